@@ -0,0 +1,101 @@
+#include "bench.h"
+#include "nvstore.h"
+#include "memcheck.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+size_t bench_nsamples = BENCH_DEFAULT_SAMPLES;
+size_t bench_nruns = BENCH_DEFAULT_RUNS;
+
+/******************************************************************************/
+/** Private Implementation: bench ------------------------------------------- */
+/******************************************************************************/
+static int bench_compare(const void *a, const void *b)
+{
+    uint64_t lhs = *(const uint64_t *)a, rhs = *(const uint64_t *)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+/** Nearest-rank [fraction] quantile of the sorted array [samples]. */
+static uint64_t bench_rank(const uint64_t *samples, size_t nsamples,
+                          double fraction)
+{
+    size_t rank = (size_t)(fraction * nsamples + 0.999999);
+
+    if (rank == 0)
+        rank = 1;
+    if (rank > nsamples)
+        rank = nsamples;
+
+    return samples[rank - 1];
+}
+
+/******************************************************************************/
+/** Public Interface: bench ------------------------------------------------- */
+/******************************************************************************/
+uint64_t bench_now_ns()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+uint64_t *bench_samples_new(size_t nsamples)
+{
+    return mccalloc(nsamples, sizeof(uint64_t));
+}
+
+void bench_samples_delete(uint64_t *samples)
+{
+    mcfree(samples);
+}
+
+/** Sorts [values] and returns their nearest-rank [fraction] quantile. */
+uint64_t bench_quantile(uint64_t *values, size_t nvalues, double fraction)
+{
+    qsort(values, nvalues, sizeof(*values), bench_compare);
+    return bench_rank(values, nvalues, fraction);
+}
+
+uint64_t bench_median(uint64_t *values, size_t nvalues)
+{
+    return bench_quantile(values, nvalues, 0.50);
+}
+
+void bench_header()
+{
+    printf("suite,benchmark,param,samples,min_ns,median_ns,mean_ns,p99_ns,"
+           "max_ns\n");
+    fflush(stdout);
+}
+
+void bench_report(const char *suite, const char *name, const char *param,
+                  uint64_t *samples, size_t nsamples)
+{
+    uint64_t total = 0;
+    size_t i;
+
+    if (nsamples == 0)
+        return;
+
+    qsort(samples, nsamples, sizeof(*samples), bench_compare);
+
+    for (i = 0; i < nsamples; i++)
+        total += samples[i];
+
+    printf("%s,%s,%s,%zu,%lu,%lu,%lu,%lu,%lu\n", suite, name, param, nsamples,
+           samples[0], bench_rank(samples, nsamples, 0.50),
+           total / nsamples, bench_rank(samples, nsamples, 0.99),
+           samples[nsamples - 1]);
+    fflush(stdout);
+}
+
+int bench_heap_init(const char *filename)
+{
+    unlink(filename);
+    return nvstore_init(filename);
+}
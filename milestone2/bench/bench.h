@@ -0,0 +1,49 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Shared harness for the benchmark suites built by [make bench].
+ *
+ * A benchmark collects one latency per sample into an array and hands it to
+ * [bench_report()], which sorts the samples and prints a single CSV row of
+ * summary statistics to stdout. Each suite is a plain function registered in
+ * [bench_main.c] which prints its own CSV header, then its rows in a fixed 
+ * order. Suites seed [rand()] with [BENCH_SEED] so that two runs on the same
+ * machine are comparable.
+ *
+ * Operations too fast to time individually are timed in batches, in which
+ * case each sample is the mean latency of one operation within the batch.
+ *
+ * Every latency is reported in nanoseconds.
+ */
+
+#define BENCH_SEED              0x5EED
+#define BENCH_DEFAULT_SAMPLES   101
+#define BENCH_WARMUP_SAMPLES    5
+#define BENCH_DEFAULT_RUNS      3
+
+/** Samples taken by each microbenchmark, settable from the command line. */
+extern size_t bench_nsamples;
+
+/** Repetitions of each end-to-end configuration, settable likewise. */
+extern size_t bench_nruns;
+
+uint64_t bench_now_ns();
+
+uint64_t *bench_samples_new(size_t nsamples);
+void bench_samples_delete(uint64_t *samples);
+
+uint64_t bench_quantile(uint64_t *values, size_t nvalues, double fraction);
+uint64_t bench_median(uint64_t *values, size_t nvalues);
+
+void bench_header();
+void bench_report(const char *suite, const char *name, const char *param,
+                  uint64_t *samples, size_t nsamples);
+
+/** Creates an empty heap file [filename], removing any earlier contents. */
+int bench_heap_init(const char *filename);
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * crheap_bench: runs the benchmark suites of the checkpoint-restore framework
+ * and prints their results to stdout as CSV.
+ *
+ *     usage: crheap_bench [-n samples] [-r runs] [suite...]
+ *
+ * With no suites named, every suite is run in the order listed below. Every
+ * suite prints a CSV table of its own, headed by its column names.
+ */
+#include "bench.h"
+#include "microbench.h"
+#include "workload.h"
+#include "recovery.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+struct bench_suite
+{
+    const char *name;
+    void (*run)();
+};
+
+static const struct bench_suite s_suites[] = {
+    {"micro", run_microbenchmarks},
+    {"workload", run_workload_benchmarks},
+    {"recovery", run_recovery_benchmarks},
+};
+
+#define NSUITES     (sizeof(s_suites) / sizeof(s_suites[0]))
+
+static void usage(const char *argv0)
+{
+    size_t i;
+
+    fprintf(stderr, "usage: %s [-n samples] [-r runs] [suite...]\n", argv0);
+    fprintf(stderr, "suites:");
+
+    for (i = 0; i < NSUITES; i++)
+        fprintf(stderr, " %s", s_suites[i].name);
+
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+    bool selected[NSUITES] = {false}, any = false;
+    int arg;
+    size_t i;
+
+    for (arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc)
+        {
+            bench_nsamples = strtoul(argv[++arg], NULL, 10);
+            if (bench_nsamples == 0)
+            {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+
+        if (strcmp(argv[arg], "-r") == 0 && arg + 1 < argc)
+        {
+            bench_nruns = strtoul(argv[++arg], NULL, 10);
+            if (bench_nruns == 0)
+            {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+
+        for (i = 0; i < NSUITES; i++)
+            if (strcmp(argv[arg], s_suites[i].name) == 0)
+                break;
+
+        if (i == NSUITES)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        selected[i] = any = true;
+    }
+
+    for (i = 0; i < NSUITES; i++)
+        if (!any || selected[i])
+            s_suites[i].run();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,833 @@
+#include "microbench.h"
+#include "bench.h"
+
+#include "crheap.h"
+#include "nvstore.h"
+#include "checkpoint.h"
+#include "vblock.h"
+#include "vtsaddrtable.h"
+#include "vtsdirtyset.h"
+#include "contextswitch.h"
+#include "crthread.h"
+#include "memcheck.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/******************************************************************************/
+/** Macros, Definitions, and Static Variables: microbench ------------------- */
+/******************************************************************************/
+#define SUITE               "micro"
+#define PARAMLEN            32
+
+/** operations timed together for each sample of the very fast benchmarks */
+#define BATCH_SIZE          1024
+
+/** the allocator benchmark allocates this many objects before freeing them */
+#define ALLOC_BATCH_SIZE    256
+
+/** heap restoration is slow, so it is sampled less often than the others */
+#define RESTORE_SAMPLES_DIV 4
+
+#define BLOCK_PAGES         16
+
+static const size_t s_dirty_pages[] = {1, 4, 16, 64, 256};
+static const size_t s_table_pages[] = {64, 1024, 16384};
+static const size_t s_dirtyset_sizes[] = {1024, 16384};
+static const size_t s_alloc_sizes[] = {16, 64, 256, 1024, 4096, 16384};
+static const size_t s_restore_pages[] = {16, 64, 256, 1024};
+
+/** small free blocks left between live ones before timing the allocator */
+static const size_t s_fragments[] = {0, 1024, 16384};
+
+#define FRAGMENT_SIZE       32
+#define FRAGMENTED_SIZE     256
+
+/** threads allocating at once, each from an arena of its own */
+#define MAX_ALLOC_THREADS   8
+#define THREADED_SIZE       64
+
+static const size_t s_alloc_threads[] = {1, 2, 4, MAX_ALLOC_THREADS};
+
+static pthread_barrier_t s_alloc_barrier;
+
+/** hot counters, each allocated next to a record which is never written */
+#define HINT_COUNTERS       256
+#define HINT_RECORD_SIZE    4096
+
+/** an array appended to a step at a time, from one large object size on */
+#define GROW_INITIAL        (1 << 20)
+#define GROW_FINAL          (16 << 20)
+#define GROW_STEP           (64 << 10)
+
+/** the ways a thread can commit itself, and their names in reports */
+static const enum crthread_cpmode s_cpmodes[] = {
+    CRTHREAD_CP_RESTART, CRTHREAD_CP_INPLACE, CRTHREAD_CP_ASYNC
+};
+static const char *const s_cpmode_names[] = {"restart", "inplace", "async"};
+
+/** crthreads checkpointing at once, restarted by the resurrector workers */
+#define MAX_BURST_THREADS   64
+
+static const size_t s_burst_threads[] = {1, 8, MAX_BURST_THREADS};
+
+static pthread_barrier_t s_burst_barrier;
+
+/** crthreads held in a heap, all resurrected when it is restored */
+#define MAX_RESURRECT_THREADS   512
+
+static const size_t s_resurrect_threads[] = {1, 64, MAX_RESURRECT_THREADS};
+
+#define ARRAY_LEN(arr)      (sizeof(arr) / sizeof((arr)[0]))
+
+/******************************************************************************/
+/** Private Implementation: microbench -------------------------------------- */
+/******************************************************************************/
+
+/** Writes one byte to each page of [data], faulting in those not yet dirty. */
+static void microbench_touch(uint8_t *data, size_t npages)
+{
+    size_t i;
+
+    for (i = 0; i < npages; i++)
+        data[i * sysconf(_SC_PAGE_SIZE)]++;
+}
+
+/** Reads one byte from each page of [data], fetching them from the heap. */
+static uint8_t microbench_read(volatile uint8_t *data, size_t npages)
+{
+    uint8_t sum = 0;
+    size_t i;
+
+    for (i = 0; i < npages; i++)
+        sum += data[i * sysconf(_SC_PAGE_SIZE)];
+
+    return sum;
+}
+
+/**
+ * Times commits of [npages] dirty pages. Background commits are also timed up
+ * to the return of the submission alone, which is the pause they cost the 
+ * application.
+ */
+static void microbench_commit(size_t npages, bool background)
+{
+    struct checkpoint *checkpoint;
+    char param[PARAMLEN];
+    uint64_t *samples, *submits, start;
+    uint8_t *data;
+    size_t i;
+
+    bench_heap_init("bench_commit.heap");
+
+    samples = bench_samples_new(bench_nsamples);
+    submits = bench_samples_new(bench_nsamples);
+    data = nvstore_allocpage(npages);
+
+    for (i = 0; i < BENCH_WARMUP_SAMPLES + bench_nsamples; i++)
+    {
+        microbench_touch(data, npages);
+
+        start = bench_now_ns();
+        if (background)
+        {
+            checkpoint = nvstore_checkpoint_everything_background();
+            if (i >= BENCH_WARMUP_SAMPLES)
+                submits[i - BENCH_WARMUP_SAMPLES] = bench_now_ns() - start;
+
+            checkpoint_wait(checkpoint);
+            checkpoint_delete(checkpoint);
+        }
+        else
+            nvstore_checkpoint_everything();
+
+        if (i >= BENCH_WARMUP_SAMPLES)
+            samples[i - BENCH_WARMUP_SAMPLES] = bench_now_ns() - start;
+    }
+
+    snprintf(param, PARAMLEN, "%zu", npages);
+    bench_report(SUITE, background ? "commit_background" : "commit", param,
+                 samples, bench_nsamples);
+
+    if (background)
+        bench_report(SUITE, "commit_background_submit", param, submits, 
+                     bench_nsamples);
+
+    bench_samples_delete(submits);
+    bench_samples_delete(samples);
+    nvstore_shutdown();
+}
+
+static void microbench_crmalloc(const char *allocname, const char *freename,
+                                size_t size, size_t param_value)
+{
+    uint64_t *allocs, *frees, start;
+    void *ptrs[ALLOC_BATCH_SIZE];
+    char param[PARAMLEN];
+    size_t i, j;
+
+    allocs = bench_samples_new(bench_nsamples);
+    frees = bench_samples_new(bench_nsamples);
+
+    for (i = 0; i < BENCH_WARMUP_SAMPLES + bench_nsamples; i++)
+    {
+        start = bench_now_ns();
+        for (j = 0; j < ALLOC_BATCH_SIZE; j++)
+            ptrs[j] = crmalloc(size);
+
+        if (i >= BENCH_WARMUP_SAMPLES)
+            allocs[i - BENCH_WARMUP_SAMPLES] =
+                (bench_now_ns() - start) / ALLOC_BATCH_SIZE;
+
+        start = bench_now_ns();
+        for (j = 0; j < ALLOC_BATCH_SIZE; j++)
+            crfree(ptrs[j]);
+
+        if (i >= BENCH_WARMUP_SAMPLES)
+            frees[i - BENCH_WARMUP_SAMPLES] =
+                (bench_now_ns() - start) / ALLOC_BATCH_SIZE;
+    }
+
+    snprintf(param, PARAMLEN, "%zu", param_value);
+    bench_report(SUITE, allocname, param, allocs, bench_nsamples);
+    bench_report(SUITE, freename, param, frees, bench_nsamples);
+
+    bench_samples_delete(allocs);
+    bench_samples_delete(frees);
+}
+
+static void microbench_restore(size_t npages, size_t nsamples)
+{
+    char param[PARAMLEN];
+    uint64_t *samples, start;
+    uint8_t *blocks[npages / BLOCK_PAGES];
+    size_t i, j;
+
+    bench_heap_init("bench_restore.heap");
+
+    for (j = 0; j < npages / BLOCK_PAGES; j++)
+    {
+        blocks[j] = nvstore_allocpage(BLOCK_PAGES);
+        microbench_touch(blocks[j], BLOCK_PAGES);
+    }
+
+    nvstore_checkpoint_everything();
+    nvstore_shutdown();
+
+    samples = bench_samples_new(nsamples);
+
+    for (i = 0; i < nsamples; i++)
+    {
+        start = bench_now_ns();
+        nvstore_init("bench_restore.heap");
+
+        for (j = 0; j < npages / BLOCK_PAGES; j++)
+            microbench_read(blocks[j], BLOCK_PAGES);
+
+        samples[i] = bench_now_ns() - start;
+        nvstore_shutdown();
+    }
+
+    snprintf(param, PARAMLEN, "%zu", npages);
+    bench_report(SUITE, "restore", param, samples, nsamples);
+
+    bench_samples_delete(samples);
+}
+
+/******************************************************************************/
+/** Public Interface: microbench -------------------------------------------- */
+/******************************************************************************/
+
+/**
+ * Latency of the first write to a fresh heap page, one fault per sample, and 
+ * of the first read, which maps the zero page instead.
+ */
+void bench_fault_first_touch()
+{
+    uint64_t *samples, start;
+    volatile uint8_t *data;
+    size_t i;
+
+    bench_heap_init("bench_fault.heap");
+
+    samples = bench_samples_new(bench_nsamples);
+    data = nvstore_allocpage(BENCH_WARMUP_SAMPLES + bench_nsamples);
+
+    for (i = 0; i < BENCH_WARMUP_SAMPLES + bench_nsamples; i++)
+    {
+        start = bench_now_ns();
+        data[i * sysconf(_SC_PAGE_SIZE)] = 1;
+
+        if (i >= BENCH_WARMUP_SAMPLES)
+            samples[i - BENCH_WARMUP_SAMPLES] = bench_now_ns() - start;
+    }
+
+    bench_report(SUITE, "fault_first_touch", "1", samples, bench_nsamples);
+
+    data = nvstore_allocpage(BENCH_WARMUP_SAMPLES + bench_nsamples);
+
+    for (i = 0; i < BENCH_WARMUP_SAMPLES + bench_nsamples; i++)
+    {
+        start = bench_now_ns();
+        (void)data[i * sysconf(_SC_PAGE_SIZE)];
+
+        if (i >= BENCH_WARMUP_SAMPLES)
+            samples[i - BENCH_WARMUP_SAMPLES] = bench_now_ns() - start;
+    }
+
+    bench_report(SUITE, "fault_first_read", "1", samples, bench_nsamples);
+
+    bench_samples_delete(samples);
+    nvstore_shutdown();
+}
+
+/** Latency of a full checkpoint against the number of dirty heap pages. */
+void bench_commit_dirty_pages()
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_LEN(s_dirty_pages); i++)
+        microbench_commit(s_dirty_pages[i], false);
+
+    for (i = 0; i < ARRAY_LEN(s_dirty_pages); i++)
+        microbench_commit(s_dirty_pages[i], true);
+}
+
+/** Lookup of random addresses in tables holding a varying number of pages. */
+void bench_vtsaddrtable_find()
+{
+    struct vtsaddrtable *table;
+    struct vblock *block;
+    char param[PARAMLEN];
+    uint64_t *samples, start;
+    uint8_t *addrs[BATCH_SIZE];
+    size_t i, j, k, npages;
+
+    samples = bench_samples_new(bench_nsamples);
+
+    for (k = 0; k < ARRAY_LEN(s_table_pages); k++)
+    {
+        npages = s_table_pages[k];
+        block = vblock_new(NULL, npages, 0);
+        table = vtsaddrtable_new(NVADDRTABLE_INIT_POWER);
+
+        vtsaddrtable_insert(table, block);
+
+        for (i = 0; i < BENCH_WARMUP_SAMPLES + bench_nsamples; i++)
+        {
+            for (j = 0; j < BATCH_SIZE; j++)
+                addrs[j] = (uint8_t *)block->pgstart
+                         + (rand() % (npages * sysconf(_SC_PAGE_SIZE)));
+
+            start = bench_now_ns();
+            for (j = 0; j < BATCH_SIZE; j++)
+                vtsaddrtable_find(table, addrs[j]);
+
+            if (i >= BENCH_WARMUP_SAMPLES)
+                samples[i - BENCH_WARMUP_SAMPLES] =
+                    (bench_now_ns() - start) / BATCH_SIZE;
+        }
+
+        snprintf(param, PARAMLEN, "%zu", npages);
+        bench_report(SUITE, "vtsaddrtable_find", param, samples,
+                     bench_nsamples);
+
+        vtsaddrtable_delete(table);
+        vblock_delete(block);
+    }
+
+    bench_samples_delete(samples);
+}
+
+/** Insertion of distinct pages into a dirty set, up to a given set size. */
+void bench_vtsdirtyset_insert()
+{
+    struct vtsdirtyset *set;
+    char param[PARAMLEN];
+    uint64_t *samples, start;
+    uintptr_t base;
+    size_t i, j, k, nelem;
+
+    samples = bench_samples_new(bench_nsamples);
+
+    for (k = 0; k < ARRAY_LEN(s_dirtyset_sizes); k++)
+    {
+        nelem = s_dirtyset_sizes[k];
+        base = (uintptr_t)rand() * sysconf(_SC_PAGE_SIZE);
+
+        for (i = 0; i < BENCH_WARMUP_SAMPLES + bench_nsamples; i++)
+        {
+            set = vtsdirtyset_new();
+
+            start = bench_now_ns();
+            for (j = 0; j < nelem; j++)
+                vtsdirtyset_insert(set, (void *)(base
+                                                 + j * sysconf(_SC_PAGE_SIZE)));
+
+            if (i >= BENCH_WARMUP_SAMPLES)
+                samples[i - BENCH_WARMUP_SAMPLES] =
+                    (bench_now_ns() - start) / nelem;
+
+            vtsdirtyset_delete(set);
+        }
+
+        snprintf(param, PARAMLEN, "%zu", nelem);
+        bench_report(SUITE, "vtsdirtyset_insert", param, samples,
+                     bench_nsamples);
+    }
+
+    bench_samples_delete(samples);
+}
+
+/** Throughput of crmalloc/crfree, reported per operation, by object size. */
+void bench_crmalloc_size_classes()
+{
+    size_t i;
+
+    unlink("bench_crmalloc.heap");
+    crheap_init("bench_crmalloc.heap");
+
+    for (i = 0; i < ARRAY_LEN(s_alloc_sizes); i++)
+        microbench_crmalloc("crmalloc", "crfree", s_alloc_sizes[i],
+                            s_alloc_sizes[i]);
+
+    crheap_shutdown_nosave();
+}
+
+/**
+ * Throughput of crmalloc/crfree of one size, by the number of smaller free 
+ * blocks pinned between live ones elsewhere in the heap.
+ */
+void bench_crmalloc_fragmented()
+{
+    void **pinned;
+    size_t i, j;
+
+    for (i = 0; i < ARRAY_LEN(s_fragments); i++)
+    {
+        unlink("bench_crmalloc.heap");
+        crheap_init("bench_crmalloc.heap");
+
+        pinned = mcmalloc((2 * s_fragments[i] + 1) * sizeof(*pinned));
+        for (j = 0; j < 2 * s_fragments[i]; j++)
+            pinned[j] = crmalloc(FRAGMENT_SIZE);
+        for (j = 0; j < s_fragments[i]; j++)
+            crfree(pinned[2 * j]);
+
+        microbench_crmalloc("crmalloc_fragmented", "crfree_fragmented",
+                            FRAGMENTED_SIZE, s_fragments[i]);
+
+        mcfree(pinned);
+        crheap_shutdown_nosave();
+    }
+}
+
+/** Allocates and frees a batch per sample, in step with the other threads. */
+static void *microbench_tf_crmalloc(__attribute__((unused)) void *arg)
+{
+    void *ptrs[ALLOC_BATCH_SIZE];
+    size_t i, j;
+
+    for (i = 0; i < BENCH_WARMUP_SAMPLES + bench_nsamples; i++)
+    {
+        pthread_barrier_wait(&s_alloc_barrier);
+
+        for (j = 0; j < ALLOC_BATCH_SIZE; j++)
+            ptrs[j] = crmalloc(THREADED_SIZE);
+        for (j = 0; j < ALLOC_BATCH_SIZE; j++)
+            crfree(ptrs[j]);
+
+        pthread_barrier_wait(&s_alloc_barrier);
+    }
+
+    return NULL;
+}
+
+/**
+ * Throughput of crmalloc/crfree with several threads allocating at once,
+ * reported as wall time per crmalloc/crfree pair over all threads.
+ */
+void bench_crmalloc_threads()
+{
+    pthread_t threads[MAX_ALLOC_THREADS];
+    uint64_t *samples, start;
+    char param[PARAMLEN];
+    size_t i, j, nthreads;
+
+    samples = bench_samples_new(bench_nsamples);
+
+    for (i = 0; i < ARRAY_LEN(s_alloc_threads); i++)
+    {
+        nthreads = s_alloc_threads[i];
+
+        unlink("bench_crmalloc.heap");
+        crheap_init("bench_crmalloc.heap");
+        pthread_barrier_init(&s_alloc_barrier, NULL, nthreads + 1);
+
+        for (j = 0; j < nthreads; j++)
+            pthread_create(&threads[j], NULL, microbench_tf_crmalloc, NULL);
+
+        for (j = 0; j < BENCH_WARMUP_SAMPLES + bench_nsamples; j++)
+        {
+            pthread_barrier_wait(&s_alloc_barrier);
+            start = bench_now_ns();
+            pthread_barrier_wait(&s_alloc_barrier);
+
+            if (j >= BENCH_WARMUP_SAMPLES)
+                samples[j - BENCH_WARMUP_SAMPLES] = (bench_now_ns() - start)
+                    / (nthreads * ALLOC_BATCH_SIZE);
+        }
+
+        for (j = 0; j < nthreads; j++)
+            pthread_join(threads[j], NULL);
+
+        snprintf(param, PARAMLEN, "%zu", nthreads);
+        bench_report(SUITE, "crmalloc_threads", param, samples,
+                     bench_nsamples);
+
+        pthread_barrier_destroy(&s_alloc_barrier);
+        crheap_shutdown_nosave();
+    }
+
+    bench_samples_delete(samples);
+}
+
+/**
+ * Commit latency after every hot counter was updated, with the counters and
+ * the cold records allocated between them mixed on the same pages, and then
+ * kept apart by placement hints.
+ */
+void bench_crmalloc_hints()
+{
+    uint64_t *counters[HINT_COUNTERS], *samples, start;
+    uint8_t *record;
+    size_t i, j;
+    int hinted;
+
+    samples = bench_samples_new(bench_nsamples);
+
+    for (hinted = 0; hinted < 2; hinted++)
+    {
+        unlink("bench_crmalloc.heap");
+        crheap_init("bench_crmalloc.heap");
+
+        for (i = 0; i < HINT_COUNTERS; i++)
+        {
+            counters[i] = crmalloc_hint(sizeof(*counters[i]),
+                                        hinted ? CR_HOT : 0);
+            *counters[i] = 0;
+
+            record = crmalloc_hint(HINT_RECORD_SIZE, hinted ? CR_COLD : 0);
+            memset(record, (int)i, HINT_RECORD_SIZE);
+        }
+
+        nvstore_checkpoint_everything();
+
+        for (i = 0; i < BENCH_WARMUP_SAMPLES + bench_nsamples; i++)
+        {
+            for (j = 0; j < HINT_COUNTERS; j++)
+                (*counters[j])++;
+
+            start = bench_now_ns();
+            nvstore_checkpoint_everything();
+
+            if (i >= BENCH_WARMUP_SAMPLES)
+                samples[i - BENCH_WARMUP_SAMPLES] = bench_now_ns() - start;
+        }
+
+        bench_report(SUITE, "crmalloc_hints_commit",
+                     hinted ? "hinted" : "plain", samples, bench_nsamples);
+
+        crheap_shutdown_nosave();
+    }
+
+    bench_samples_delete(samples);
+}
+
+/**
+ * Latency of each crrealloc() growing an array by a fixed step, as a vector
+ * does on every append that overflows it, with the new pages written after.
+ */
+void bench_crrealloc_grow()
+{
+    uint64_t *samples, start;
+    char param[PARAMLEN];
+    size_t size, i, nsamples = 0;
+    uint8_t *array;
+
+    samples = bench_samples_new((GROW_FINAL - GROW_INITIAL) / GROW_STEP);
+
+    unlink("bench_crmalloc.heap");
+    crheap_init("bench_crmalloc.heap");
+
+    array = crmalloc(GROW_INITIAL);
+    microbench_touch(array, GROW_INITIAL / sysconf(_SC_PAGE_SIZE));
+
+    for (size = GROW_INITIAL; size < GROW_FINAL; size += GROW_STEP)
+    {
+        start = bench_now_ns();
+        array = crrealloc(array, size + GROW_STEP);
+        samples[nsamples++] = bench_now_ns() - start;
+
+        for (i = size; i < size + GROW_STEP; i += sysconf(_SC_PAGE_SIZE))
+            array[i]++;
+    }
+
+    snprintf(param, PARAMLEN, "%d", GROW_STEP);
+    bench_report(SUITE, "crrealloc_grow", param, samples, nsamples);
+
+    crheap_shutdown_nosave();
+    bench_samples_delete(samples);
+}
+
+/** Cost of [save_context()] alone and of a save/load round trip. */
+void bench_context_switch()
+{
+    struct crcontext context;
+    uint64_t *samples;
+    volatile uint64_t start;
+    volatile size_t i, j;
+
+    samples = bench_samples_new(bench_nsamples);
+
+    for (i = 0; i < BENCH_WARMUP_SAMPLES + bench_nsamples; i++)
+    {
+        start = bench_now_ns();
+        for (j = 0; j < BATCH_SIZE; j++)
+            save_context(&context);
+
+        if (i >= BENCH_WARMUP_SAMPLES)
+            samples[i - BENCH_WARMUP_SAMPLES] =
+                (bench_now_ns() - start) / BATCH_SIZE;
+    }
+
+    bench_report(SUITE, "save_context", "1", samples, bench_nsamples);
+
+    /* every [load_context()] resumes at the [save_context()] below it */
+    for (i = 0; i < BENCH_WARMUP_SAMPLES + bench_nsamples; i++)
+    {
+        j = 0;
+        start = bench_now_ns();
+
+        save_context(&context);
+        if (++j < BATCH_SIZE)
+            load_context(&context);
+
+        if (i >= BENCH_WARMUP_SAMPLES)
+            samples[i - BENCH_WARMUP_SAMPLES] =
+                (bench_now_ns() - start) / BATCH_SIZE;
+    }
+
+    bench_report(SUITE, "save_load_context", "1", samples, bench_nsamples);
+
+    bench_samples_delete(samples);
+}
+
+/** 
+ * Checkpoints itself once per sample. Every local is volatile, as a thread
+ * restarted from its checkpoint only gets back what was saved to its stack.
+ */
+static void *microbench_tf_checkpoint(void *samples_vp)
+{
+    uint64_t *volatile samples = samples_vp;
+    volatile uint64_t start;
+    volatile size_t i;
+
+    for (i = 0; i < BENCH_WARMUP_SAMPLES + bench_nsamples; i++)
+    {
+        start = bench_now_ns();
+        crthread_checkpoint();
+
+        if (i >= BENCH_WARMUP_SAMPLES)
+            samples[i - BENCH_WARMUP_SAMPLES] = bench_now_ns() - start;
+    }
+
+    return NULL;
+}
+
+/** Latency of [crthread_checkpoint()] in each of the checkpoint modes. */
+void bench_thread_checkpoint()
+{
+    struct crthread *thread;
+    uint64_t *samples;
+    size_t i;
+
+    samples = bench_samples_new(bench_nsamples);
+
+    for (i = 0; i < ARRAY_LEN(s_cpmodes); i++)
+    {
+        unlink("bench_crthread.heap");
+        crheap_init("bench_crthread.heap");
+        crthread_set_checkpoint_mode(s_cpmodes[i]);
+
+        thread = crthread_new(microbench_tf_checkpoint, samples, 0);
+        crthread_fork(thread);
+        crthread_join(thread);
+        crthread_delete(thread);
+
+        bench_report(SUITE, "thread_checkpoint", s_cpmode_names[i], samples,
+                     bench_nsamples);
+
+        crthread_set_checkpoint_mode(CRTHREAD_CP_RESTART);
+        crheap_shutdown_nosave();
+    }
+
+    bench_samples_delete(samples);
+}
+
+/** Checkpoints itself once per sample, in step with the other threads. */
+static void *microbench_tf_burst(__attribute__((unused)) void *arg)
+{
+    volatile size_t i;
+
+    for (i = 0; i < BENCH_WARMUP_SAMPLES + bench_nsamples; i++)
+    {
+        pthread_barrier_wait(&s_burst_barrier);
+        crthread_checkpoint();
+        pthread_barrier_wait(&s_burst_barrier);
+    }
+
+    return NULL;
+}
+
+/**
+ * Time until every one of several crthreads checkpointing at once has been
+ * restarted, which is bounded by how many of their commits are in flight.
+ */
+void bench_thread_checkpoint_burst()
+{
+    struct crthread *threads[MAX_BURST_THREADS];
+    uint64_t *samples, start;
+    char param[PARAMLEN];
+    size_t i, j, nthreads;
+
+    samples = bench_samples_new(bench_nsamples);
+
+    for (i = 0; i < ARRAY_LEN(s_burst_threads); i++)
+    {
+        nthreads = s_burst_threads[i];
+
+        unlink("bench_crthread.heap");
+        crheap_init("bench_crthread.heap");
+        pthread_barrier_init(&s_burst_barrier, NULL, nthreads + 1);
+
+        for (j = 0; j < nthreads; j++)
+        {
+            threads[j] = crthread_new(microbench_tf_burst, NULL, 0);
+            crthread_fork(threads[j]);
+        }
+
+        for (j = 0; j < BENCH_WARMUP_SAMPLES + bench_nsamples; j++)
+        {
+            pthread_barrier_wait(&s_burst_barrier);
+            start = bench_now_ns();
+            pthread_barrier_wait(&s_burst_barrier);
+
+            if (j >= BENCH_WARMUP_SAMPLES)
+                samples[j - BENCH_WARMUP_SAMPLES] = bench_now_ns() - start;
+        }
+
+        for (j = 0; j < nthreads; j++)
+        {
+            crthread_join(threads[j]);
+            crthread_delete(threads[j]);
+        }
+
+        snprintf(param, PARAMLEN, "%zu", nthreads);
+        bench_report(SUITE, "thread_checkpoint_burst", param, samples,
+                     bench_nsamples);
+
+        pthread_barrier_destroy(&s_burst_barrier);
+        crheap_shutdown_nosave();
+    }
+
+    bench_samples_delete(samples);
+}
+
+/** Returns at once, so that a resurrected thread costs only its restoration */
+static void *microbench_tf_noop(__attribute__((unused)) void *arg)
+{
+    return NULL;
+}
+
+/** Time of [crheap_init()] for a heap holding a number of crthreads. */
+void bench_resurrect_threads()
+{
+    struct crthread **threads;
+    uint64_t *samples, start;
+    char param[PARAMLEN];
+    size_t i, j, k, nthreads, nsamples;
+
+    nsamples = bench_nsamples / RESTORE_SAMPLES_DIV;
+    if (nsamples == 0)
+        nsamples = 1;
+
+    samples = bench_samples_new(nsamples);
+    threads = mcmalloc(MAX_RESURRECT_THREADS * sizeof(*threads));
+
+    for (i = 0; i < ARRAY_LEN(s_resurrect_threads); i++)
+    {
+        nthreads = s_resurrect_threads[i];
+
+        unlink("bench_resurrect.heap");
+        crheap_init("bench_resurrect.heap");
+        for (j = 0; j < nthreads; j++)
+            threads[j] = crthread_new(microbench_tf_noop, NULL, 0);
+        crheap_shutdown();
+
+        for (j = 0; j < nsamples; j++)
+        {
+            start = bench_now_ns();
+            crheap_init("bench_resurrect.heap");
+            samples[j] = bench_now_ns() - start;
+
+            for (k = 0; k < nthreads; k++)
+                crthread_join(threads[k]);
+            crheap_shutdown_nosave();
+        }
+
+        snprintf(param, PARAMLEN, "%zu", nthreads);
+        bench_report(SUITE, "resurrect_threads", param, samples, nsamples);
+    }
+
+    mcfree(threads);
+    bench_samples_delete(samples);
+}
+
+/** Time from [nvstore_init()] until every page of a heap has been read back. */
+void bench_restore_heap_size()
+{
+    size_t i, nsamples;
+
+    nsamples = bench_nsamples / RESTORE_SAMPLES_DIV;
+    if (nsamples == 0)
+        nsamples = 1;
+
+    for (i = 0; i < ARRAY_LEN(s_restore_pages); i++)
+        microbench_restore(s_restore_pages[i], nsamples);
+}
+
+void run_microbenchmarks()
+{
+    srand(BENCH_SEED);
+    bench_header();
+
+    bench_fault_first_touch();
+    bench_commit_dirty_pages();
+    bench_vtsaddrtable_find();
+    bench_vtsdirtyset_insert();
+    bench_crmalloc_size_classes();
+    bench_crmalloc_fragmented();
+    bench_crmalloc_threads();
+    bench_crmalloc_hints();
+    bench_crrealloc_grow();
+    bench_context_switch();
+    bench_thread_checkpoint();
+    bench_thread_checkpoint_burst();
+    bench_resurrect_threads();
+    bench_restore_heap_size();
+}
@@ -0,0 +1,28 @@
+#ifndef __MICROBENCH_H__
+#define __MICROBENCH_H__
+
+/**
+ * Microbenchmarks of the primitives every checkpoint is built from: page
+ * faults, commits, the volatile address table and dirty set, the persistent
+ * allocator, the context switch routines, thread checkpoints, and the 
+ * restoration of heaps and their threads.
+ */
+
+void bench_fault_first_touch();
+void bench_commit_dirty_pages();
+void bench_vtsaddrtable_find();
+void bench_vtsdirtyset_insert();
+void bench_crmalloc_size_classes();
+void bench_crmalloc_fragmented();
+void bench_crmalloc_threads();
+void bench_crmalloc_hints();
+void bench_crrealloc_grow();
+void bench_context_switch();
+void bench_thread_checkpoint();
+void bench_thread_checkpoint_burst();
+void bench_resurrect_threads();
+void bench_restore_heap_size();
+
+void run_microbenchmarks();
+
+#endif
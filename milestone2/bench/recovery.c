@@ -0,0 +1,340 @@
+#include "recovery.h"
+#include "bench.h"
+
+#include "crheap.h"
+#include "nvstore.h"
+#include "checkpoint.h"
+#include "crashsched.h"
+#include "memcheck.h"
+
+#include "primesieve.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+/******************************************************************************/
+/** Macros, Definitions, and Static Variables: recovery --------------------- */
+/******************************************************************************/
+#define RECOVERY_HEAP           "bench_recovery.heap"
+#define RECOVERY_LIMIT          (1 << 22)
+#define RECOVERY_SEGMENT        (1 << 14)
+#define RECOVERY_NSEGMENTS      (RECOVERY_LIMIT / RECOVERY_SEGMENT)
+
+/** segments sieved between two checkpoints */
+#define RECOVERY_PERIOD         16
+
+/** scale of every crash schedule, and the kills tolerated before giving up */
+#define RECOVERY_KILL_US        30000
+#define RECOVERY_MAX_KILLS      256
+
+/** incarnations of a single run, each of which is sampled once */
+#define RECOVERY_MAX_SAMPLES    (RECOVERY_MAX_KILLS + 1)
+
+/** Progress of the sieve, kept in the heap. */
+struct recovery_state
+{
+    bool *sieve;
+    size_t cursor;          /* segments done as of the last checkpoint        */
+};
+
+/**
+ * Progress of the current child as observed by the driver, in memory shared
+ * between the two. Written by the child, read by the driver once it is dead.
+ */
+struct recovery_progress
+{
+    struct recovery_state *volatile state;  /* root of the heap, after setup */
+    volatile uint64_t start_ns;         /* when the driver forked the child   */
+    volatile uint64_t resume_ns;        /* first useful instruction, or 0     */
+    volatile uint64_t restored_bytes;   /* bytes of pages read at restore     */
+    volatile size_t resumed_at;         /* segment the child resumed from     */
+    volatile size_t done;               /* segments done by the child so far  */
+};
+
+/** Measurements of one run to completion under a schedule. */
+struct recovery_result
+{
+    uint64_t total_ns;
+    uint64_t nkills;
+    uint64_t recomputed;
+    bool correct;
+};
+
+/******************************************************************************/
+/** Private Implementation: recovery ---------------------------------------- */
+/******************************************************************************/
+
+/**
+ * Forks a child for one step of a run. Every step that maps the heap runs in
+ * a child of its own, so that the driver's address space stays clear for the
+ * blocks the next incarnation restores.
+ */
+static pid_t recovery_fork()
+{
+    fflush(stdout);
+    fflush(stderr);
+
+    return fork();
+}
+
+/** Builds the heap of a fresh run, with its inputs already durable. */
+static void recovery_setup(struct recovery_progress *progress)
+{
+    struct recovery_state *state;
+
+    unlink(RECOVERY_HEAP);
+    crheap_init(RECOVERY_HEAP);
+
+    state = crmalloc(sizeof(*state));
+    state->sieve = crmalloc(RECOVERY_LIMIT * sizeof(*state->sieve));
+    state->cursor = 0;
+
+    primesieve_init(state->sieve, RECOVERY_LIMIT);
+
+    crheap_checkpoint_everything();
+    crheap_shutdown_nosave();
+
+    progress->state = state;
+    exit(EXIT_SUCCESS);
+}
+
+/** Body of every incarnation of the child: restore, resume, and finish. */
+static void recovery_child(struct recovery_state *state,
+                           struct recovery_progress *progress)
+{
+    struct checkpoint *checkpoint;
+    struct nvstats stats;
+    size_t segment;
+
+    crheap_init(RECOVERY_HEAP);
+
+    nvstore_get_stats(&stats);
+    progress->restored_bytes = stats.pages_restored * sysconf(_SC_PAGE_SIZE);
+
+    progress->resumed_at = progress->done = state->cursor;
+    progress->resume_ns = bench_now_ns();
+
+    for (segment = state->cursor; segment < RECOVERY_NSEGMENTS; segment++)
+    {
+        primesieve_segment(state->sieve, segment * RECOVERY_SEGMENT,
+                           (segment + 1) * RECOVERY_SEGMENT);
+        progress->done = segment + 1;
+
+        if ((segment + 1) % RECOVERY_PERIOD == 0
+            || segment + 1 == RECOVERY_NSEGMENTS)
+        {
+            state->cursor = segment + 1;
+
+            checkpoint = crheap_checkpoint_everything_background();
+            checkpoint_wait(checkpoint);
+            checkpoint_delete(checkpoint);
+        }
+    }
+
+    crheap_shutdown_nosave();
+    exit(EXIT_SUCCESS);
+}
+
+/** Restores the finished heap and checks the answer left in it. */
+static void recovery_check(struct recovery_state *state, size_t expected)
+{
+    bool correct;
+
+    crheap_init(RECOVERY_HEAP);
+    correct = state->cursor == RECOVERY_NSEGMENTS
+           && primesieve_count(state->sieve, RECOVERY_LIMIT) == expected;
+    crheap_shutdown_nosave();
+
+    exit(correct ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/** Reaps the step run by [child] and tells whether it succeeded. */
+static bool recovery_step(pid_t child)
+{
+    int status;
+
+    return child != -1 && waitpid(child, &status, 0) == child
+        && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+/**
+ * Runs the sieve to completion, killing it under [schedule] unless [kills] is
+ * false. Resume latencies and restored bytes of every incarnation are appended
+ * to [resume_ns] and [restored], counting up [nsamples].
+ */
+static bool recovery_run(bool kills, enum crashsched schedule, size_t expected,
+                         struct recovery_progress *progress,
+                         struct recovery_result *result, uint64_t *resume_ns,
+                         uint64_t *restored, size_t *nsamples)
+{
+    size_t lost = 0;
+    uint64_t start;
+    int status;
+    pid_t child;
+    bool killed;
+
+    child = recovery_fork();
+    if (child == 0)
+        recovery_setup(progress);
+    if (!recovery_step(child))
+        return false;
+
+    result->nkills = 0;
+    result->recomputed = 0;
+    start = bench_now_ns();
+
+    for (;;)
+    {
+        progress->resume_ns = 0;
+        progress->done = 0;
+        progress->start_ns = bench_now_ns();
+
+        child = recovery_fork();
+        if (child == -1)
+            return false;
+
+        if (child == 0)
+            recovery_child(progress->state, progress);
+
+        killed = kills && crashsched_wait(schedule, RECOVERY_KILL_US, child,
+                                          &status);
+        if (killed)
+            crashsched_kill(child);
+        else if (!kills && waitpid(child, &status, 0) != child)
+            return false;
+
+        /* work past the restored checkpoint was lost by an earlier kill */
+        if (progress->resume_ns != 0)
+        {
+            if (lost > progress->resumed_at)
+                result->recomputed += lost - progress->resumed_at;
+
+            lost = 0;
+            if (*nsamples < RECOVERY_MAX_SAMPLES * bench_nruns)
+            {
+                resume_ns[*nsamples] = progress->resume_ns
+                                     - progress->start_ns;
+                restored[*nsamples] = progress->restored_bytes;
+                (*nsamples)++;
+            }
+        }
+
+        if (!killed)
+            break;
+
+        if (progress->done > lost)
+            lost = progress->done;
+
+        if (++result->nkills > RECOVERY_MAX_KILLS)
+            return false;
+    }
+
+    result->total_ns = bench_now_ns() - start;
+    result->correct = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+
+    child = recovery_fork();
+    if (child == 0)
+        recovery_check(progress->state, expected);
+    result->correct = recovery_step(child) && result->correct;
+
+    return true;
+}
+
+/** Runs one schedule [bench_nruns] times and prints its row. */
+static uint64_t recovery_sweep(const char *name, bool kills,
+                               enum crashsched schedule, size_t expected,
+                               struct recovery_progress *progress,
+                               uint64_t baseline)
+{
+    struct recovery_result result;
+    uint64_t totals[bench_nruns], nkills[bench_nruns], recomputed[bench_nruns];
+    uint64_t *resume_ns, *restored, total;
+    size_t run, nsamples = 0;
+    bool correct = true;
+
+    resume_ns = bench_samples_new(RECOVERY_MAX_SAMPLES * bench_nruns);
+    restored = bench_samples_new(RECOVERY_MAX_SAMPLES * bench_nruns);
+
+    for (run = 0; run < bench_nruns; run++)
+    {
+        if (!recovery_run(kills, schedule, expected, progress, &result,
+                          resume_ns, restored, &nsamples))
+        {
+            fprintf(stderr, "recovery: %s run did not finish\n", name);
+            bench_samples_delete(resume_ns);
+            bench_samples_delete(restored);
+            return baseline;
+        }
+
+        totals[run] = result.total_ns;
+        nkills[run] = result.nkills;
+        recomputed[run] = result.recomputed;
+        correct = correct && result.correct;
+    }
+
+    total = bench_median(totals, bench_nruns);
+    if (!kills)
+        baseline = total;
+
+    printf("%s,%u,%zu,%lu,%lu,%lu,%lu,%zu,%lu,%lu,%.2f,%s\n",
+           name, kills ? RECOVERY_KILL_US : 0, bench_nruns,
+           bench_median(nkills, bench_nruns),
+           bench_median(resume_ns, nsamples),
+           bench_quantile(resume_ns, nsamples, 0.99),
+           bench_median(restored, nsamples),
+           bench_median(recomputed, bench_nruns), total, baseline,
+           (double)total / baseline, correct ? "yes" : "no");
+    fflush(stdout);
+
+    bench_samples_delete(resume_ns);
+    bench_samples_delete(restored);
+
+    return baseline;
+}
+
+/******************************************************************************/
+/** Public Interface: recovery ---------------------------------------------- */
+/******************************************************************************/
+void run_recovery_benchmarks()
+{
+    struct recovery_progress *progress;
+    uint64_t baseline;
+    bool *reference;
+    size_t expected;
+    int schedule;
+
+    srand(BENCH_SEED);
+    srand48(BENCH_SEED);
+
+    progress = mmap(NULL, sizeof(*progress), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (progress == MAP_FAILED)
+        return;
+
+    reference = mcmalloc(RECOVERY_LIMIT * sizeof(*reference));
+    primesieve_init(reference, RECOVERY_LIMIT);
+    primesieve_segment(reference, 0, RECOVERY_LIMIT);
+    expected = primesieve_count(reference, RECOVERY_LIMIT);
+    mcfree(reference);
+
+    printf("schedule,kill_us,runs,kills,resume_ns,resume_p99_ns,"
+           "restored_bytes,recomputed_segments,total_ns,baseline_ns,"
+           "slowdown,correct\n");
+    fflush(stdout);
+
+    baseline = recovery_sweep("none", false, 0, expected, progress, 0);
+
+    for (schedule = 0; schedule < CRASHSCHED_NSCHEDULES; schedule++)
+        recovery_sweep(crashsched_names[schedule], true, schedule, expected,
+                       progress, baseline);
+
+    munmap(progress, sizeof(*progress));
+    unlink(RECOVERY_HEAP);
+}
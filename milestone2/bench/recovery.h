@@ -0,0 +1,21 @@
+#ifndef __RECOVERY_H__
+#define __RECOVERY_H__
+
+/**
+ * Crash-recovery benchmark. A segmented prime sieve, whose progress lives in
+ * the heap and is checkpointed every few segments, runs in a child process
+ * which is killed and restarted under each crash schedule of [crashsched.h],
+ * until it finishes. Against a run without kills, every schedule reports:
+ *
+ *  - the time from each restart to the first useful instruction, which is the
+ *    first read of the restored progress,
+ *  - the bytes restored from the heap file upon each restart,
+ *  - the work recomputed because it was done after the last durable
+ *    checkpoint, in sieve segments,
+ *  - the total time to solution and the resulting slowdown,
+ *  - whether every run still produced the right answer.
+ */
+
+void run_recovery_benchmarks();
+
+#endif
@@ -0,0 +1,476 @@
+#include "workload.h"
+#include "bench.h"
+
+#include "crheap.h"
+#include "nvstore.h"
+#include "checkpoint.h"
+#include "memcheck.h"
+
+#include "summation.h"
+#include "mergesort.h"
+#include "fibonacci.h"
+#include "primesieve.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/******************************************************************************/
+/** Macros, Definitions, and Static Variables: workload --------------------- */
+/******************************************************************************/
+#define WORKLOAD_HEAP       "bench_workload.heap"
+#define WORKLOAD_NSIZES     2
+#define MAX_THREADS         16
+
+struct workload_run;
+
+/** One of the bundled algorithms, split into phases the driver can time. */
+struct workload
+{
+    const char *name;
+    size_t sizes[WORKLOAD_NSIZES];
+
+    void (*setup)(struct workload_run *run);
+    void (*work)(struct workload_run *run, size_t tid);
+    bool (*check)(struct workload_run *run);
+};
+
+/** State of one configuration, shared by every worker of the child. */
+struct workload_run
+{
+    const struct workload *workload;
+    size_t size;
+    size_t nthreads;
+
+    /* inputs, outputs, and one result slot per thread, all in the heap      */
+    void *data;
+    void *scratch;
+    intptr_t *results;
+
+    pthread_barrier_t barrier;
+    sem_t finished;
+};
+
+struct workload_worker
+{
+    struct workload_run *run;
+    size_t tid;
+    pthread_t thread;
+};
+
+/** Measurements of one run, passed from the child to the driver. */
+struct workload_result
+{
+    uint64_t time_ns;
+    uint64_t bytes_written;
+    uint64_t ncheckpoints;
+};
+
+static const size_t s_threads[] = {1, 2, 4};
+static const long s_intervals_ms[] = {0, 20, 5};
+
+#define ARRAY_LEN(arr)      (sizeof(arr) / sizeof((arr)[0]))
+
+/******************************************************************************/
+/** Private Implementation: workload kernels -------------------------------- */
+/******************************************************************************/
+
+/** The [lo, hi) share of [n] items belonging to thread [tid]. */
+static void workload_slice(struct workload_run *run, size_t n, size_t tid,
+                           size_t *lo, size_t *hi)
+{
+    size_t width = (n + run->nthreads - 1) / run->nthreads;
+
+    *lo = tid * width < n ? tid * width : n;
+    *hi = *lo + width < n ? *lo + width : n;
+}
+
+static void summation_setup(struct workload_run *run)
+{
+    intptr_t *arr;
+    size_t i;
+
+    run->data = arr = crmalloc(run->size * sizeof(*arr));
+    for (i = 0; i < run->size; i++)
+        arr[i] = rand() % 1000;
+}
+
+static void summation_work(struct workload_run *run, size_t tid)
+{
+    size_t lo, hi;
+
+    workload_slice(run, run->size, tid, &lo, &hi);
+    run->results[tid] = summation_serial((intptr_t *)run->data + lo, hi - lo);
+}
+
+static bool summation_check(struct workload_run *run)
+{
+    intptr_t total = 0;
+    size_t tid;
+
+    for (tid = 0; tid < run->nthreads; tid++)
+        total += run->results[tid];
+
+    return total == summation_serial(run->data, run->size);
+}
+
+static void mergesort_setup(struct workload_run *run)
+{
+    int *arr;
+    size_t i;
+
+    run->data = arr = crmalloc(run->size * sizeof(*arr));
+    run->scratch = crmalloc(run->size * sizeof(*arr));
+
+    for (i = 0; i < run->size; i++)
+        arr[i] = rand();
+}
+
+/** Each thread sorts its slice, then the first merges the sorted slices. */
+static void mergesort_work(struct workload_run *run, size_t tid)
+{
+    int *arr = run->data, *scratch = run->scratch;
+    size_t lo, hi, width, low, high;
+
+    workload_slice(run, run->size, tid, &lo, &hi);
+    if (hi > lo)
+        mergesort_buffered(arr, scratch + lo, lo, hi - 1);
+
+    pthread_barrier_wait(&run->barrier);
+
+    if (tid != 0)
+        return;
+
+    for (width = hi - lo; width < run->size; width *= 2)
+    {
+        for (low = 0; low + width < run->size; low += 2 * width)
+        {
+            high = low + 2 * width < run->size ? low + 2 * width : run->size;
+            merge_buffered(arr, scratch, low, low + width - 1, high - 1);
+        }
+    }
+}
+
+static bool mergesort_check(struct workload_run *run)
+{
+    int *arr = run->data;
+    size_t i;
+
+    for (i = 1; i < run->size; i++)
+        if (arr[i - 1] > arr[i])
+            return false;
+
+    return true;
+}
+
+static void fibonacci_setup(struct workload_run *run)
+{
+    run->data = crmalloc((run->size + 1) * sizeof(int64_t));
+}
+
+/** Threads take every [nthreads]th term, each computed from scratch. */
+static void fibonacci_work(struct workload_run *run, size_t tid)
+{
+    int64_t *terms = run->data;
+    size_t n;
+
+    for (n = run->size - tid; n > 0 && n <= run->size; n -= run->nthreads)
+        terms[n] = fibonacci_recursive(n);
+}
+
+static bool fibonacci_check(struct workload_run *run)
+{
+    int64_t *terms = run->data;
+    size_t n;
+
+    for (n = 1; n <= run->size; n++)
+        if (terms[n] != fibonacci_fast(n))
+            return false;
+
+    return true;
+}
+
+static void primesieve_setup(struct workload_run *run)
+{
+    run->data = crmalloc(run->size * sizeof(bool));
+    primesieve_init(run->data, run->size);
+}
+
+static void primesieve_work(struct workload_run *run, size_t tid)
+{
+    size_t lo, hi;
+
+    workload_slice(run, run->size, tid, &lo, &hi);
+    primesieve_segment(run->data, lo, hi);
+}
+
+static bool primesieve_check(struct workload_run *run)
+{
+    bool *reference;
+    size_t i, expected;
+
+    reference = mcmalloc(run->size * sizeof(*reference));
+    primesieve_init(reference, run->size);
+
+    for (i = 2; i * i < run->size; i++)
+        if (reference[i])
+            primesieve_mark(reference, run->size, i);
+
+    expected = primesieve_count(reference, run->size);
+    mcfree(reference);
+
+    return primesieve_count(run->data, run->size) == expected;
+}
+
+static const struct workload s_workloads[] = {
+    {"summation", {1 << 20, 1 << 22},
+     summation_setup, summation_work, summation_check},
+    {"mergesort", {1 << 18, 1 << 20},
+     mergesort_setup, mergesort_work, mergesort_check},
+    {"fibonacci", {24, 27},
+     fibonacci_setup, fibonacci_work, fibonacci_check},
+    {"primesieve", {1 << 20, 1 << 22},
+     primesieve_setup, primesieve_work, primesieve_check},
+};
+
+/******************************************************************************/
+/** Private Implementation: workload driver --------------------------------- */
+/******************************************************************************/
+static void *workload_tf_worker(void *worker_vp)
+{
+    struct workload_worker *worker = worker_vp;
+
+    worker->run->workload->work(worker->run, worker->tid);
+    sem_post(&worker->run->finished);
+
+    return NULL;
+}
+
+/** Checkpoints the whole heap, leaving every committed page tracked clean. */
+static void workload_checkpoint()
+{
+    struct checkpoint *checkpoint;
+
+    checkpoint = crheap_checkpoint_everything_background();
+    checkpoint_wait(checkpoint);
+    checkpoint_delete(checkpoint);
+}
+
+static void workload_deadline(struct timespec *deadline, long interval_ms)
+{
+    clock_gettime(CLOCK_REALTIME, deadline);
+
+    deadline->tv_nsec += (interval_ms % 1000) * 1000000;
+    deadline->tv_sec += interval_ms / 1000 + deadline->tv_nsec / 1000000000;
+    deadline->tv_nsec %= 1000000000;
+}
+
+/**
+ * Body of the child process running one configuration. Setup and the initial
+ * checkpoint of the inputs are not timed; the final checkpoint is, since the
+ * answer is not durable without it.
+ */
+static void workload_child(const struct workload *workload, size_t size,
+                           size_t nthreads, long interval_ms, int fd)
+{
+    struct workload_worker workers[MAX_THREADS];
+    struct workload_result result = {0};
+    struct workload_run run = {0};
+    struct nvstats before, after;
+    struct timespec deadline;
+    size_t tid, nfinished;
+    uint64_t start;
+    int rc;
+
+    unlink(WORKLOAD_HEAP);
+    crheap_init(WORKLOAD_HEAP);
+
+    run.workload = workload;
+    run.size = size;
+    run.nthreads = nthreads;
+    run.results = crmalloc(nthreads * sizeof(*run.results));
+
+    pthread_barrier_init(&run.barrier, NULL, nthreads);
+    sem_init(&run.finished, 0, 0);
+
+    workload->setup(&run);
+
+    if (interval_ms > 0)
+        workload_checkpoint();
+
+    nvstore_get_stats(&before);
+    start = bench_now_ns();
+
+    for (tid = 0; tid < nthreads; tid++)
+    {
+        workers[tid].run = &run;
+        workers[tid].tid = tid;
+        pthread_create(&workers[tid].thread, NULL, workload_tf_worker,
+                       &workers[tid]);
+    }
+
+    workload_deadline(&deadline, interval_ms);
+
+    for (nfinished = 0; nfinished < nthreads; )
+    {
+        rc = interval_ms > 0 ? sem_timedwait(&run.finished, &deadline)
+                             : sem_wait(&run.finished);
+
+        if (rc == 0)
+            nfinished++;
+        else if (errno == ETIMEDOUT)
+        {
+            workload_checkpoint();
+            result.ncheckpoints++;
+            workload_deadline(&deadline, interval_ms);
+        }
+    }
+
+    for (tid = 0; tid < nthreads; tid++)
+        pthread_join(workers[tid].thread, NULL);
+
+    if (interval_ms > 0)
+    {
+        workload_checkpoint();
+        result.ncheckpoints++;
+    }
+
+    result.time_ns = bench_now_ns() - start;
+
+    nvstore_get_stats(&after);
+    result.bytes_written = (after.pages_committed - before.pages_committed)
+                         * sysconf(_SC_PAGE_SIZE);
+
+    if (!workload->check(&run))
+    {
+        fprintf(stderr, "%s: wrong answer for size %zu\n", workload->name,
+                size);
+        exit(EXIT_FAILURE);
+    }
+
+    if (write(fd, &result, sizeof(result)) != sizeof(result))
+        exit(EXIT_FAILURE);
+
+    pthread_barrier_destroy(&run.barrier);
+    sem_destroy(&run.finished);
+
+    crheap_shutdown_nosave();
+    unlink(WORKLOAD_HEAP);
+
+    exit(EXIT_SUCCESS);
+}
+
+/** Runs one configuration in a child, returning false if it failed. */
+static bool workload_measure(const struct workload *workload, size_t size,
+                             size_t nthreads, long interval_ms,
+                             struct workload_result *result, long *maxrss_kb)
+{
+    struct rusage usage;
+    ssize_t nread;
+    int fds[2], status;
+    pid_t child;
+
+    if (pipe(fds) != 0)
+        return false;
+
+    fflush(stdout);
+    fflush(stderr);
+
+    child = fork();
+    if (child == -1)
+        return false;
+
+    if (child == 0)
+    {
+        close(fds[0]);
+        workload_child(workload, size, nthreads, interval_ms, fds[1]);
+    }
+
+    close(fds[1]);
+    nread = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+
+    if (wait4(child, &status, 0, &usage) != child)
+        return false;
+
+    *maxrss_kb = usage.ru_maxrss;
+
+    return nread == sizeof(*result) && WIFEXITED(status)
+        && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+/** Measures every interval for one size and thread count, baseline first. */
+static void workload_sweep(const struct workload *workload, size_t size,
+                           size_t nthreads)
+{
+    struct workload_result result;
+    uint64_t times[bench_nruns], bytes[bench_nruns], ncheckpoints[bench_nruns];
+    uint64_t baseline = 0, median;
+    long maxrss_kb, peak_kb;
+    size_t i, run;
+
+    for (i = 0; i < ARRAY_LEN(s_intervals_ms); i++)
+    {
+        peak_kb = 0;
+
+        for (run = 0; run < bench_nruns; run++)
+        {
+            if (!workload_measure(workload, size, nthreads, s_intervals_ms[i],
+                                  &result, &maxrss_kb))
+            {
+                fprintf(stderr, "%s: run failed (size=%zu, threads=%zu, "
+                        "interval=%ldms)\n", workload->name, size, nthreads,
+                        s_intervals_ms[i]);
+                return;
+            }
+
+            times[run] = result.time_ns;
+            bytes[run] = result.bytes_written;
+            ncheckpoints[run] = result.ncheckpoints;
+
+            if (maxrss_kb > peak_kb)
+                peak_kb = maxrss_kb;
+        }
+
+        median = bench_median(times, bench_nruns);
+        if (s_intervals_ms[i] == 0)
+            baseline = median;
+
+        printf("%s,%zu,%zu,%ld,%zu,%lu,%lu,%.1f,%lu,%lu,%ld\n",
+               workload->name, size, nthreads, s_intervals_ms[i], bench_nruns,
+               median, baseline, 100.0 * ((double)median - baseline) / baseline,
+               bench_median(ncheckpoints, bench_nruns),
+               bench_median(bytes, bench_nruns), peak_kb);
+        fflush(stdout);
+    }
+}
+
+/******************************************************************************/
+/** Public Interface: workload ---------------------------------------------- */
+/******************************************************************************/
+void run_workload_benchmarks()
+{
+    size_t i, j, k;
+
+    srand(BENCH_SEED);
+
+    printf("workload,size,threads,interval_ms,runs,median_ns,baseline_ns,"
+           "overhead_pct,checkpoints,bytes_written,peak_rss_kb\n");
+    fflush(stdout);
+
+    for (i = 0; i < ARRAY_LEN(s_workloads); i++)
+        for (j = 0; j < WORKLOAD_NSIZES; j++)
+            for (k = 0; k < ARRAY_LEN(s_threads); k++)
+                workload_sweep(&s_workloads[i], s_workloads[i].sizes[j],
+                               s_threads[k]);
+}
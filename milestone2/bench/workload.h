@@ -0,0 +1,20 @@
+#ifndef __WORKLOAD_H__
+#define __WORKLOAD_H__
+
+#include <stddef.h>
+
+/**
+ * End-to-end benchmarks over the bundled algorithms: summation, mergesort,
+ * fibonacci, and the prime sieve. Each workload keeps its data in the heap and
+ * is split across a number of plain pthreads while the driving thread takes a
+ * background checkpoint of the whole heap at a fixed interval.
+ *
+ * Every configuration runs in a child process of its own, so that its peak
+ * RSS may be read from [wait4()] and no heap state leaks between runs. An
+ * interval of zero disables checkpointing; that run is the baseline against
+ * which the overhead of the other intervals is reported.
+ */
+
+void run_workload_benchmarks();
+
+#endif
@@ -0,0 +1,173 @@
+#include "crarena.h"
+#include "crmalloc.h"
+
+#include <stdint.h>
+
+/******************************************************************************/
+/** Private Implementation: crarena ----------------------------------------- */
+/******************************************************************************/
+
+/** Chunk after [chunk], or NULL. */
+static inline struct crarena_chunk *__crarena_next(struct crarena_chunk *chunk)
+{
+    return crptr_get(&chunk->next);
+}
+
+/**
+ * Allocates a chunk holding at least [size] bytes. The chunk is sized so that
+ * it and crmalloc()'s own block header fill whole pages.
+ */
+static struct crarena_chunk *__crarena_chunk_new(size_t size)
+{
+    struct crarena_chunk *chunk;
+    size_t total;
+
+    total = sizeof(*chunk) + size + METADATA_SIZE;
+    total = (total + PAGESIZE - 1) & ~(PAGESIZE - 1);
+
+    chunk = crmalloc(total - METADATA_SIZE);
+    if (chunk == NULL)
+        return NULL;
+
+    chunk->next = 0;
+    chunk->size = total - METADATA_SIZE - sizeof(*chunk);
+    chunk->cursor = 0;
+
+    return chunk;
+}
+
+/** Offset of the first aligned byte at or past [cursor] in [chunk]. */
+static size_t __crarena_align(struct crarena_chunk *chunk, size_t cursor)
+{
+    uintptr_t start;
+
+    start = (uintptr_t)chunk->data + cursor;
+    start = (start + CRARENA_ALIGN - 1) & ~((uintptr_t)CRARENA_ALIGN - 1);
+
+    return start - (uintptr_t)chunk->data;
+}
+
+/**
+ * Moves the arena on to a chunk with room for [size] bytes: the next chunk 
+ * left over from before a reset, or a new one linked in after the current.
+ */
+static struct crarena_chunk *__crarena_advance(struct crarena *arena, 
+                                               size_t size)
+{
+    struct crarena_chunk *chunk, *current;
+
+    current = crptr_get(&arena->current);
+    chunk = current ? __crarena_next(current) : crptr_get(&arena->first);
+    while (chunk != NULL && chunk->size < size)
+    {
+        chunk->cursor = 0;
+        chunk = __crarena_next(chunk);
+    }
+
+    if (chunk == NULL)
+    {
+        chunk = __crarena_chunk_new(size > arena->chunksize 
+                                    ? size : arena->chunksize);
+        if (chunk == NULL)
+            return NULL;
+
+        if (current == NULL)
+        {
+            crptr_set(&chunk->next, crptr_get(&arena->first));
+            crptr_set(&arena->first, chunk);
+        }
+        else
+        {
+            crptr_set(&chunk->next, __crarena_next(current));
+            crptr_set(&current->next, chunk);
+        }
+    }
+
+    chunk->cursor = 0;
+    crptr_set(&arena->current, chunk);
+
+    return chunk;
+}
+
+/******************************************************************************/
+/** Public-Facing API: crarena ---------------------------------------------- */
+/******************************************************************************/
+struct crarena *crarena_new(size_t chunksize)
+{
+    struct crarena *arena;
+
+    arena = crmalloc(sizeof(*arena));
+    if (arena == NULL)
+        return NULL;
+
+    arena->first = arena->current = 0;
+    arena->chunksize = chunksize ? chunksize : CRARENA_CHUNK_SIZE;
+
+    return arena;
+}
+
+void crarena_destroy(struct crarena *arena)
+{
+    struct crarena_chunk *chunk, *next;
+
+    for (chunk = crptr_get(&arena->first); chunk != NULL; chunk = next)
+    {
+        next = __crarena_next(chunk);
+        crfree(chunk);
+    }
+
+    crfree(arena);
+}
+
+void *crarena_alloc(struct crarena *arena, size_t size)
+{
+    struct crarena_chunk *chunk;
+    size_t offset = 0;
+
+    chunk = crptr_get(&arena->current);
+    if (chunk != NULL)
+        offset = __crarena_align(chunk, chunk->cursor);
+
+    if (chunk == NULL || offset + size > chunk->size)
+    {
+        chunk = __crarena_advance(arena, size + CRARENA_ALIGN);
+        if (chunk == NULL)
+            return NULL;
+
+        offset = __crarena_align(chunk, 0);
+    }
+
+    chunk->cursor = offset + size;
+    return chunk->data + offset;
+}
+
+/** 
+ * Frees every object at once. Only the arena and its first chunk are written:
+ * the cursors of the other chunks are reset as allocation reaches them.
+ */
+void crarena_reset(struct crarena *arena)
+{
+    struct crarena_chunk *first;
+
+    first = crptr_get(&arena->first);
+    crptr_set(&arena->current, first);
+
+    if (first != NULL)
+        first->cursor = 0;
+}
+
+void crarena_checkpoint_add(struct crarena *arena, 
+                            struct checkpoint *checkpoint)
+{
+    struct crarena_chunk *chunk, *current;
+
+    checkpoint_add(checkpoint, arena, sizeof(*arena));
+
+    current = crptr_get(&arena->current);
+    if (current == NULL)
+        return;
+
+    for (chunk = crptr_get(&arena->first); chunk != __crarena_next(current); 
+         chunk = __crarena_next(chunk))
+        checkpoint_add(checkpoint, chunk, sizeof(*chunk) + chunk->cursor);
+}
@@ -0,0 +1,53 @@
+#ifndef __CRARENA_H__
+#define __CRARENA_H__
+
+#include <stddef.h>
+
+#include "crptr.h"
+#include "checkpoint.h"
+
+/** alignment of every allocation, and the default size of a chunk */
+#define CRARENA_ALIGN           16
+#define CRARENA_CHUNK_SIZE      (64 * 1024)
+
+/**
+ * Region allocator for objects which die together. Allocations are bumped 
+ * off contiguous chunks of the persistent heap, so short-lived buffers pack
+ * densely into few pages instead of being scattered by crmalloc(), and every
+ * object in the region is freed at once by [crarena_reset()] - which keeps 
+ * the chunks for the next round - or by [crarena_destroy()].
+ *
+ * The arena and its cursors live in the heap with the objects themselves, so
+ * a checkpoint taken with [crheap_checkpoint_everything()] restores them to
+ * the same point. [crarena_checkpoint_add()] adds the arena to a hand-built
+ * checkpoint for the same effect. Links between the arena and its chunks are
+ * [crptr]s, so they survive the heap being restored elsewhere. An arena is not
+ * thread-safe.
+ */
+struct crarena_chunk
+{
+    crptr next;                     /* chunk to bump into once this is full   */
+    size_t size;                    /* bytes of [data]                        */
+    size_t cursor;                  /* bytes of [data] handed out             */
+    char data[];
+};
+
+struct crarena
+{
+    crptr first;                    /* every chunk, in order of use           */
+    crptr current;                  /* chunk allocations are bumped off       */
+    size_t chunksize;               /* bytes of [data] in a new chunk         */
+};
+
+/** Creates an arena with chunks of [chunksize] bytes, or the default if 0. */
+struct crarena *crarena_new(size_t chunksize);
+void crarena_destroy(struct crarena *arena);
+
+void *crarena_alloc(struct crarena *arena, size_t size);
+void crarena_reset(struct crarena *arena);
+
+/** Adds the arena and the bytes handed out from it to [checkpoint]. */
+void crarena_checkpoint_add(struct crarena *arena, 
+                            struct checkpoint *checkpoint);
+
+#endif
@@ -14,15 +14,19 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "nvstore.h"
 #include "vtsthreadtable.h"
+#include "crtune.h"
+#include "crtrace.h"
 
 /******************************************************************************/
 /** Macros, Definitions, and Static Variables ------------------------------- */
 /******************************************************************************/
 #define CRPRINTF_BUFLEN     256
 #define DEFAULT_NVFILE      "heapfile.heap"
+#define CRTRACE_ENV         "CRTRACE"
 
 /******************************************************************************/
 /** Public-Facing API: Common ----------------------------------------------- */
@@ -32,12 +36,30 @@ int crheap_init(const char *filename)
     if (filename == NULL)
         filename = DEFAULT_NVFILE;
 
+    /* CRTRACE=<file> traces the whole run and exports it upon shutdown */
+    if (getenv(CRTRACE_ENV) != NULL)
+        crtrace_enable(true);
+
     nvstore_init(filename);
     crthread_init_system();
 
     return 0;
 }
 
+int crheap_init_relocatable(const char *filename, void *base)
+{
+    if (filename == NULL)
+        filename = DEFAULT_NVFILE;
+
+    if (getenv(CRTRACE_ENV) != NULL)
+        crtrace_enable(true);
+
+    nvstore_init_relocatable(filename, base);
+    crthread_init_system();
+
+    return 0;
+}
+
 int crheap_shutdown()
 {
     crthread_shutdown_system();
@@ -46,6 +68,9 @@ int crheap_shutdown()
     crheap_checkpoint_everything();
     nvstore_shutdown();
 
+    if (getenv(CRTRACE_ENV) != NULL)
+        crtrace_export_chrome(getenv(CRTRACE_ENV));
+
     return 0;
 }
 
@@ -64,7 +89,47 @@ int crheap_checkpoint_everything()
     return 0;
 }
 
+struct checkpoint *crheap_checkpoint_everything_background()
+{
+    return nvstore_checkpoint_everything_background();
+}
+
+void crheap_set_checkpoint_io_limits(size_t bytes_per_sec, size_t iops)
+{
+    nvstore_set_io_limits(bytes_per_sec, iops);
+}
+
+int crheap_set_checkpoint_io_priority(enum nvioclass ioclass, int level)
+{
+    return nvstore_set_io_priority(ioclass, level);
+}
+
+void crheap_set_mtbf(double seconds)
+{
+    crtune_set_mtbf(seconds);
+}
+
+bool crheap_should_checkpoint()
+{
+    return crtune_should_checkpoint();
+}
+
+double crheap_checkpoint_interval()
+{
+    return crtune_interval();
+}
+
 enum nvexecstate crheap_get_last_progress()
 {
     return nvmetadata_instance()->execstate;
+}
+
+size_t crheap_offset(const void *addr)
+{
+    return (uintptr_t)addr - (uintptr_t)nvstore_base();
+}
+
+void *crheap_at(size_t offset)
+{
+    return (uint8_t *)nvstore_base() + offset;
 }
\ No newline at end of file
@@ -27,6 +27,7 @@
 #include <stddef.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "macros.h"
 #include "crmalloc.h"
@@ -47,6 +48,14 @@
  */
 int crheap_init(const char *filename);
 
+/**
+ * Initializes a relocatable heap, which is restored at [base] if that address
+ * range is free, or wherever it fits otherwise. See 
+ * [nvstore_init_relocatable()] for what pointers stored in such a heap must 
+ * look like.
+ */
+int crheap_init_relocatable(const char *filename, void *base);
+
 /**
  * Used to uninitalize and cleanup any resources consumed by the crheap 
  * subsystem. This should close the non-volatile memory file, among other 
@@ -73,4 +82,46 @@ int crprintf(const char * __restrict fmt, ...);
  */
 int crheap_checkpoint_everything();
 
-enum nvexecstate crheap_get_last_progress();
\ No newline at end of file
+/**
+ * Checkpoints the current heap into a file from a forked child process while
+ * the calling process keeps running.
+ *
+ * @return: a completion handle for the checkpoint, see checkpoint.h. The 
+ *          caller must delete it with [checkpoint_delete()].
+ */
+struct checkpoint *crheap_checkpoint_everything_background();
+
+/**
+ * Limits the bandwidth and I/O operation rate of checkpoint commits, and sets
+ * their I/O scheduling class. See [nvstore_set_io_limits()] and 
+ * [nvstore_set_io_priority()].
+ */
+void crheap_set_checkpoint_io_limits(size_t bytes_per_sec, size_t iops);
+int crheap_set_checkpoint_io_priority(enum nvioclass ioclass, int level);
+
+/**
+ * Configures the mean time between failures, in seconds, which the checkpoint
+ * interval is tuned for. Defaults to one day.
+ */
+void crheap_set_mtbf(double seconds);
+
+/**
+ * Returns true once it is time to checkpoint, according to the measured cost
+ * of commits, the amount of data dirtied since the last one, and the MTBF. 
+ * Cheap enough to poll from inner loops - see crtune.h for the model.
+ */
+bool crheap_should_checkpoint();
+
+/** Returns the currently optimal checkpoint interval, in seconds. */
+double crheap_checkpoint_interval();
+
+enum nvexecstate crheap_get_last_progress();
+
+/**
+ * Base-relative handles to objects of the heap. The offset of an object stays
+ * the same across restores of a relocatable heap, which makes it the way to 
+ * find a root object again after the heap moved. Offsets of a pinned heap are
+ * plain addresses.
+ */
+size_t crheap_offset(const void *addr);
+void *crheap_at(size_t offset);
\ No newline at end of file
@@ -1,6 +1,31 @@
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/syscall.h>
 #include "crmalloc.h"
 #include "nvstore.h"
+#include "crstat.h"
+#include "crtrace.h"
+
+// Owner of the shared arena, which no thread can claim
+#define SHARED_OWNER ((pid_t) -1)
+
+// Volatile state of the arenas, then of the pools, reset by mm_restore() on
+// every boot
+static pthread_mutex_t arena_locks[NUM_ARENAS + NUM_POOLS];
+static pid_t arena_owners[NUM_ARENAS + NUM_POOLS];
+static pthread_mutex_t arena_creation_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Bumped on every boot, so threads drop arenas claimed before it
+static uint64_t arena_generation;
+
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t arena_key;
+
+// Arena claimed by the calling thread, and the boot it was claimed in
+static __thread struct arena *thread_arena;
+static __thread uint64_t thread_generation;
+static __thread pid_t thread_tid;
 
 /* Instance getter for memory manager */
 static struct memory_manager *mm_instance() {
@@ -25,6 +50,53 @@ static inline size_t block_payload_size(struct block *b) {
     return tag_payload_size(&b->tag);
 }
 
+/* Start of the run of pages holding a block */
+static inline char *block_mem_lo(struct block *b) {
+    return crptr_get(&b->mem_lo);
+}
+
+/* End of the run of pages holding a block */
+static inline char *block_mem_hi(struct block *b) {
+    return crptr_get(&b->mem_hi);
+}
+
+/* Arena whose pages hold a block */
+static inline struct arena *block_arena(struct block *b) {
+    return crptr_get(&b->arena);
+}
+
+/* Set the run of pages and the arena of a block */
+static inline void block_set_run(struct block *b, void *mem_lo, void *mem_hi,
+                                 struct arena *a) {
+    crptr_set(&b->mem_lo, mem_lo);
+    crptr_set(&b->mem_hi, mem_hi);
+    crptr_set(&b->arena, a);
+}
+
+/* Size class of free blocks with the given payload size */
+static inline size_t size_class(size_t payload_size) {
+    size_t granules = payload_size / GRANULE_SIZE;
+    if (granules < (1 << SUBCLASS_BITS)) { return granules; }
+
+    // Power-of-two range, then the subclass within that range
+    size_t range = 63 - __builtin_clzl(granules);
+    size_t sub = (granules >> (range - SUBCLASS_BITS))
+                 & ((1 << SUBCLASS_BITS) - 1);
+    size_t class = ((range - SUBCLASS_BITS + 1) << SUBCLASS_BITS) + sub;
+
+    return class < NUM_SIZE_CLASSES ? class : NUM_SIZE_CLASSES - 1;
+}
+
+/* Smallest payload size held by the given size class */
+static inline size_t class_min_size(size_t class) {
+    if (class < (1 << SUBCLASS_BITS)) { return class * GRANULE_SIZE; }
+
+    size_t range = (class >> SUBCLASS_BITS) + SUBCLASS_BITS - 1;
+    size_t sub = class & ((1 << SUBCLASS_BITS) - 1);
+    return (((1 << SUBCLASS_BITS) + sub) << (range - SUBCLASS_BITS))
+           * GRANULE_SIZE;
+}
+
 /* Determine if block is in use */
 static inline bool block_inuse(struct block *b) {
     return tag_inuse(&b->tag);
@@ -57,7 +129,7 @@ static inline struct block *block_on_left(struct block *block) {
     b -= sizeof(union boundary_tag);
 
     // Guard if current block is leftmost in the set of pages
-    if (b <= block->mem_lo) { return NULL; }
+    if (b <= (void *) block_mem_lo(block)) { return NULL; }
 
     // Determine payload size and back up the pointer
     size_t payload_size = tag_payload_size((union boundary_tag *) b);
@@ -73,14 +145,31 @@ static inline struct block *block_on_right(struct block *block) {
     b += block_payload_size(block) 
          + sizeof(struct block) 
          + sizeof(union boundary_tag);
-    return b > ((void *) block->mem_hi) ? NULL : (struct block *) b;
+    return b >= (void *) block_mem_hi(block) ? NULL : (struct block *) b;
+}
+
+/* Add a free block to the front of its size class */
+static void freelist_push(struct arena *a, struct block *b) {
+    size_t class = size_class(block_payload_size(b));
+    list_push_front(&a->free[class], &b->elem);
+    a->nonempty |= 1ull << class;
+    a->nfree++;
+}
+
+/* Take a free block off its size class; its size must be unchanged */
+static void freelist_remove(struct arena *a, struct block *b) {
+    size_t class = size_class(block_payload_size(b));
+    list_remove(&b->elem);
+    if (list_empty(&a->free[class])) { a->nonempty &= ~(1ull << class); }
+    a->nfree--;
 }
 
 /**
  * Attempt to split block. Assumes given block is large enough to store
  * at least the requested_size
  */
-static struct block *split_block(struct block *b, size_t requested_size) {
+static struct block *split_block(struct arena *a, struct block *b,
+                                 size_t requested_size) {
 
     // Only split if the remainder is large enough to hold a payload
     int64_t remainder_size = (int64_t) block_payload_size(b)
@@ -100,13 +189,12 @@ static struct block *split_block(struct block *b, size_t requested_size) {
         block_right_tag(next_b)->data.payload_size = (size_t) remainder_size;
         block_right_tag(next_b)->data.inuse = false;
 
-        // Set absolute memory boundaries of next block
-        next_b->mem_lo = b->mem_lo;
-        next_b->mem_hi = b->mem_hi;
+        // Set absolute memory boundaries and arena of next block
+        block_set_run(next_b, block_mem_lo(b), block_mem_hi(b),
+                      block_arena(b));
 
         // Add next block to free list
-        struct memory_manager *mm = mm_instance();
-        list_push_back(&mm->free, &next_b->elem);
+        freelist_push(a, next_b);
 
     }
 
@@ -118,14 +206,18 @@ static struct block *split_block(struct block *b, size_t requested_size) {
 }
 
 /* Allocate pages of memory to satisfy request size */
-static struct block *make_block(size_t payload_size) {
+static struct block *make_block(struct arena *a,
+                                size_t payload_size) {
 
     // Determine number of pages to request
     size_t block_size = payload_size + METADATA_SIZE;
     size_t npages = block_size/PAGESIZE + (block_size % PAGESIZE != 0);
 
-    // Request memory
-    struct block *b = nvstore_allocpage(npages);
+    // Request memory, with room to grow in place for large objects
+    struct block *b = block_size >= LARGE_OBJECT_SIZE
+                      ? nvstore_allocpage_reserved(npages,
+                                                   LARGE_RESERVE_SIZE/PAGESIZE)
+                      : nvstore_allocpage(npages);
     if (!b) {
         printf("ERROR: make_block() failed on size <%ld>\n", payload_size);
         return NULL;
@@ -137,32 +229,51 @@ static struct block *make_block(size_t payload_size) {
     block_right_tag(b)->data.payload_size = npages*PAGESIZE-METADATA_SIZE;
     block_right_tag(b)->data.inuse = true;
 
-    // Initialize absolute memory boundaries
-    b->mem_lo = (void *) b;
-    b->mem_hi = ((void *) b) + npages*PAGESIZE;
+    // Initialize absolute memory boundaries and arena
+    block_set_run(b, b, ((void *) b) + npages*PAGESIZE, a);
 
     // Split block to free any unused spaces
-    return split_block(b, block_size);
+    return split_block(a, b, payload_size);
 
 }
 
-/* Search for free block with large enough payload */
-static struct block *find_reusable_block(size_t size) {
-    struct memory_manager *mm = mm_instance();
-    struct list_elem *e = list_begin(&mm->free);
-    while (e != list_end(&mm->free)) {
+/* First fit among at most [limit] blocks of one size class */
+static struct block *search_class(struct arena *a, size_t class,
+                                  size_t size, size_t limit) {
+    struct list_elem *e = list_begin(&a->free[class]);
+    while (e != list_end(&a->free[class]) && limit-- > 0) {
         struct block *b = list_entry(e, struct block, elem);
         if (block_payload_size(b) >= size) {
-            list_remove(e);
-            return split_block(b, size);
+            freelist_remove(a, b);
+            return split_block(a, b, size);
         }
         e = list_next(e);
     }
     return NULL;
 }
 
+/**
+ * Search for free block with large enough payload. Only the first few blocks
+ * of the request's own class are looked at; past it, the lowest non-empty
+ * class is found from the bitmap, and its first block fits unless it is the
+ * last class, which may need a longer walk.
+ */
+static struct block *find_reusable_block(struct arena *a,
+                                         size_t size) {
+    size_t class = size_class(size);
+    struct block *b = search_class(a, class, size, CLASS_SEARCH_LIMIT);
+    if (b || class == NUM_SIZE_CLASSES - 1) {
+        return b ? b : search_class(a, class, size, SIZE_MAX);
+    }
+
+    uint64_t larger = a->nonempty & (~0ull << (class + 1));
+    if (!larger) { return NULL; }
+
+    return search_class(a, __builtin_ctzl(larger), size, SIZE_MAX);
+}
+
 /* Attempt to coalesce block with its neighbors */
-static struct block *coalesce(struct block *b) {
+static struct block *coalesce(struct arena *a, struct block *b) {
 
     // Mark block as free
     block_left_tag(b)->data.inuse = false;
@@ -176,7 +287,7 @@ static struct block *coalesce(struct block *b) {
     if (right_b && !block_inuse(right_b)) {
 
         // Remove right block from free list and combine sizes
-        list_remove(&right_b->elem);
+        freelist_remove(a, right_b);
         size_t new_size = block_payload_size(b) 
                           + block_payload_size(right_b) 
                           + METADATA_SIZE;
@@ -194,7 +305,7 @@ static struct block *coalesce(struct block *b) {
     if (left_b && !block_inuse(left_b)) {
 
         // Remove left block from free list and combine sizes
-        list_remove(&left_b->elem);
+        freelist_remove(a, left_b);
         size_t new_size = block_payload_size(b)
                           + block_payload_size(left_b)
                           + METADATA_SIZE;
@@ -215,10 +326,634 @@ static struct block *coalesce(struct block *b) {
     return b;
 }
 
+/**
+ * Move the payload of an in-use block up to the given alignment, freeing the
+ * space skipped as a block of its own, then split the block to size. The
+ * block must have room for size + align + METADATA_SIZE + GRANULE_SIZE.
+ */
+static struct block *align_block(struct arena *a, struct block *b,
+                                 size_t size, size_t align) {
+    uintptr_t payload = (uintptr_t) b->payload;
+    if (payload % align != 0) {
+
+        // Leave room for a free block of at least a granule before it
+        uintptr_t aligned = (payload + METADATA_SIZE + GRANULE_SIZE
+                             + align - 1) & ~(align - 1);
+        size_t lead_size = aligned - payload - METADATA_SIZE;
+        size_t rest_size = block_payload_size(b) - lead_size - METADATA_SIZE;
+
+        // Set boundary tags, memory boundaries and arena of aligned block
+        struct block *aligned_b = payload_to_block((void *) aligned);
+        block_left_tag(aligned_b)->data.payload_size = rest_size;
+        block_left_tag(aligned_b)->data.inuse = true;
+        block_right_tag(aligned_b)->data.payload_size = rest_size;
+        block_right_tag(aligned_b)->data.inuse = true;
+        block_set_run(aligned_b, block_mem_lo(b), block_mem_hi(b),
+                      block_arena(b));
+
+        // Shrink the original block to the space skipped and free it
+        block_left_tag(b)->data.payload_size = lead_size;
+        block_left_tag(b)->data.inuse = false;
+        block_right_tag(b)->data.payload_size = lead_size;
+        block_right_tag(b)->data.inuse = false;
+        freelist_push(a, b);
+
+        b = aligned_b;
+    }
+
+    b = split_block(a, b, size);
+
+    // What the split returned may sit next to more free space
+    struct block *rest = block_on_right(b);
+    if (rest && !block_inuse(rest)) {
+        freelist_remove(a, rest);
+        rest = coalesce(a, rest);
+        freelist_push(a, rest);
+    }
+
+    return b;
+}
+
+/* ---------- ARENAS ---------- */
+
+/* Kernel thread id of the caller, cached */
+static inline pid_t current_tid() {
+    if (thread_tid == 0) { thread_tid = syscall(SYS_gettid); }
+    return thread_tid;
+}
+
+/* Give a thread's arena up when it exits, for the next thread to claim */
+static void arena_release(void *owner_vp) {
+    pid_t *owner = owner_vp;
+    pid_t tid = current_tid();
+    __atomic_compare_exchange_n(owner, &tid, 0, false, __ATOMIC_RELEASE,
+                                __ATOMIC_RELAXED);
+}
+
+static void arena_key_create() {
+    pthread_key_create(&arena_key, arena_release);
+}
+
+/* Allocate an arena of the given pool and set up its volatile state */
+static struct arena *arena_create(size_t index, unsigned pool, pid_t owner) {
+    size_t npages = sizeof(struct arena)/PAGESIZE
+                    + (sizeof(struct arena) % PAGESIZE != 0);
+    struct arena *a = nvstore_allocpage(npages);
+    if (!a) { return NULL; }
+
+    a->index = index;
+    a->pool = pool;
+    a->remote = 0;
+    memset(a->partial, 0, sizeof(a->partial));
+    a->reclaimed = 0;
+    a->nonempty = 0;
+    a->nfree = 0;
+    for (size_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        list_init(&a->free[i]);
+    }
+
+    pthread_mutex_init(&arena_locks[a->index], NULL);
+    arena_owners[a->index] = owner;
+    return a;
+}
+
+/* Allocate and register a new arena; caller holds the creation lock */
+static struct arena *arena_new(struct memory_manager *mm, pid_t owner) {
+    struct arena *a = arena_create(mm->narenas, 0, owner);
+    if (!a) { return NULL; }
+
+    crptr_set(&mm->arenas[a->index], a);
+    __atomic_store_n(&mm->narenas, a->index + 1, __ATOMIC_RELEASE);
+    return a;
+}
+
+/**
+ * Claim an arena for the calling thread: one left unclaimed by an exited
+ * thread or by the previous boot, else a new one. Once every arena exists
+ * and is claimed, the thread falls back to the shared arena.
+ */
+static struct arena *arena_claim(struct memory_manager *mm) {
+    pid_t tid = current_tid();
+
+    size_t narenas = __atomic_load_n(&mm->narenas, __ATOMIC_ACQUIRE);
+    for (size_t i = SHARED_ARENA + 1; i < narenas; i++) {
+        pid_t unclaimed = 0;
+        if (__atomic_compare_exchange_n(&arena_owners[i], &unclaimed, tid,
+                                        false, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            return crptr_get(&mm->arenas[i]);
+        }
+    }
+
+    pthread_mutex_lock(&arena_creation_lock);
+    if (mm->narenas == SHARED_ARENA) { arena_new(mm, SHARED_OWNER); }
+
+    struct arena *a = crptr_get(&mm->arenas[SHARED_ARENA]);
+    if (mm->narenas < NUM_ARENAS) {
+        struct arena *own = arena_new(mm, tid);
+        if (own) { a = own; }
+    }
+    pthread_mutex_unlock(&arena_creation_lock);
+
+    return a;
+}
+
+/* The calling thread's arena, claimed on first use in every boot */
+static struct arena *arena_get() {
+    uint64_t generation = __atomic_load_n(&arena_generation, __ATOMIC_ACQUIRE);
+    if (thread_arena && thread_generation == generation) {
+        return thread_arena;
+    }
+
+    pthread_once(&arena_key_once, arena_key_create);
+    thread_arena = arena_claim(mm_instance());
+    thread_generation = generation;
+    pthread_setspecific(arena_key, &arena_owners[thread_arena->index]);
+
+    return thread_arena;
+}
+
+/* Pool a set of placement hints asks for, or 0 for the thread's arena */
+static inline unsigned hint_pool(unsigned hints) {
+    if (hints & CR_HOT) { return CR_HOT; }
+    if (hints & CR_READONLY) { return CR_READONLY; }
+    return hints & CR_COLD;
+}
+
+/* Payload alignment a set of placement hints asks for, or 0 for none */
+static inline size_t hint_align(unsigned hints) {
+    if (hints & CR_PAGE_ALIGNED) { return PAGESIZE; }
+    if (hints & CR_CACHE_ALIGNED) { return CACHE_LINE_SIZE; }
+    return 0;
+}
+
+/* The arena of a pool, created on first use; locked by every thread */
+static struct arena *pool_get(unsigned pool) {
+    struct memory_manager *mm = mm_instance();
+    size_t i = __builtin_ctz(pool);
+
+    struct arena *a = crptr_decode(&mm->pools[i],
+                                   __atomic_load_n(&mm->pools[i],
+                                                   __ATOMIC_ACQUIRE));
+    if (a) { return a; }
+
+    pthread_mutex_lock(&arena_creation_lock);
+    a = crptr_get(&mm->pools[i]);
+    if (!a) {
+        a = arena_create(NUM_ARENAS + i, pool, SHARED_OWNER);
+        __atomic_store_n(&mm->pools[i], crptr_encode(&mm->pools[i], a),
+                         __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&arena_creation_lock);
+
+    return a;
+}
+
+/* Determine if the calling thread has the arena to itself */
+static inline bool arena_owned(struct arena *a) {
+    return __atomic_load_n(&arena_owners[a->index], __ATOMIC_RELAXED)
+           == current_tid();
+}
+
+/* Hand a block freed by another thread to its arena, without locking */
+static void remote_push(struct arena *a, struct block *b) {
+    crptr head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+    do {
+        crptr_set(&b->elem.next, crptr_decode(&a->remote, head));
+    } while (!__atomic_compare_exchange_n(&a->remote, &head,
+                                          crptr_encode(&a->remote, b), true,
+                                          __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+}
+
+/**
+ * Coalesce a block and put it on its free list; caller is in the arena. Once
+ * the free block is large, the pages around the freed block are released -
+ * along with those of small free neighbors, which were not released before.
+ */
+static void release_block(struct arena *a, struct block *b) {
+
+    // Span of the freed block, widened over neighbors never released
+    char *lo = (char *) b;
+    char *hi = (char *) block_right_tag(b) + sizeof(union boundary_tag);
+    struct block *left_b = block_on_left(b);
+    struct block *right_b = block_on_right(b);
+    if (left_b && !block_inuse(left_b)
+        && block_payload_size(left_b) < RELEASE_SIZE) {
+        lo = (char *) left_b;
+    }
+    if (right_b && !block_inuse(right_b)
+        && block_payload_size(right_b) < RELEASE_SIZE) {
+        hi = (char *) block_right_tag(right_b) + sizeof(union boundary_tag);
+    }
+
+    b = coalesce(a, b);
+    freelist_push(a, b);
+
+    // Only pages of the payload, and a page past the span for the tags of
+    // neighbors which became part of it
+    if (block_payload_size(b) >= RELEASE_SIZE) {
+        char *start = b->payload;
+        char *end = (char *) block_right_tag(b);
+        if (lo - PAGESIZE > start) { start = lo - PAGESIZE; }
+        if (hi + PAGESIZE < end) { end = hi + PAGESIZE; }
+        nvstore_release(start, end - start);
+    }
+
+}
+
+/* Put a slab back on the partial list of its class; caller is in the arena */
+static inline void slab_relist(struct arena *a, struct slab *s) {
+    crptr_set(&s->next, crptr_get(&a->partial[s->class]));
+    crptr_set(&a->partial[s->class], s);
+}
+
+/* Hand a full slab another thread freed an object in to its arena */
+static void slab_remote_push(struct arena *a, struct slab *s) {
+    crptr head = __atomic_load_n(&a->reclaimed, __ATOMIC_RELAXED);
+    do {
+        crptr_set(&s->next, crptr_decode(&a->reclaimed, head));
+    } while (!__atomic_compare_exchange_n(&a->reclaimed, &head,
+                                          crptr_encode(&a->reclaimed, s),
+                                          true, __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+}
+
+/* Take in every block and slab other threads freed; caller is in the arena */
+static void remote_drain(struct arena *a) {
+    if (__atomic_load_n(&a->remote, __ATOMIC_RELAXED)) {
+        struct block *b = crptr_decode(&a->remote,
+                                       __atomic_exchange_n(&a->remote, 0,
+                                                           __ATOMIC_ACQUIRE));
+        while (b) {
+            struct block *next = crptr_get(&b->elem.next);
+            release_block(a, b);
+            b = next;
+        }
+    }
+
+    if (__atomic_load_n(&a->reclaimed, __ATOMIC_RELAXED)) {
+        struct slab *s = crptr_decode(&a->reclaimed,
+                                      __atomic_exchange_n(&a->reclaimed, 0,
+                                                          __ATOMIC_ACQUIRE));
+        while (s) {
+            struct slab *next = crptr_get(&s->next);
+            slab_relist(a, s);
+            s = next;
+        }
+    }
+}
+
+/**
+ * Enter the calling thread's own arena, locking it only if it is the shared
+ * one, and take in the blocks other threads freed into it. Nobody else
+ * touches the free lists of an owned arena.
+ */
+static void arena_enter(struct arena *a) {
+    if (!arena_owned(a)) { pthread_mutex_lock(&arena_locks[a->index]); }
+    remote_drain(a);
+}
+
+static void arena_leave(struct arena *a) {
+    crstat_set(CRSTAT_FREELIST_LEN, a->nfree);
+    if (!arena_owned(a)) { pthread_mutex_unlock(&arena_locks[a->index]); }
+}
+
+/* Reuse or make a block of the given size; caller is in the arena */
+static struct block *arena_alloc(struct arena *a, size_t size) {
+
+    // Search reusable free blocks
+    struct block *b = find_reusable_block(a, size);
+
+    // No suitable free blocks available; allocate new block
+    if (!b) {
+        CRTRACE(CRTRACE_CRMALLOC_SLOWPATH, CRTRACE_BEGIN, size);
+        b = make_block(a, size);
+        CRTRACE(CRTRACE_CRMALLOC_SLOWPATH, CRTRACE_END, 0);
+    }
+
+    return b;
+}
+
+/**
+ * Grow a block which has its run of pages to itself, but for a free block
+ * after it, by mapping more pages at the end of the run. The run at least
+ * doubles, and all of it stays with the block so that it can keep growing;
+ * nothing is copied, and only the pages the tags are on are written.
+ */
+static struct block *grow_in_place(struct arena *a, struct block *b,
+                                   size_t size) {
+
+    // Only the first block of a run, with at most a free block after it
+    struct block *right_b = block_on_right(b);
+    if (block_mem_lo(b) != (char *) b) { return NULL; }
+    if (right_b && (block_inuse(right_b) || block_on_right(right_b))) {
+        return NULL;
+    }
+
+    // Determine number of pages missing, and try doubling the run first
+    size_t run_size = block_mem_hi(b) - block_mem_lo(b);
+    size_t missing = size + METADATA_SIZE - run_size;
+    size_t npages = missing/PAGESIZE + (missing % PAGESIZE != 0);
+    size_t doubled = run_size/PAGESIZE > npages ? run_size/PAGESIZE : npages;
+    if (nvstore_growpage(block_mem_hi(b), doubled)) {
+        npages = doubled;
+    } else if (doubled == npages
+               || !nvstore_growpage(block_mem_hi(b), npages)) {
+        return NULL;
+    }
+
+    // The free block after it is now part of the block
+    if (right_b) { freelist_remove(a, right_b); }
+
+    // Extend the block over the whole run
+    crptr_set(&b->mem_hi, block_mem_hi(b) + npages*PAGESIZE);
+    size_t payload_size = block_mem_hi(b) - block_mem_lo(b) - METADATA_SIZE;
+    block_left_tag(b)->data.payload_size = payload_size;
+    block_left_tag(b)->data.inuse = true;
+    block_right_tag(b)->data.payload_size = payload_size;
+    block_right_tag(b)->data.inuse = true;
+
+    return b;
+}
+
+/**
+ * Resize a block of the caller's own arena without moving it, by splitting
+ * it, by merging the free block on its right, or by growing its run of pages;
+ * NULL if it has to move
+ */
+static struct block *resize_in_place(struct arena *a, struct block *old_b,
+                                     size_t size) {
+
+    // If new block is smaller than old block, split
+    if (size <= block_payload_size(old_b)) {
+        return split_block(a, old_b, size);
+    }
+
+    // If block on right is free and large enough, coalesce
+    struct block *right_b = block_on_right(old_b);
+    if (right_b && !block_inuse(right_b)) {
+        size_t combined_size = METADATA_SIZE
+                               + block_payload_size(old_b)
+                               + block_payload_size(right_b);
+        if (combined_size >= size) {
+
+            // Remove right block from free list
+            freelist_remove(a, right_b);
+
+            // Update right boundary tag
+            block_right_tag(right_b)->data.payload_size = combined_size;
+            block_right_tag(right_b)->data.inuse = true;
+
+            // Update left boundary tag
+            block_left_tag(old_b)->data.payload_size = combined_size;
+            block_left_tag(old_b)->data.inuse = true;
+
+            // Return what the request does not need
+            return split_block(a, old_b, size);
+        }
+    }
+
+    // If the block ends its run of pages, map more pages after it
+    return grow_in_place(a, old_b, size);
+}
+
+/* ---------- SLABS ---------- */
+
+/* Slab class of a small request: its size class, rounded up */
+static inline size_t slab_class(size_t size) {
+    size_t class = size_class(size);
+    return class_min_size(class) < size ? class + 1 : class;
+}
+
+/* Start of the slab area, or NULL before the first small object */
+static inline char *slab_area(struct memory_manager *mm) {
+    return crptr_get(&mm->slab_area);
+}
+
+/* Descriptors of the slab area */
+static inline struct slab *slab_descs(struct memory_manager *mm) {
+    return crptr_get(&mm->slabs);
+}
+
+/* Arena allocating from a slab */
+static inline struct arena *slab_arena(struct slab *s) {
+    return crptr_get(&s->arena);
+}
+
+/* First object of a slab */
+static inline char *slab_base(struct memory_manager *mm, struct slab *s) {
+    return slab_area(mm) + (s - slab_descs(mm)) * SLAB_SIZE;
+}
+
+/* Slab an object was carved out of, or NULL if it is a block */
+static inline struct slab *slab_of(struct memory_manager *mm, void *ptr) {
+    size_t nslabs = __atomic_load_n(&mm->nslabs, __ATOMIC_ACQUIRE);
+    char *area = slab_area(mm);
+    if (!nslabs || (char *) ptr < area
+        || (char *) ptr >= area + nslabs*SLAB_SIZE) {
+        return NULL;
+    }
+    return &slab_descs(mm)[((char *) ptr - area) / SLAB_SIZE];
+}
+
+/* Pages of descriptors needed for the given number of slabs */
+static inline size_t slab_desc_pages(size_t nslabs) {
+    size_t size = nslabs * sizeof(struct slab);
+    return size/PAGESIZE + (size % PAGESIZE != 0);
+}
+
+/**
+ * Map pages after the end of the slab area or of its descriptors. Pages left
+ * mapped there by a boot that crashed before its next checkpoint are reused.
+ */
+static bool slab_grow(char *end, size_t npages) {
+    return nvstore_contains(end) || nvstore_growpage(end, npages);
+}
+
+/* Map a new slab into the heap and give it to an arena */
+static struct slab *slab_new(struct memory_manager *mm, struct arena *a,
+                             size_t class) {
+    pthread_mutex_lock(&arena_creation_lock);
+
+    // The first slab comes with the reservation of the whole area
+    size_t n = mm->nslabs;
+    bool mapped;
+    if (!mm->slab_area) {
+        size_t reserve = SLAB_AREA_SIZE/SLAB_SIZE;
+        crptr_set(&mm->slabs, nvstore_allocpage_reserved(1,
+                                  slab_desc_pages(reserve) - 1));
+        mm->slab_desc_pages = 1;
+        crptr_set(&mm->slab_area,
+                  nvstore_allocpage_reserved(SLAB_SIZE/PAGESIZE,
+                      (SLAB_AREA_SIZE - SLAB_SIZE)/PAGESIZE));
+        mapped = true;
+    } else if ((n + 1) * SLAB_SIZE > SLAB_AREA_SIZE) {
+        mapped = false;
+    } else {
+        size_t npages = slab_desc_pages(n + 1);
+        mapped = npages <= mm->slab_desc_pages
+                 || slab_grow((char *) slab_descs(mm)
+                              + mm->slab_desc_pages*PAGESIZE, 1);
+        if (mapped && npages > mm->slab_desc_pages) {
+            mm->slab_desc_pages = npages;
+        }
+        mapped = mapped && slab_grow(slab_area(mm) + n*SLAB_SIZE,
+                                     SLAB_SIZE/PAGESIZE);
+    }
+
+    struct slab *s = NULL;
+    if (mapped) {
+        s = &slab_descs(mm)[n];
+        memset(s, 0, sizeof(*s));
+        crptr_set(&s->arena, a);
+        s->class = class;
+
+        // Objects past the end of the slab are marked as in use
+        size_t nobjects = SLAB_SIZE / class_min_size(class);
+        s->nfree = nobjects;
+        for (size_t i = nobjects; i < SLAB_BITMAP_WORDS * 64; i++) {
+            s->used[i / 64] |= 1ull << (i % 64);
+        }
+
+        __atomic_store_n(&mm->nslabs, n + 1, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&arena_creation_lock);
+    return s;
+}
+
+/**
+ * Take a slab which just ran out of objects off its partial list. A thread
+ * freeing an object in it from then on puts it back; if one already did,
+ * this thread might have missed it and decides the race instead.
+ */
+static void slab_retire(struct arena *a, struct slab *s) {
+    crptr_set(&a->partial[s->class], crptr_get(&s->next));
+    __atomic_store_n(&s->full, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&s->nfree, __ATOMIC_SEQ_CST) > 0
+        && __atomic_exchange_n(&s->full, 0, __ATOMIC_SEQ_CST)) {
+        slab_relist(a, s);
+    }
+}
+
+/* Carve an object out of a slab of the class; caller is in the arena */
+static void *slab_alloc(struct arena *a, size_t class) {
+    struct memory_manager *mm = mm_instance();
+
+    struct slab *s = crptr_get(&a->partial[class]);
+    if (!s) {
+        s = slab_new(mm, a, class);
+        if (!s) { return NULL; }
+        slab_relist(a, s);
+    }
+
+    // Only this thread sets bits, so a clear bit stays clear until it does
+    for (size_t w = 0; w < SLAB_BITMAP_WORDS; w++) {
+        uint64_t clear = ~__atomic_load_n(&s->used[w], __ATOMIC_ACQUIRE);
+        if (!clear) { continue; }
+
+        size_t bit = __builtin_ctzl(clear);
+        __atomic_fetch_or(&s->used[w], 1ull << bit, __ATOMIC_ACQ_REL);
+        if (__atomic_sub_fetch(&s->nfree, 1, __ATOMIC_SEQ_CST) == 0) {
+            slab_retire(a, s);
+        }
+
+        return slab_base(mm, s) + (w*64 + bit) * class_min_size(class);
+    }
+
+    return NULL;
+}
+
+/* Free an object of a slab, from any thread */
+static void slab_free(struct memory_manager *mm, struct slab *s, void *ptr) {
+    size_t i = ((char *) ptr - slab_base(mm, s)) / class_min_size(s->class);
+    __atomic_fetch_and(&s->used[i / 64], ~(1ull << (i % 64)),
+                       __ATOMIC_RELEASE);
+    __atomic_add_fetch(&s->nfree, 1, __ATOMIC_SEQ_CST);
+
+    // The first free in a full slab puts it back on its partial list
+    if (__atomic_load_n(&s->full, __ATOMIC_SEQ_CST)
+        && __atomic_exchange_n(&s->full, 0, __ATOMIC_SEQ_CST)) {
+        struct arena *a = slab_arena(s);
+        if (arena_owned(a)) {
+            slab_relist(a, s);
+        } else {
+            slab_remote_push(a, s);
+        }
+    }
+}
+
+/**
+ * Hold back the rest of the slab area and of its descriptors again, after
+ * whatever a crashed boot left mapped past their ends, so they keep growing
+ * in place
+ */
+static void slab_restore(struct memory_manager *mm) {
+    if (!mm->slab_area) { return; }
+
+    char *end = slab_area(mm) + mm->nslabs*SLAB_SIZE;
+    char *area_end = slab_area(mm) + SLAB_AREA_SIZE;
+    while (end < area_end && nvstore_contains(end)) { end += SLAB_SIZE; }
+    if (end < area_end) { nvstore_reserve(end, (area_end - end)/PAGESIZE); }
+
+    size_t ndesc = slab_desc_pages(SLAB_AREA_SIZE/SLAB_SIZE);
+    char *desc_end = (char *) slab_descs(mm) + mm->slab_desc_pages*PAGESIZE;
+    char *descs_end = (char *) slab_descs(mm) + ndesc*PAGESIZE;
+    while (desc_end < descs_end && nvstore_contains(desc_end)) {
+        desc_end += PAGESIZE;
+    }
+    if (desc_end < descs_end) {
+        nvstore_reserve(desc_end, (descs_end - desc_end)/PAGESIZE);
+    }
+}
+
 /* ---------- USER INTERFACE ---------- */
 void mm_init(struct memory_manager *mm)
 {
-    list_init(&mm->free);
+    mm->narenas = 0;
+    for (size_t i = 0; i < NUM_POOLS; i++) {
+        mm->pools[i] = 0;
+    }
+    mm->slab_area = 0;
+    mm->slabs = 0;
+    mm->nslabs = 0;
+    mm->slab_desc_pages = 0;
+}
+
+void mm_restore(struct memory_manager *mm)
+{
+    pthread_mutex_init(&arena_creation_lock, NULL);
+    for (size_t i = 0; i < mm->narenas; i++) {
+        pthread_mutex_init(&arena_locks[i], NULL);
+        arena_owners[i] = i == SHARED_ARENA ? SHARED_OWNER : 0;
+    }
+    for (size_t i = 0; i < NUM_POOLS; i++) {
+        pthread_mutex_init(&arena_locks[NUM_ARENAS + i], NULL);
+        arena_owners[NUM_ARENAS + i] = SHARED_OWNER;
+    }
+
+    slab_restore(mm);
+    __atomic_add_fetch(&arena_generation, 1, __ATOMIC_RELEASE);
+}
+
+void mm_checkpoint_add(struct memory_manager *mm,
+                       struct checkpoint *checkpoint)
+{
+    for (size_t i = 0; i < mm->narenas; i++) {
+        checkpoint_add(checkpoint, crptr_get(&mm->arenas[i]),
+                       sizeof(struct arena));
+    }
+    for (size_t i = 0; i < NUM_POOLS; i++) {
+        if (mm->pools[i]) {
+            checkpoint_add(checkpoint, crptr_get(&mm->pools[i]),
+                           sizeof(struct arena));
+        }
+    }
+    if (mm->nslabs) {
+        checkpoint_add(checkpoint, slab_descs(mm),
+                       mm->nslabs * sizeof(struct slab));
+    }
 }
 
 /* Return a usable block with given minimum size */
@@ -226,14 +961,79 @@ void *crmalloc(size_t size) {
 
     // Ignore spurious requests
     if (size == 0) { return NULL; }
+    crstat_add(CRSTAT_ALLOCS, 1);
 
-    // Search reusable free blocks
-    struct block *b = find_reusable_block(size);
-    if (b) { return b->payload; }
+    struct arena *a = arena_get();
+    arena_enter(a);
 
-    // No suitable free blocks available; allocate new block
-    b = make_block(size);
-    return b->payload;
+    // Small objects come from slabs, unless the slab area is used up
+    void *ptr = size <= SLAB_MAX_SIZE ? slab_alloc(a, slab_class(size)) : NULL;
+    if (!ptr) {
+        struct block *b = arena_alloc(a, size);
+        ptr = b ? b->payload : NULL;
+    }
+
+    arena_leave(a);
+    return ptr;
+
+}
+
+/* Return a zeroed block, writing only to pages which may not be zero yet */
+void *crcalloc(size_t nmemb, size_t size) {
+
+    // Refuse requests whose total size overflows
+    if (size && nmemb > SIZE_MAX / size) { return NULL; }
+
+    char *ptr = crmalloc(nmemb * size);
+    if (!ptr) { return NULL; }
+
+    // Unwritten pages read as the zero page, and writing them would dirty them
+    char *end = ptr + nmemb * size;
+    for (char *cur = ptr; cur < end; ) {
+        char *next = (char *) (((uintptr_t) cur & ~(PAGESIZE - 1)) + PAGESIZE);
+        if (next > end) { next = end; }
+
+        if (!nvstore_iszero(cur)) { memset(cur, 0, next - cur); }
+        cur = next;
+    }
+
+    return ptr;
+
+}
+
+/* Return a block placed in the pool and at the alignment hinted at */
+void *crmalloc_hint(size_t size, unsigned hints) {
+
+    unsigned pool = hint_pool(hints);
+    size_t align = hint_align(hints);
+    if (!pool && !align) { return crmalloc(size); }
+
+    // Ignore spurious requests
+    if (size == 0) { return NULL; }
+    crstat_add(CRSTAT_ALLOCS, 1);
+
+    struct arena *a = pool ? pool_get(pool) : arena_get();
+    if (!a) { return NULL; }
+
+    arena_enter(a);
+    void *ptr = NULL;
+    if (align) {
+
+        // Take enough to align the payload anywhere in the block
+        struct block *b = arena_alloc(a, size + align + METADATA_SIZE
+                                         + GRANULE_SIZE);
+        if (b) { ptr = align_block(a, b, size, align)->payload; }
+
+    } else {
+        if (size <= SLAB_MAX_SIZE) { ptr = slab_alloc(a, slab_class(size)); }
+        if (!ptr) {
+            struct block *b = arena_alloc(a, size);
+            ptr = b ? b->payload : NULL;
+        }
+    }
+    arena_leave(a);
+
+    return ptr;
 
 }
 
@@ -242,18 +1042,32 @@ void crfree(void *ptr) {
 
     // Ignore spurious requests
     if (ptr == NULL) { return; }
+    crstat_add(CRSTAT_FREES, 1);
 
-    // Instance getter
+    // Small objects only clear their bit in the slab descriptor
     struct memory_manager *mm = mm_instance();
+    struct slab *s = slab_of(mm, ptr);
+    if (s) {
+        slab_free(mm, s, ptr);
+        return;
+    }
 
-    // Get block from payload
+    // Get block and the arena it belongs to
     struct block *b = payload_to_block(ptr);
+    struct arena *a = block_arena(b);
 
-    // Coalesce with neighbors
-    b = coalesce(b);
+    if (!a->pool && a != arena_get()) {
 
-    // Add to free list
-    list_push_back(&mm->free, &b->elem);
+        // Another thread's arena; its owner coalesces the block later
+        remote_push(a, b);
+        return;
+
+    }
+
+    // Coalesce with neighbors and add to free list
+    arena_enter(a);
+    release_block(a, b);
+    arena_leave(a);
 
 }
 
@@ -266,44 +1080,39 @@ void *crrealloc(void *ptr, size_t size) {
         return NULL;
     }
 
-    // Keep track of original block
-    char *old_payload = (char *) ptr;
-    struct block *old_b = payload_to_block(old_payload);
+    // Small objects stay in their slab as long as they fit
+    struct slab *s = slab_of(mm_instance(), ptr);
+    if (s) {
+        size_t old_size = class_min_size(s->class);
+        if (size <= old_size) { return ptr; }
 
-    // If new block is smaller than old block, split
-    if (size <= block_payload_size(old_b)) {
-        struct block *b = split_block(old_b, size);
-        return b->payload;
+        char *new_payload = crmalloc_hint(size, slab_arena(s)->pool);
+        if (!new_payload) { return NULL; }
+        memcpy(new_payload, ptr, old_size);
+        crfree(ptr);
+        return new_payload;
     }
 
-    // If block on right is free and large enough, coalesce
-    size_t combined_size = METADATA_SIZE
-                           + block_payload_size(old_b)
-                           + block_payload_size(block_on_left(old_b));
-    if (combined_size >= size) {
-        struct block *right_b = block_on_right(old_b);
-        if (!block_inuse(right_b)) {
-            
-            // Remove right block from free list
-            list_remove(&right_b->elem);
-
-            // Update right boundary tag
-            block_right_tag(right_b)->data.payload_size = combined_size;
-            block_right_tag(right_b)->data.inuse = true;
+    // Keep track of original block
+    char *old_payload = (char *) ptr;
+    struct block *old_b = payload_to_block(old_payload);
+    struct arena *a = block_arena(old_b);
 
-            // Update left boundary tag
-            block_left_tag(old_b)->data.payload_size = combined_size;
-            block_left_tag(old_b)->data.inuse = true;
+    // Blocks of another thread's arena are only ever moved
+    if (a->pool || a == arena_get()) {
+        arena_enter(a);
+        struct block *b = resize_in_place(a, old_b, size);
+        arena_leave(a);
 
-            return old_b->payload;
-        }
+        if (b) { return b->payload; }
     }
 
-    // Otherwise, malloc a new block, copy memory, free old block
-    char *new_payload = crmalloc(size);
-    for (size_t i = 0; i < block_payload_size(old_b); i++) {
-        new_payload[i] = old_payload[i];
-    }
+    // Otherwise, malloc a new block in the same pool, copy, free old block
+    char *new_payload = crmalloc_hint(size, a->pool);
+    if (!new_payload) { return NULL; }
+    size_t ncopy = block_payload_size(old_b) < size ? block_payload_size(old_b)
+                                                    : size;
+    memcpy(new_payload, old_payload, ncopy);
     crfree(old_payload);
     return new_payload;
-}
\ No newline at end of file
+}
@@ -2,11 +2,110 @@
 #define __CRMALLOC_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <sys/types.h>
 #include "list.h"
+#include "crptr.h"
+#include "checkpoint.h"
+
+// Free blocks are segregated by their payload size in whole granules: the
+// first classes hold one granule count each, and every power-of-two range
+// above them is split into 2^SUBCLASS_BITS classes. The last class takes
+// every block too large for the others.
+#define GRANULE_SIZE 16
+#define SUBCLASS_BITS 2
+#define NUM_SIZE_CLASSES 64
+
+// Blocks inspected in a request's own class before looking at larger ones
+#define CLASS_SEARCH_LIMIT 8
+
+// Every thread allocates from an arena it claims for itself, so threads do
+// not contend on the free lists. Arena 0 is shared, under its lock, by the
+// threads left over once every other arena is claimed.
+#define NUM_ARENAS 16
+#define SHARED_ARENA 0
+
+// Objects of up to SLAB_MAX_SIZE bytes are carved out of slabs: runs of
+// SLAB_SIZE bytes holding objects of one size class and nothing else. Which
+// objects are in use is kept out of line, in a descriptor per slab, so that
+// allocating and freeing small objects never writes to their own pages -
+// only to the descriptor pages and to the arena. Slab classes are the size
+// classes above, rounded up, so classes 1 to SLAB_MAX_CLASS are used.
+#define SLAB_SIZE (16 * 1024)
+#define SLAB_MAX_SIZE 1024
+#define SLAB_MAX_CLASS 20
+#define SLAB_BITMAP_WORDS (SLAB_SIZE / GRANULE_SIZE / 64)
+
+// Slabs lie back to back in one area of address space, so the slab of an
+// object is found from its address alone. The area is reserved up front, and
+// mapped into the heap a slab at a time.
+#define SLAB_AREA_SIZE (1ul << 34)
+
+// Placement hints for crmalloc_hint(). Each of CR_HOT, CR_COLD and
+// CR_READONLY puts objects in a pool of pages of its own, shared by all
+// threads, so that the pages of rarely written objects are not dirtied - and
+// committed again - along with a hot object next to them. At most one pool
+// applies: CR_HOT wins over CR_READONLY, which wins over CR_COLD.
+#define CR_HOT (1u << 0)
+#define CR_COLD (1u << 1)
+#define CR_READONLY (1u << 2)
+#define NUM_POOLS 3
+
+// Alignment hints: the payload starts on a cache line or on a page. Neither
+// is kept by crrealloc(), though the pool is.
+#define CR_CACHE_ALIGNED (1u << 3)
+#define CR_PAGE_ALIGNED (1u << 4)
+#define CACHE_LINE_SIZE 64
+
+// Requests of at least LARGE_OBJECT_SIZE get a run of pages of their own,
+// followed by LARGE_RESERVE_SIZE of address space for crrealloc() to grow the
+// run into without moving it
+#define LARGE_OBJECT_SIZE (256 * 1024)
+#define LARGE_RESERVE_SIZE (1ul << 30)
+
+// Free blocks of at least RELEASE_SIZE give the whole pages of their payload
+// back to the OS and to the heap file, so that both follow the live data
+#define RELEASE_SIZE (64 * 1024)
+
+// Pointers between the structures below are crptrs, so the heap can be
+// restored at another address (see nvstore_init_relocatable())
+struct block;
+struct arena;
+
+// Lives in the descriptor pages of the slab area. Only the arena's owner (or
+// a thread holding its lock) sets bits and moves the slab between lists;
+// any thread may clear a bit, atomically, to free an object.
+struct slab {
+    crptr arena; // struct arena allocating from the slab
+    crptr next; // next struct slab on a partial list or the reclaimed stack
+    uint32_t class;
+    uint32_t nfree; // objects free, updated atomically
+    uint32_t full; // off the partial list, until an object is freed
+    uint64_t used[SLAB_BITMAP_WORDS]; // bit per object, and past the last
+};
+
+// Lives in the persistent heap, so arenas are restored with their blocks.
+// Locks and owners are volatile and kept aside by crmalloc.c.
+struct arena {
+    size_t index; // position in memory_manager.arenas, or past it for pools
+    unsigned pool; // CR_HOT, CR_COLD or CR_READONLY, or 0 for thread arenas
+    crptr remote; // blocks freed by other threads, to be coalesced
+    crptr partial[SLAB_MAX_CLASS + 1]; // slabs with free objects
+    crptr reclaimed; // full slabs other threads freed objects in
+    uint64_t nonempty; // bit c is set when free[c] holds a block
+    size_t nfree; // free blocks over all classes
+    struct list free[NUM_SIZE_CLASSES];
+};
 
 struct memory_manager {
-    struct list free;
+    size_t narenas;
+    crptr arenas[NUM_ARENAS];
+    crptr pools[NUM_POOLS]; // created on their first hinted request
+    crptr slab_area; // NULL until the first small object
+    crptr slabs; // descriptors, one per slab of the area
+    size_t nslabs;
+    size_t slab_desc_pages; // pages of descriptors mapped into the heap
 };
 
 union boundary_tag {
@@ -16,9 +115,12 @@ union boundary_tag {
     } data;
 };
 
+// The arena comes first: mem_lo of the first block of a run points to the
+// block itself, which a crptr at offset 0 could not
 struct block {
-    void *mem_lo;
-    void *mem_hi;
+    crptr arena; // arena whose pages hold the block
+    crptr mem_lo;
+    crptr mem_hi;
     union boundary_tag tag; // left tag
     struct list_elem elem;
     char payload[0];
@@ -30,8 +132,22 @@ struct block {
 
 void mm_init(struct memory_manager *mm);
 
+// Resets the volatile arena state - locks and owners - on every boot
+void mm_restore(struct memory_manager *mm);
+
+// Adds the arena headers, which live outside the metadata, to a checkpoint
+void mm_checkpoint_add(struct memory_manager *mm,
+                       struct checkpoint *checkpoint);
+
 void *crmalloc(size_t);
 void crfree(void *);
+
+// crmalloc() of a zeroed array, which leaves pages of the heap that were never
+// written untouched
+void *crcalloc(size_t, size_t);
 void *crrealloc(void *, size_t);
 
+// crmalloc() placing the object by the CR_ hints above
+void *crmalloc_hint(size_t, unsigned);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "crtune.h"
+#include "nvstore.h"
+
+#include <math.h>
+#include <time.h>
+#include <stdint.h>
+
+/******************************************************************************/
+/** Macros, Definitions, and Static Variables: crtune ----------------------- */
+/******************************************************************************/
+static volatile double s_mtbf = CRTUNE_DEFAULT_MTBF;
+
+/******************************************************************************/
+/** Private Implementation: crtune ------------------------------------------ */
+/******************************************************************************/
+
+/** Returns the predicted cost in seconds of a checkpoint taken right now. */
+static double __crtune_cost(const struct nvstats *stats)
+{
+    return (double)stats->dirty_pages * stats->ns_per_page / 1e9;
+}
+
+/******************************************************************************/
+/** Public-Facing API: crtune ----------------------------------------------- */
+/******************************************************************************/
+void crtune_set_mtbf(double seconds)
+{
+    s_mtbf = seconds;
+}
+
+double crtune_get_mtbf()
+{
+    return s_mtbf;
+}
+
+/**
+ * Daly's optimal checkpoint interval for a checkpoint costing [cost] seconds 
+ * on a system failing every [mtbf] seconds on average. Beyond [cost] = 2 * 
+ * [mtbf], checkpointing more often than once per MTBF cannot pay off.
+ */
+double crtune_daly_interval(double cost, double mtbf)
+{
+    double ratio;
+
+    if (cost >= 2 * mtbf)
+        return mtbf;
+
+    ratio = cost / (2 * mtbf);
+    return sqrt(2 * cost * mtbf) * (1 + sqrt(ratio) / 3 + ratio / 9) - cost;
+}
+
+/** The optimal interval in seconds for the checkpoint that is due next. */
+double crtune_interval()
+{
+    struct nvstats stats;
+
+    nvstore_get_stats(&stats);
+    return crtune_daly_interval(__crtune_cost(&stats), s_mtbf);
+}
+
+bool crtune_should_checkpoint()
+{
+    struct nvstats stats;
+    struct timespec now;
+    double elapsed;
+
+    nvstore_get_stats(&stats);
+
+    /* nothing to save */
+    if (stats.dirty_pages == 0)
+        return false;
+
+    /* the commit cost is still unknown, so measure it */
+    if (stats.ns_per_page == 0)
+        return true;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec * 1000000000ull + now.tv_nsec 
+            - stats.last_commit_ns) / 1e9;
+
+    return elapsed >= crtune_daly_interval(__crtune_cost(&stats), s_mtbf);
+}
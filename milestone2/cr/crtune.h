@@ -0,0 +1,32 @@
+#ifndef __CRTUNE_H__
+#define __CRTUNE_H__
+
+#include <stdbool.h>
+
+/** assumed mean time between failures until one is configured, in seconds */
+#define CRTUNE_DEFAULT_MTBF     (24.0 * 60 * 60)
+
+/**
+ * Checkpoint interval auto-tuner. Given the mean time between failures (MTBF)
+ * M and the cost C of a checkpoint, the interval which minimizes the expected
+ * time lost to checkpoints and recomputation is given by Daly's higher order
+ * refinement of Young's approximation sqrt(2CM).
+ * 
+ * C is not a constant here: it is the measured per page commit cost of the 
+ * checkpoint engine times the number of pages currently dirty, so it grows as
+ * the application's dirty rate keeps adding to the next commit. [crtune_should_checkpoint()]
+ * fires once the time since the last commit reaches the optimal interval for
+ * the checkpoint that would be taken right now. Until a first commit has been
+ * measured, it fires as soon as anything is dirty.
+ * 
+ * Polling is cheap - a clock read and a handful of loads - so it can sit in
+ * the hot loop of a computation in place of a hardcoded cadence.
+ */
+void crtune_set_mtbf(double seconds);
+double crtune_get_mtbf();
+
+double crtune_daly_interval(double cost, double mtbf);
+double crtune_interval();
+bool crtune_should_checkpoint();
+
+#endif
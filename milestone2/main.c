@@ -10,7 +10,13 @@
 #include "nvstore_test.h"
 #include "memcheck_test.h"
 #include "crmalloc_test.h"
+#include "crarena_test.h"
 #include "checkpoint_test.h"
+#include "throttle_test.h"
+#include "crtune_test.h"
+#include "crstat_test.h"
+#include "crtrace_test.h"
+#include "crashsched_test.h"
 #include "crthread_test.h"
 #include "crashtest.h"
 
@@ -49,6 +55,7 @@ void run_all_tests()
     run_test(test_vtsaddrtable_basic_insertion, "vtsaddrtable", "Basic insertion for one block");
     run_test(test_vtsaddrtable_expansion, "vtsaddrtable", "More insertions expand the table");
     run_test(test_vtsaddrtable_large_entries, "vtsaddrtable", "Insertions of larger than one page");
+    run_test(test_vtsaddrtable_large_block, "vtsaddrtable", "One block larger than the whole table");
 
     /**************************************************************************/
     /** Tests: nvstore ------------------------------------------------------ */
@@ -59,6 +66,9 @@ void run_all_tests()
     run_test(test_nvstore_checkpoint_simple, "nvstore", "Simple data checkpointing and restoration");
     run_test(test_nvstore_checkpoint_complex, "nvstore", "Complex data checkpointing and restoration");
     run_test(test_nvstore_checkpoint_without_shutdown, "nvstore", "Checkpoint twice before shutdown");
+    run_test(test_nvstore_checkpoint_background, "nvstore", "Background checkpoint from a forked child");
+    run_test(test_nvstore_io_limits, "nvstore", "Throttled checkpoint at idle I/O priority");
+    run_test(test_nvstore_zeropage, "nvstore", "Reads of fresh pages share the zero page");
 
     /**************************************************************************/
     /** Tests: memcheck ----------------------------------------------------- */
@@ -75,6 +85,20 @@ void run_all_tests()
     run_test(test_crmalloc_complex, "crmalloc", "Complex crmalloc() and crfree()");
     run_test(test_crmalloc_recovery, "crmalloc", "Heap checkpointing and restoration");
     run_test(test_crmalloc_integration, "crmalloc", "Integration of crmalloc(), crfree(), and crrealloc()");
+    run_test(test_crmalloc_size_classes, "crmalloc", "Free blocks are reused by size class");
+    run_test(test_crmalloc_threads, "crmalloc", "Concurrent crmalloc() and cross-thread crfree()");
+    run_test(test_crmalloc_hints, "crmalloc", "Placement hints keep pools on separate pages");
+    run_test(test_crmalloc_large_realloc, "crmalloc", "Large objects grow in place without copying");
+    run_test(test_crmalloc_churn, "crmalloc", "Allocation churn only dirties allocator metadata");
+    run_test(test_crcalloc, "crmalloc", "crcalloc() zeroes without touching fresh pages");
+    run_test(test_crmalloc_release, "crmalloc", "Freed runs leave memory and the heap file");
+    run_test(test_crmalloc_relocation, "crmalloc", "Relocatable heaps restore at another address");
+
+    /**************************************************************************/
+    /** Tests: crarena ------------------------------------------------------ */
+    /**************************************************************************/
+    run_test(test_crarena_basic, "crarena", "Bump allocation, reset, and large objects");
+    run_test(test_crarena_restore, "crarena", "Cursor is restored to the last checkpoint");
 
     /**************************************************************************/
     /** Tests: vtslist ------------------------------------------------------ */
@@ -86,12 +110,55 @@ void run_all_tests()
     /**************************************************************************/
     run_test(test_checkpoint_basic, "checkpoint", "Basic sequential checkpointing capacity");
     run_test(test_checkpoint_stack_variables, "checkpoint", "Tests checkpointing a thread's stack variables");
+    run_test(test_checkpoint_context_controls, "checkpoint", "Contexts restore the floating-point controls");
+    run_test(test_checkpoint_context_registers, "checkpoint", "Contexts restore the callee-saved registers");
+    run_test(test_checkpoint_async, "checkpoint", "Asynchronous commit captures a consistent image");
+
+    /**************************************************************************/
+    /** Tests: throttle ----------------------------------------------------- */
+    /**************************************************************************/
+    run_test(test_throttle_unlimited, "throttle", "Unlimited throttle never delays");
+    run_test(test_throttle_bandwidth, "throttle", "Bandwidth cap, adjustable at runtime");
+    run_test(test_throttle_iops, "throttle", "IOPS cap");
+
+    /**************************************************************************/
+    /** Tests: crtune ------------------------------------------------------- */
+    /**************************************************************************/
+    run_test(test_crtune_daly, "crtune", "Daly's optimal checkpoint interval");
+    run_test(test_crtune_should_checkpoint, "crtune", "Checkpoint advice follows cost and MTBF");
+
+    /**************************************************************************/
+    /** Tests: crstat ------------------------------------------------------- */
+    /**************************************************************************/
+    run_test(test_crstat_buckets, "crstat", "Log2 histogram bucketing");
+    run_test(test_crstat_shared_segment, "crstat", "Statistics are published in shared memory");
+
+    /**************************************************************************/
+    /** Tests: crtrace ------------------------------------------------------ */
+    /**************************************************************************/
+    run_test(test_crtrace_ring_wraparound, "crtrace", "Rings keep the most recent events");
+    run_test(test_crtrace_chrome_export, "crtrace", "Hot points export to Chrome trace JSON");
+
+    /**************************************************************************/
+    /** Tests: crashsched --------------------------------------------------- */
+    /**************************************************************************/
+    run_test(test_crashsched_exit, "crashsched", "Children exiting first are not killed");
+    run_test(test_crashsched_exponential, "crashsched", "Exponential delays have the requested mean");
+    run_test(test_crashsched_during_commit, "crashsched", "Kills land in the middle of a commit");
 
     /**************************************************************************/
     /** Tests: crthread ----------------------------------------------------- */
     /**************************************************************************/
     run_test(test_crthread_basic, "crthread", "Basic crthread test");
     run_test(test_crthread_restore_graceful, "crthread", "Test to restore a single thread after crash.");
+    run_test(test_crthread_stack_usage, "crthread", "Stacks are measured and sized upon request");
+    run_test(test_crthread_inplace, "crthread", "Threads checkpoint in place on the same pthread");
+    run_test(test_crthread_checkpoint_all, "crthread", "All threads checkpoint as one global epoch");
+    run_test(test_crthread_checkpoint_all_restore, "crthread", "A crash restores every thread from one epoch");
+    run_test(test_crthread_preemption, "crthread", "Threads are checkpointed preemptively by a timer");
+    run_test(test_crthread_preemption_restore, "crthread", "A crash restores a thread from a preemptive checkpoint");
+    run_test(test_crthread_burst, "crthread", "Many threads checkpoint at once");
+    run_test(test_crthread_resurrect_many, "crthread", "Many threads are resurrected at once");
 
     /**************************************************************************/
     /** Integration Testing ------------------------------------------------- */
@@ -4,7 +4,13 @@
 #include "crmalloc.h"
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 /** Creates a new checkpoint object. */
 struct checkpoint *checkpoint_new()
@@ -13,16 +19,30 @@ struct checkpoint *checkpoint_new()
 
     checkpoint = mcmalloc(sizeof(*checkpoint));
     checkpoint->addrs = vaddrlist_new(NVADDRLIST_INIT_POWER);
+    checkpoint->captured = vaddrlist_new(NVADDRLIST_INIT_POWER);
 
     checkpoint->is_kill_message = false;
+    checkpoint->is_async = false;
+    checkpoint->is_background = false;
+    checkpoint->inflight = false;
+    checkpoint->failed = false;
+
     sem_init(&checkpoint->finished, 0, 0);
+    checkpoint->completionfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(checkpoint->completionfd != -1);
 
     return checkpoint;
 }
 
-/** Deletes the checkpoint object supplied. */
+/** Deletes the checkpoint object supplied, reaping any commit in flight. */
 void checkpoint_delete(struct checkpoint *checkpoint)
 {
+    checkpoint_wait(checkpoint);
+
+    close(checkpoint->completionfd);
+    sem_destroy(&checkpoint->finished);
+
+    vaddrlist_delete(checkpoint->captured);
     vaddrlist_delete(checkpoint->addrs);
     mcfree(checkpoint);
 }
@@ -33,18 +53,126 @@ void checkpoint_add(struct checkpoint *checkpoint, void *addr, size_t len)
     vaddrlist_insert_pages_of(checkpoint->addrs, addr, len);
 }
 
+/** 
+ * Removes every region from the checkpoint. An asynchronous commit in flight 
+ * is unaffected, as it only writes the pages it captured upon submission.
+ */
+void checkpoint_clear(struct checkpoint *checkpoint)
+{
+    vaddrlist_clear(checkpoint->addrs);
+}
+
 /** 
  * Commits the region by sending this object to the checkpoint worker and 
  * waiting until the commit job is completed.
  */
 void checkpoint_commit(struct checkpoint *checkpoint)
 {
+    checkpoint_wait(checkpoint);
+
+    checkpoint->is_async = false;
+    checkpoint->inflight = true;
+
     nvstore_submit_checkpoint(checkpoint);
-    sem_wait(&checkpoint->finished);
+    checkpoint_wait(checkpoint);
 }
 
-/** Marks the commit as finished - should only be called by system. */
+/** 
+ * Marks the commit as finished - should only be called by system. The owner
+ * may delete the checkpoint as soon as [finished] is posted, so the eventfd 
+ * must be signalled first.
+ */
 void checkpoint_post_commit_finished(struct checkpoint *checkpoint)
 {
+    uint64_t post = 1;
+
+    assert(write(checkpoint->completionfd, &post, sizeof(post)) 
+           == sizeof(post));
     sem_post(&checkpoint->finished);
-}
\ No newline at end of file
+}
+
+/**
+ * Captures the dirty pages of every region in this checkpoint and hands them 
+ * to the checkpoint worker, returning without waiting for the write. The 
+ * returned handle is the checkpoint itself and must be reaped through 
+ * [checkpoint_test()], [checkpoint_wait()] or [checkpoint_wait_timeout()] 
+ * before the object is committed again.
+ */
+struct checkpoint *checkpoint_commit_async(struct checkpoint *checkpoint)
+{
+    uint64_t drain;
+
+    checkpoint_wait(checkpoint);
+
+    /* Clear any completion left unread on the eventfd by a previous commit. */
+    while (read(checkpoint->completionfd, &drain, sizeof(drain)) > 0);
+
+    checkpoint->is_async = true;
+    checkpoint->inflight = true;
+
+    nvstore_submit_checkpoint(checkpoint);
+    return checkpoint;
+}
+
+/** Returns true if no commit is in flight, reaping a finished one. */
+bool checkpoint_test(struct checkpoint *checkpoint)
+{
+    if (!checkpoint->inflight)
+        return true;
+
+    if (sem_trywait(&checkpoint->finished) != 0)
+        return false;
+
+    checkpoint->inflight = false;
+    return true;
+}
+
+/** Blocks until the commit in flight, if any, is finished. */
+void checkpoint_wait(struct checkpoint *checkpoint)
+{
+    if (!checkpoint->inflight)
+        return;
+
+    while (sem_wait(&checkpoint->finished) != 0)
+        assert(errno == EINTR);
+
+    checkpoint->inflight = false;
+}
+
+/** 
+ * Blocks for at most [timeout_us] microseconds until the commit in flight is
+ * finished. Returns true if the commit finished in time.
+ */
+bool checkpoint_wait_timeout(struct checkpoint *checkpoint, long timeout_us)
+{
+    struct timespec deadline;
+
+    if (!checkpoint->inflight)
+        return true;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_us / 1000000;
+    deadline.tv_nsec += (timeout_us % 1000000) * 1000;
+
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    while (sem_timedwait(&checkpoint->finished, &deadline) != 0)
+    {
+        if (errno == ETIMEDOUT)
+            return false;
+        assert(errno == EINTR);
+    }
+
+    checkpoint->inflight = false;
+    return true;
+}
+
+/** Returns an eventfd which becomes readable when a commit is finished. */
+int checkpoint_completion_fd(struct checkpoint *checkpoint)
+{
+    return checkpoint->completionfd;
+}
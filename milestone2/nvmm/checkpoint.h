@@ -29,26 +29,61 @@
  * continue as usual. The calling thread is free to either delete the checkpoint
  * object. Alternatively, the calling thread can also add more regions to this
  * checkpoint object before requesting another commit.
+ * [checkpoint_clear()] drops every region added so far, for checkpoints whose
+ * regions move between commits, such as the live part of a thread's stack.
  * 
  * Two user threads should NOT attempt to modify the same checkpoint object by
  * calling [checkpoint_add()] at the same time. Checkpoints should be "owned"
  * by a single thread.
+ * 
+ * Data-only checkpoints (i.e. regions which do NOT include the calling 
+ * thread's own stack) may instead be committed with [checkpoint_commit_async()]
+ * which returns as soon as the dirty pages of the regions have been captured.
+ * Captured pages are write-protected until the background worker has copied 
+ * them, so writes issued after the call returns never tear the image being 
+ * committed. The checkpoint object itself doubles as the completion handle:
+ * 
+ *  - [checkpoint_test()] polls for completion without blocking.
+ *  - [checkpoint_wait()] and [checkpoint_wait_timeout()] block on completion.
+ *  - [checkpoint_completion_fd()] returns an eventfd which becomes readable 
+ *    once the commit is finished, suitable for use with poll() and epoll().
+ * 
+ * A checkpoint object can only have one commit in flight at a time.
+ * 
+ * Background checkpoints created by [nvstore_checkpoint_everything_background()]
+ * use the same completion interface. Their pages are written by a forked child
+ * process, and [failed] is set if the child could not make them durable.
  */
 
 struct checkpoint
 {
-    struct vaddrlist *addrs;
+    struct vaddrlist *addrs;        /* pages of the regions to checkpoint     */
+    struct vaddrlist *captured;     /* dirty pages captured by async commits  */
     struct vtslist_elem tselem;
 
     bool is_kill_message;
+    bool is_async;                  /* commit from [captured] pages instead   */
+    bool is_background;             /* commit all dirty pages from a child    */
+    volatile bool inflight;         /* a commit was submitted, not yet reaped */
+    volatile bool failed;           /* the last commit was not made durable   */
+
     sem_t finished;
+    int completionfd;               /* eventfd posted alongside [finished]    */
 };
 
 struct checkpoint *checkpoint_new();
 void checkpoint_delete(struct checkpoint *checkpoint);
 
 void checkpoint_add(struct checkpoint *checkpoint, void *addr, size_t len);
+void checkpoint_clear(struct checkpoint *checkpoint);
 void checkpoint_commit(struct checkpoint *checkpoint);
 void checkpoint_post_commit_finished(struct checkpoint *checkpoint);
 
+/** Non-blocking commit and its completion interface */
+struct checkpoint *checkpoint_commit_async(struct checkpoint *checkpoint);
+bool checkpoint_test(struct checkpoint *checkpoint);
+void checkpoint_wait(struct checkpoint *checkpoint);
+bool checkpoint_wait_timeout(struct checkpoint *checkpoint, long timeout_us);
+int checkpoint_completion_fd(struct checkpoint *checkpoint);
+
 #endif
\ No newline at end of file
@@ -13,20 +13,27 @@
 #include <errno.h>
 
 #include <syscall.h>
+#include <signal.h>
+#include <sys/prctl.h>
 #include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
 
 #include <linux/userfaultfd.h>
+#include <linux/ioprio.h>
 
 #include <pthread.h>
+#include <semaphore.h>
 #include <assert.h>
 #include <alloca.h>
 
 #include "vblock.h"
 #include "checkpoint.h"
+#include "throttle.h"
 
 #include "vtslist.h"
 #include "vtsdirtyset.h"
@@ -34,11 +41,33 @@
 #include "crmalloc.h"
 
 #include "macros.h"
+#include "crstat.h"
+#include "crtrace.h"
 
 /******************************************************************************/
 /** Macros, Definitions, and Static Variables: nvstore ---------------------- */
 /******************************************************************************/
 
+/* relocatable heaps lie in one range of address space this large, aligned so
+ * that the kernel may back it with huge pages */
+#define NVREGION_SIZE           (1ul << 44)
+#define NVREGION_ALIGN          (2ul << 20)
+
+/* marks the address recorded for a block of a relocatable heap, which is its
+ * offset into the range rather than where it was mapped */
+#define NVRECORD_RELATIVE       0x1ul
+
+/* most blocking commits the checkpoint worker writes as one batch */
+#define NVCOMMIT_BATCH          64
+
+/* address space held back after an allocation, for it to grow into */
+struct nvreservation
+{
+    struct list_elem elem;
+    void *start;                /* first page not yet handed out              */
+    size_t npages;              /* pages left in the reservation              */
+};
+
 /* non-volatile storage manager struct */
 struct nvstore
 {
@@ -55,16 +84,33 @@ struct nvstore
     int killfd;                 /* killswitch for userfaultfd handler         */
     void *tmppage;              /* the mmapped page to load upon pagefault    */
 
+    /* write-protection used to capture pages for asynchronous commits        */
+    /* ---------------------------------------------------------------------- */
+    bool wpsupported;           /* kernel supports userfaultfd write-protect  */
+    pthread_mutex_t wplock;     /* orders captures against fault resolution   */
+
     /* checkpoint worker and associated data structures                       */
     /* ---------------------------------------------------------------------- */
     pthread_t crworker;         /* thread for handling requests to checkpoint */
+    pid_t crworkertid;          /* kernel thread id of [crworker]             */
     struct vtslist crinput;     /* input message queue for async. checkpoints */
+    struct throttle throttle;   /* bandwidth and IOPS cap on checkpoint I/O   */
+    struct vaddrlist *released; /* released pages the commit punches out      */
+    struct nvstats stats;       /* commit cost and dirty rate measurements    */
 
     /* non-volatile filesystem used to store data on checkpoint               */
     /* ---------------------------------------------------------------------- */
     FILE *nvfs;                 /* file where the heap pages are stored       */
     off_t filesize;             /* size of file, tracked manually             */
+    pthread_mutex_t alloclock;  /* serializes growth of the heap and file     */
+    struct list reservations;   /* [nvreservation]s, guarded by [alloclock]   */
     struct nvmetadata *meta;    /* metadata object                            */
+
+    /* relocatable heaps, whose blocks all lie in one range of address space  */
+    /* ---------------------------------------------------------------------- */
+    uint8_t *region;            /* start of the range, or NULL when pinned    */
+    uint8_t *cursor;            /* pages past it were never handed out        */
+    bool relocated;             /* restored elsewhere than it was last mapped */
 };
 
 /** static variables for holding nvstore state (use like it's an object) */
@@ -73,9 +119,10 @@ static struct nvstore *const self = &s_nvstore;
 
 /** task function - do not call directly, run on separate thread */
 static void *nvstore_tf_uffdworker(__attribute__((unused))void *arg);
-static void *nvstore_tf_crworker(__attribute__((unused))void *arg);
+static void *nvstore_tf_crworker(void *arg);
 
 /** helper init functions */
+static int nvstore_initregion(void *base);
 static int nvstore_initnvfs(const char *filename);
 static int nvstore_initmmap();
 static int nvstore_inituffdworker();
@@ -87,6 +134,36 @@ static struct vblock *nvstore_fetchnvfs();
 
 /** helper allocation function, allows address specification */
 static struct vblock *__nvstore_allocpage(size_t size, void *addr);
+static struct vblock *__nvstore_addblock(struct vblock *block, bool fresh);
+
+/** helpers placing blocks and reservations in the range of relocatable heaps */
+static bool __nvstore_inregion(void *start, size_t npages);
+static bool __nvstore_isfree(void *start, size_t npages);
+static void *__nvstore_bump(size_t npages);
+static void __nvstore_addreservation(void *start, size_t npages);
+
+/** commits the dirty pages of blocking checkpoints, returns pages written */
+static size_t nvstore_commit_dirty(struct checkpoint **batch, size_t nbatch);
+static size_t nvstore_commit_regions(struct checkpoint *checkpoint);
+
+/** helpers for capturing and committing pages of asynchronous checkpoints */
+static void nvstore_capture_checkpoint(struct checkpoint *checkpoint);
+static void nvstore_capture_everything(struct checkpoint *checkpoint);
+static size_t nvstore_commit_captured(struct checkpoint *checkpoint, 
+                                      void *pgbuf);
+static void nvstore_writeprotect(void *pgstart, bool protect);
+static void nvstore_writeprotect_block(struct vblock *block);
+static void nvstore_handle_zerofault(void *pgstart);
+static void nvstore_punch_released();
+
+/** helpers for fork-based background checkpoints */
+static size_t nvstore_commit_background(struct checkpoint *checkpoint);
+static void nvstore_bgsave_child(const void **sources, off_t *offsets, 
+                                 size_t npages, off_t lockoffset, 
+                                 pid_t parent);
+
+/** accounts for a finished commit in the statistics */
+static void nvstore_record_commit(const struct timespec *start, size_t npages);
 
 /******************************************************************************/
 /** Public-Facing API: nvmetadata ------------------------------------------- */
@@ -128,6 +205,7 @@ void nvmetadata_checkpoint(struct nvmetadata *meta)
 
     checkpoint = checkpoint_new();
     checkpoint_add(checkpoint, meta, sizeof(*meta));
+    mm_checkpoint_add(&meta->mm, checkpoint);
 
     nvmetadata_lock(meta);
     checkpoint_commit(checkpoint);
@@ -155,16 +233,137 @@ void nvmetadata_checkpoint(struct nvmetadata *meta)
  */
 static struct vblock *__nvstore_allocpage(size_t npages, void *addr)
 {
-    struct uffdio_register reg;
     struct vblock *block;
-    
+    bool fresh = addr == NULL;
+
     /* raw allocation and mmap() - offset should be at end of file */
-    block = vblock_new(addr, npages, self->filesize);
+    if (self->region == NULL || !(fresh || __nvstore_inregion(addr, npages)))
+        block = vblock_new(addr, npages, self->filesize);
+    else
+    {
+        /* relocatable heaps map new blocks at the end of their range */
+        if (fresh)
+            addr = __nvstore_bump(npages);
+
+        if (addr == NULL)
+            return NULL;
+
+        block = vblock_new_fixed(addr, npages, self->filesize, true);
+    }
+
+    return __nvstore_addblock(block, fresh);
+}
+
+/** Determines whether [npages] pages from [start] on lie in the heap's range. */
+static bool __nvstore_inregion(void *start, size_t npages)
+{
+    return self->region != NULL && (uint8_t *)start >= self->region
+        && (uint8_t *)start + npages * sysconf(_SC_PAGE_SIZE) 
+           <= self->region + NVREGION_SIZE;
+}
+
+/**
+ * Determines whether none of [npages] pages from [start] on, in the range of a
+ * relocatable heap, belongs to a block or a reservation. The caller holds 
+ * [alloclock], which every block is added under.
+ */
+static bool __nvstore_isfree(void *start, size_t npages)
+{
+    struct nvreservation *reservation;
+    struct list_elem *elem;
+    struct vblock *block;
+    uint8_t *end;
+    bool isfree;
+
+    end = (uint8_t *)start + npages * sysconf(_SC_PAGE_SIZE);
+    if (!__nvstore_inregion(start, npages))
+        return false;
+
+    /* nothing was ever handed out past the cursor */
+    if ((uint8_t *)start >= self->cursor)
+        return true;
+
+    for (elem = list_begin(&self->reservations); 
+         elem != list_end(&self->reservations); elem = list_next(elem))
+    {
+        reservation = list_entry(elem, struct nvreservation, elem);
+        if ((uint8_t *)reservation->start < end 
+            && (uint8_t *)start < (uint8_t *)reservation->start 
+               + reservation->npages * sysconf(_SC_PAGE_SIZE))
+            return false;
+    }
+
+    isfree = true;
+    pthread_mutex_lock(&self->blocks.lock);
+
+    for (elem = list_begin(&self->blocks.list); 
+         isfree && elem != list_end(&self->blocks.list); 
+         elem = list_next(elem))
+    {
+        block = container_of(elem, struct vblock, tselem.elem);
+        isfree = (uint8_t *)block->pgstart >= end 
+              || (uint8_t *)start >= (uint8_t *)block->pgstart 
+                 + block->npages * sysconf(_SC_PAGE_SIZE);
+    }
+
+    pthread_mutex_unlock(&self->blocks.lock);
+    return isfree;
+}
+
+/** Hands out the next [npages] pages of a relocatable heap's range, or NULL. */
+static void *__nvstore_bump(size_t npages)
+{
+    void *addr;
+
+    if (!__nvstore_inregion(self->cursor, npages))
+        return NULL;
+
+    addr = self->cursor;
+    self->cursor += npages * sysconf(_SC_PAGE_SIZE);
+
+    return addr;
+}
+
+/** Holds back [npages] pages from [start] on for an allocation to grow into. */
+static void __nvstore_addreservation(void *start, size_t npages)
+{
+    struct nvreservation *reservation;
+
+    reservation = mcmalloc(sizeof(*reservation));
+    reservation->start = start;
+    reservation->npages = npages;
+    list_push_back(&self->reservations, &reservation->elem);
+}
+
+/**
+ * Takes a block just mapped at the end of the file into the heap. A [fresh]
+ * block is not backed by the file yet, and gets space allocated for it there.
+ */
+static struct vblock *__nvstore_addblock(struct vblock *block, bool fresh)
+{
+    struct uffdio_register reg;
+    uint8_t *end;
+
+    /* blocks of a relocatable heap are recorded by their offset into its range,
+     * which the cursor stays past */
+    if (__nvstore_inregion(block->pgstart, block->npages))
+    {
+        block->nvaddr = (void *)(((uint8_t *)block->pgstart - self->region) 
+                                 | NVRECORD_RELATIVE);
+
+        end = (uint8_t *)block->pgstart 
+            + block->npages * sysconf(_SC_PAGE_SIZE);
+        if (end > self->cursor)
+            self->cursor = end;
+    }
 
     /* if this allocation was brand-new (no backing address) then allocate space
-     * in the file for the new block */
-    if (addr == NULL)
+     * in the file for the new block, whose pages are all zeroes so far */
+    if (fresh)
+    {
         vblock_dumptofile(block, self->nvfs);
+        memset(block->pgflags, VBLOCK_PG_ZERO, block->npages);
+    }
 
     /* increment the filesize by the amount of data we just wrote */
     self->filesize += vblock_nvfsize(block);
@@ -178,6 +377,9 @@ static struct vblock *__nvstore_allocpage(size_t npages, void *addr)
     reg.range.len = block->npages * sysconf(_SC_PAGE_SIZE);
     reg.mode = UFFDIO_REGISTER_MODE_MISSING;
 
+    if (self->wpsupported)
+        reg.mode |= UFFDIO_REGISTER_MODE_WP;
+
     /* and register the block itself. */
     assert(ioctl(self->uffd, UFFDIO_REGISTER, &reg) != -1);
 
@@ -188,6 +390,119 @@ static struct vblock *__nvstore_allocpage(size_t npages, void *addr)
     return block;
 }
 
+/** Sets or clears write-protection on one page, waking any blocked writer. */
+static void nvstore_writeprotect(void *pgstart, bool protect)
+{
+    struct uffdio_writeprotect wp;
+
+    wp.range.start = (uintptr_t)pgstart;
+    wp.range.len = sysconf(_SC_PAGE_SIZE);
+    wp.mode = protect ? UFFDIO_WRITEPROTECT_MODE_WP : 0;
+
+    assert(ioctl(self->uffd, UFFDIO_WRITEPROTECT, &wp) != -1);
+}
+
+/**
+ * Write-protects every page of a block with a single request. A block is added
+ * to the list of blocks before it is registered for faults, and the request 
+ * fails with ENOENT for a block which is not registered yet - such a block was
+ * never faulted in, so there is nothing in it to protect. Any other failure 
+ * would leave pages writable without faulting while they are captured.
+ */
+static void nvstore_writeprotect_block(struct vblock *block)
+{
+    struct uffdio_writeprotect wp;
+
+    wp.range.start = (uintptr_t)block->pgstart;
+    wp.range.len = block->npages * sysconf(_SC_PAGE_SIZE);
+    wp.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+
+    if (ioctl(self->uffd, UFFDIO_WRITEPROTECT, &wp) == -1)
+        assert(errno == ENOENT);
+}
+
+/**
+ * Handles a write to a write-protected page. If the page was captured by an 
+ * asynchronous commit which has not copied it yet, the pre-write contents are
+ * preserved as a shadow copy for the checkpoint worker first. Either way, the
+ * page is logged as dirty again and the writer is released.
+ */
+static void nvstore_handle_wpfault(void *pgstart)
+{
+    struct vblock *block;
+    size_t pgidx;
+
+    block = vtsaddrtable_find(self->table, pgstart);
+    pgidx = vblock_pgindex(block, pgstart);
+
+    pthread_mutex_lock(&self->wplock);
+
+    if ((block->pgflags[pgidx] & VBLOCK_PG_INFLIGHT) != 0 
+        && block->pgshadow[pgidx] == NULL)
+    {
+        block->pgshadow[pgidx] = mcmalloc(sysconf(_SC_PAGE_SIZE));
+        memcpy(block->pgshadow[pgidx], pgstart, sysconf(_SC_PAGE_SIZE));
+    }
+
+    block->pgflags[pgidx] &= ~VBLOCK_PG_ZERO;
+    vtsdirtyset_insert(self->dirty, pgstart);
+    self->stats.pages_dirtied++;
+    crstat_add(CRSTAT_PAGES_DIRTIED, 1);
+    nvstore_writeprotect(pgstart, false);
+
+    pthread_mutex_unlock(&self->wplock);
+}
+
+/**
+ * Handles a read of a page which is not mapped yet by mapping the shared zero
+ * page in, write-protected. The page is neither copied nor logged as dirty, so
+ * it costs nothing to checkpoint until [nvstore_handle_wpfault()] sees a write
+ * to it.
+ * 
+ * Threads which did not fault may write to the page between it being mapped 
+ * and being write-protected. Such writes are caught by checking that the page
+ * still reads as zeroes once it is protected, and the page is dirtied then.
+ */
+static void nvstore_handle_zerofault(void *pgstart)
+{
+    struct uffdio_zeropage zeropage;
+    struct uffdio_range range;
+    struct vblock *block;
+    size_t pgidx;
+
+    block = vtsaddrtable_find(self->table, pgstart);
+    pgidx = vblock_pgindex(block, pgstart);
+
+    zeropage.range.start = (uintptr_t)pgstart;
+    zeropage.range.len = sysconf(_SC_PAGE_SIZE);
+    zeropage.mode = UFFDIO_ZEROPAGE_MODE_DONTWAKE;
+
+    pthread_mutex_lock(&self->wplock);
+
+    /* an earlier fault on the same page may have mapped it in already */
+    if (ioctl(self->uffd, UFFDIO_ZEROPAGE, &zeropage) != -1)
+    {
+        nvstore_writeprotect(pgstart, true);
+
+        if (memcmp(pgstart, self->tmppage, sysconf(_SC_PAGE_SIZE)) != 0)
+        {
+            block->pgflags[pgidx] &= ~VBLOCK_PG_ZERO;
+            vtsdirtyset_insert(self->dirty, pgstart);
+            self->stats.pages_dirtied++;
+            crstat_add(CRSTAT_PAGES_DIRTIED, 1);
+            nvstore_writeprotect(pgstart, false);
+        }
+    }
+    else
+        assert(errno == EEXIST);
+
+    pthread_mutex_unlock(&self->wplock);
+
+    range.start = (uintptr_t)pgstart;
+    range.len = sysconf(_SC_PAGE_SIZE);
+    ioctl(self->uffd, UFFDIO_WAKE, &range);
+}
+
 /**
  * When a pagefault occurs, this function handles the swapping back in of a new
  * page along with logging that the page was touched at some point. The log will
@@ -197,111 +512,713 @@ static void nvstore_handle_pagefault()
 {
     struct uffdio_copy uffdio_copy;
     struct uffd_msg msg;
+    struct vblock *block;
     void *addr, *pgstart;
 
+    uint64_t start;
     int nread;
 
     /* read in the new pagefault message and ensure we actually pagefaulted */
     nread = read(self->uffd, &msg, sizeof(msg));
+    if (nread == -1 && errno == EAGAIN)
+        return;
+
     assert(nread != -1);
     assert(msg.event == UFFD_EVENT_PAGEFAULT);
 
+    start = crstat_now_ns();
+    CRTRACE(CRTRACE_FAULT, CRTRACE_BEGIN, msg.arg.pagefault.address);
+
     /* retrieve the offending address and get its original page */
     addr = (void *)msg.arg.pagefault.address;
     pgstart = (void *)((uintptr_t)addr & ~(sysconf(_SC_PAGE_SIZE) - 1));
 
-    /* log the touched page as dirty */
-    vtsdirtyset_insert(self->dirty, pgstart);
+    /* writes to captured pages are resolved without swapping in a new page */
+    if ((msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP) != 0)
+    {
+        nvstore_handle_wpfault(pgstart);
+
+        crstat_add(CRSTAT_WPFAULTS, 1);
+        crstat_record(CRSTAT_FAULT_NS, crstat_now_ns() - start);
+        CRTRACE(CRTRACE_FAULT, CRTRACE_END, 0);
+        return;
+    }
+
+    /* reads can share the zero page for as long as the page is not written */
+    if (self->wpsupported 
+        && (msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE) == 0)
+    {
+        nvstore_handle_zerofault(pgstart);
+
+        crstat_add(CRSTAT_ZEROFAULTS, 1);
+        crstat_record(CRSTAT_FAULT_NS, crstat_now_ns() - start);
+        CRTRACE(CRTRACE_FAULT, CRTRACE_END, 0);
+        return;
+    }
+
+    block = vtsaddrtable_find(self->table, pgstart);
+
+    /* log the touched page as dirty - the page must not be captured between
+     * being logged and being swapped in, so hold the capture lock */
+    pthread_mutex_lock(&self->wplock);
+    block->pgflags[vblock_pgindex(block, pgstart)] &= ~VBLOCK_PG_ZERO;
+    vtsdirtyset_insert(self->dirty, pgstart);
+    self->stats.pages_dirtied++;
+
+    /* specify the new page to swap back in to finish the pagefault */
+    uffdio_copy.src = (uintptr_t)self->tmppage;
+    uffdio_copy.dst = (uintptr_t)pgstart;
+
+    uffdio_copy.len = sysconf(_SC_PAGE_SIZE);
+    uffdio_copy.mode = 0;
+    uffdio_copy.copy = 0;
+
+    /* finally, copy the new page in - this unblocks the offending thread */
+    assert(ioctl(self->uffd, UFFDIO_COPY, &uffdio_copy) != -1);
+    pthread_mutex_unlock(&self->wplock);
+
+    crstat_add(CRSTAT_FAULTS, 1);
+    crstat_add(CRSTAT_PAGES_DIRTIED, 1);
+    crstat_record(CRSTAT_FAULT_NS, crstat_now_ns() - start);
+    crstat_set(CRSTAT_DIRTY_PAGES, vtsdirtyset_size(self->dirty));
+    CRTRACE(CRTRACE_FAULT, CRTRACE_END, 0);
+}
+
+/**
+ * The worker thread function which services pagefaults. The input argument is
+ * not used. Polls for events from two file descriptors - one is the uffd itself
+ * and the other is a killfd which signifies when this worker routine is to be
+ * killed.
+ *
+ * Does not return anything meaningful.
+ */
+static void *nvstore_tf_uffdworker(__attribute__((unused))void *arg)
+{
+    struct pollfd pollfds[2]; /* 0: uffd, 1: killfd */
+    int nready;
+
+    pollfds[0].fd = self->uffd;
+    pollfds[0].events = POLLIN;
+
+    pollfds[1].fd = self->killfd;
+    pollfds[1].events = POLLIN;
+
+    crtrace_name_thread("uffdworker");
+
+    for (;;)
+    {
+        nready = poll(pollfds, 2, -1);
+        assert(nready != -1);
+
+        if ((pollfds[0].revents & POLLIN) != 0)
+            nvstore_handle_pagefault();
+
+        if ((pollfds[1].revents & POLLIN) != 0)
+            break;
+    }
+
+    return NULL;
+}
+
+/**
+ * The worker thread function which services address region checkpoint requests.
+ * The input argument is a semaphore, posted once the worker has published its
+ * thread id. This function continuously polls for new lists of addresses to 
+ * checkpoint, checkpoints them, and then notifies the sender that it is 
+ * complete with its job. Every page written is charged against the throttle,
+ * and every commit is timed for the statistics.
+ * 
+ * Does not return anything meaningful.
+ */
+static void *nvstore_tf_crworker(void *arg)
+{
+    struct vtslist_elem *tselem;
+    struct checkpoint *checkpoint, *next = NULL;
+    struct checkpoint *batch[NVCOMMIT_BATCH];
+    struct timespec start;
+
+    size_t npages, nbatch, i;
+    void *pgbuf;
+
+    pgbuf = alloca(sysconf(_SC_PAGE_SIZE));
+
+    self->crworkertid = syscall(SYS_gettid);
+    sem_post((sem_t *)arg);
+
+    crtrace_name_thread("crworker");
+
+    for (;;)
+    {
+        /* A request taken off the queue while gathering a batch goes next. */
+        if (next != NULL)
+        {
+            checkpoint = next;
+            next = NULL;
+        }
+        else
+        {
+            tselem = vtslist_pop_front(&self->crinput);
+            checkpoint = container_of(tselem, struct checkpoint, tselem);
+        }
+
+        /* Provide an escape for if a killswitch message was received. */
+        if (checkpoint->is_kill_message)
+            break;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        crstat_set(CRSTAT_COMMITTING, 1);
+        CRTRACE(CRTRACE_COMMIT, CRTRACE_BEGIN, checkpoint);
+
+        batch[0] = checkpoint;
+        nbatch = 1;
+
+        /* Blocking commits queued behind this one, such as those of threads
+         * checkpointing at once, are written along with it: under one lock
+         * of the metadata, and with one flush of the heap file. Gathering 
+         * stops at any other kind of request, which keeps its place. */
+        if (!checkpoint->is_async && !checkpoint->is_background)
+        {
+            while (nbatch < NVCOMMIT_BATCH)
+            {
+                tselem = vtslist_try_pop_front(&self->crinput);
+                if (tselem == NULL)
+                    break;
+
+                next = container_of(tselem, struct checkpoint, tselem);
+                if (next->is_kill_message || next->is_async 
+                    || next->is_background)
+                    break;
+
+                batch[nbatch++] = next;
+                next = NULL;
+            }
+        }
+
+        for (i = 0; i < nbatch; i++)
+            CRTRACE(CRTRACE_COMMIT_QUEUED, CRTRACE_FLOW_END, batch[i]);
+
+        /* Asynchronous commits write the pages captured upon submission,
+         * background commits are written by a child process, and otherwise,
+         * only the updated pages of the regions are written. */
+        if (checkpoint->is_async)
+            npages = nvstore_commit_captured(checkpoint, pgbuf);
+        else if (checkpoint->is_background)
+            npages = nvstore_commit_background(checkpoint);
+        else
+            npages = nvstore_commit_dirty(batch, nbatch);
+
+        nvstore_record_commit(&start, npages);
+        crstat_record(CRSTAT_COMMIT_BATCH, nbatch);
+        crstat_set(CRSTAT_COMMITTING, 0);
+        CRTRACE(CRTRACE_COMMIT, CRTRACE_END, 0);
+
+        for (i = 0; i < nbatch; i++)
+            checkpoint_post_commit_finished(batch[i]);
+    }
+
+    return NULL;
+}
+
+/**
+ * Accounts for a commit which started at [start] and wrote [npages] pages. The
+ * checkpoint worker is the only writer of the commit statistics, so readers 
+ * only ever observe individual fields being updated.
+ */
+static void nvstore_record_commit(const struct timespec *start, size_t npages)
+{
+    struct timespec end;
+    uint64_t elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start->tv_sec) * 1000000000ull 
+            + (end.tv_nsec - start->tv_nsec);
+
+    /* smooth the per page cost over roughly the last [NVSTATS_EWMA] commits */
+    if (npages != 0)
+    {
+        if (self->stats.ns_per_page == 0)
+            self->stats.ns_per_page = elapsed / npages;
+        else
+            self->stats.ns_per_page += ((int64_t)(elapsed / npages) 
+                                     - (int64_t)self->stats.ns_per_page) 
+                                     / NVSTATS_EWMA;
+    }
+
+    self->stats.commit_ns += elapsed;
+    self->stats.pages_committed += npages;
+    self->stats.last_commit_ns = end.tv_sec * 1000000000ull + end.tv_nsec;
+    self->stats.commits++;
+
+    crstat_add(CRSTAT_COMMITS, 1);
+    crstat_add(CRSTAT_BYTES_WRITTEN, npages * sysconf(_SC_PAGE_SIZE));
+    crstat_record(CRSTAT_COMMIT_NS, elapsed);
+    crstat_record(CRSTAT_COMMIT_BYTES, npages * sysconf(_SC_PAGE_SIZE));
+    crstat_set(CRSTAT_DIRTY_PAGES, vtsdirtyset_size(self->dirty));
+}
+
+/** Orders page addresses for [qsort()]. */
+static int __nvstore_addrcmp(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t)*(void *const *)a;
+    uintptr_t y = (uintptr_t)*(void *const *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Punches the pages a commit found released out of the file. Runs of 
+ * consecutive pages are punched at once, since a single page image only 
+ * covers whole filesystem blocks when it happens to be aligned to them. Where
+ * holes cannot be punched, zeroes are written instead.
+ */
+static void nvstore_punch_released()
+{
+    struct vblock *block;
+    uint8_t *run, *next, *blockend;
+    size_t i, j, k;
+
+    qsort(self->released->addrs, self->released->len, 
+          sizeof(*self->released->addrs), __nvstore_addrcmp);
+
+    for (i = 0; i < self->released->len; i = j)
+    {
+        run = self->released->addrs[i];
+        block = vtsaddrtable_find(self->table, run);
+        blockend = (uint8_t *)block->pgstart 
+                 + block->npages * sysconf(_SC_PAGE_SIZE);
+
+        for (j = i + 1; j < self->released->len; j++)
+        {
+            next = run + (j - i) * sysconf(_SC_PAGE_SIZE);
+            if (self->released->addrs[j] != next || next >= blockend)
+                break;
+        }
+
+        if (vblock_punchpages(block, self->nvfs, run, j - i))
+            crstat_add(CRSTAT_PAGES_RELEASED, j - i);
+        else
+            for (k = i; k < j; k++)
+                vblock_writepage(block, self->nvfs, self->released->addrs[k],
+                                 self->tmppage);
+    }
+
+    vaddrlist_clear(self->released);
+}
+
+/**
+ * Locks nvfs and checkpoints only the updated pages of the regions of every
+ * checkpoint in the batch. A page shared by several of them is written once.
+ * 
+ * With write-protection available, each page is write-protected as it leaves
+ * the dirty set, so that only a later write marks it dirty again. Without it,
+ * the page is dropped and copied back in, which faults it straight back into
+ * the dirty set.
+ */
+static size_t nvstore_commit_dirty(struct checkpoint **batch, size_t nbatch)
+{
+    size_t i, npages;
+
+    npages = 0;
+    nvmetadata_lock(self->meta);
+
+    for (i = 0; i < nbatch; i++)
+        npages += nvstore_commit_regions(batch[i]);
+
+    nvstore_punch_released();
+    fflush(self->nvfs);
+    nvmetadata_unlock(self->meta);
+    return npages;
+}
+
+/** Writes the dirty pages of the regions of one checkpoint, under the lock. */
+static size_t nvstore_commit_regions(struct checkpoint *checkpoint)
+{
+    struct vblock *block;
+    size_t i, npages;
+    void *addr;
+    bool zero;
+
+    npages = 0;
+
+    for (i = 0; i < checkpoint->addrs->len; i++)
+    {
+        pthread_mutex_lock(&self->wplock);
+
+        addr = vtsdirtyset_remove(self->dirty, checkpoint->addrs->addrs[i]);
+        block = addr != NULL ? vtsaddrtable_find(self->table, addr) : NULL;
+        zero = block != NULL 
+            && (block->pgflags[vblock_pgindex(block, addr)] & VBLOCK_PG_ZERO);
+
+        if (addr != NULL && self->wpsupported)
+            nvstore_writeprotect(addr, true);
+
+        pthread_mutex_unlock(&self->wplock);
+
+        if (addr != NULL)
+        {
+            throttle_acquire(&self->throttle, sysconf(_SC_PAGE_SIZE));
+
+            /* released pages are dropped from the file rather than written */
+            if (zero)
+                vaddrlist_insert(self->released, addr);
+            else if (self->wpsupported)
+                vblock_writepage(block, self->nvfs, addr, addr);
+            else
+                vblock_dumpbypage(block, self->nvfs, addr);
+
+            npages++;
+        }
+    }
+
+    return npages;
+}
+
+/**
+ * Captures the dirty pages of an asynchronous checkpoint on the submitting 
+ * thread, so that the image committed is the one at the time of submission.
+ * 
+ * With write-protection available, each captured page is removed from the 
+ * dirty set and write-protected. A later write faults into 
+ * [nvstore_handle_wpfault()], which preserves the captured contents if they
+ * have not been copied yet and marks the page dirty again. Without it, the
+ * pages are copied right away and conservatively left in the dirty set.
+ */
+static void nvstore_capture_checkpoint(struct checkpoint *checkpoint)
+{
+    struct vblock *block;
+    size_t i, pgidx;
+    void *addr;
+
+    vaddrlist_clear(checkpoint->captured);
+
+    for (i = 0; i < checkpoint->addrs->len; i++)
+    {
+        addr = checkpoint->addrs->addrs[i];
+
+        pthread_mutex_lock(&self->wplock);
+
+        if (self->wpsupported ? vtsdirtyset_remove(self->dirty, addr) == NULL
+                              : !vtsdirtyset_contains(self->dirty, addr))
+        {
+            pthread_mutex_unlock(&self->wplock);
+            continue;
+        }
+
+        block = vtsaddrtable_find(self->table, addr);
+        pgidx = vblock_pgindex(block, addr);
+
+        block->pgflags[pgidx] |= VBLOCK_PG_INFLIGHT;
+
+        if (self->wpsupported)
+            nvstore_writeprotect(addr, true);
+        else if (block->pgshadow[pgidx] == NULL)
+        {
+            block->pgshadow[pgidx] = mcmalloc(sysconf(_SC_PAGE_SIZE));
+            memcpy(block->pgshadow[pgidx], addr, sysconf(_SC_PAGE_SIZE));
+        }
+
+        pthread_mutex_unlock(&self->wplock);
+
+        vaddrlist_insert(checkpoint->captured, addr);
+    }
+}
+
+/**
+ * Captures every dirty page for a background checkpoint, without a cost per
+ * page to the submitting thread beyond moving it out of the dirty set. Each 
+ * block is write-protected with a single request instead: clean pages are 
+ * write-protected already, so this only affects the dirty ones. As for 
+ * asynchronous commits, a write to a captured page before the checkpoint 
+ * worker forks preserves the captured contents in [nvstore_handle_wpfault()],
+ * and marks the page dirty again.
+ * 
+ * Only used with write-protection available. Without it, pages cannot be 
+ * captured without copying them, and [nvstore_capture_checkpoint()] does so.
+ */
+static void nvstore_capture_everything(struct checkpoint *checkpoint)
+{
+    struct list_elem *elem;
+    struct vblock *block;
+    void *addr;
+
+    vaddrlist_clear(checkpoint->captured);
+
+    pthread_mutex_lock(&self->wplock);
+    pthread_mutex_lock(&self->blocks.lock);
+
+    for (elem = list_begin(&self->blocks.list); 
+         elem != list_end(&self->blocks.list); 
+         elem = list_next(elem))
+    {
+        block = container_of(elem, struct vblock, tselem.elem);
+        nvstore_writeprotect_block(block);
+    }
+
+    pthread_mutex_unlock(&self->blocks.lock);
+
+    while ((addr = vtsdirtyset_remove_any(self->dirty)) != NULL)
+    {
+        block = vtsaddrtable_find(self->table, addr);
+        block->pgflags[vblock_pgindex(block, addr)] |= VBLOCK_PG_INFLIGHT;
+        vaddrlist_insert(checkpoint->captured, addr);
+    }
+
+    pthread_mutex_unlock(&self->wplock);
+}
+
+/**
+ * Writes every page captured by [nvstore_capture_checkpoint()]. Each page is
+ * first copied into [pgbuf] under the capture lock - from its shadow copy if a
+ * writer got to it first, or from the still write-protected page otherwise.
+ * Pages released since, and not written to, are punched out of the file 
+ * instead. The file write itself happens outside of the lock.
+ */
+static size_t nvstore_commit_captured(struct checkpoint *checkpoint, 
+                                      void *pgbuf)
+{
+    struct vblock *block;
+    size_t i, pgidx;
+    void *addr;
+    bool zero;
+
+    nvmetadata_lock(self->meta);
+
+    for (i = 0; i < checkpoint->captured->len; i++)
+    {
+        addr = checkpoint->captured->addrs[i];
+        block = vtsaddrtable_find(self->table, addr);
+        pgidx = vblock_pgindex(block, addr);
+
+        throttle_acquire(&self->throttle, sysconf(_SC_PAGE_SIZE));
+
+        pthread_mutex_lock(&self->wplock);
+
+        zero = false;
+        if (block->pgshadow[pgidx] != NULL)
+        {
+            memcpy(pgbuf, block->pgshadow[pgidx], sysconf(_SC_PAGE_SIZE));
+            mcfree(block->pgshadow[pgidx]);
+            block->pgshadow[pgidx] = NULL;
+        }
+        else if ((block->pgflags[pgidx] & VBLOCK_PG_ZERO) != 0)
+            zero = true;
+        else
+            memcpy(pgbuf, addr, sysconf(_SC_PAGE_SIZE));
+
+        block->pgflags[pgidx] &= ~VBLOCK_PG_INFLIGHT;
+
+        pthread_mutex_unlock(&self->wplock);
+
+        if (zero)
+            vaddrlist_insert(self->released, addr);
+        else
+            vblock_writepage(block, self->nvfs, addr, pgbuf);
+    }
+
+    nvstore_punch_released();
+    fflush(self->nvfs);
+    nvmetadata_unlock(self->meta);
+
+    return checkpoint->captured->len;
+}
+
+/**
+ * Body of the child process forked by [nvstore_commit_background()]. The child
+ * shares no locks with its parent, so it only issues raw system calls against
+ * the heap file: the captured contents of each page, [sources], are written at
+ * the offsets resolved before the fork, synced, and the metadata write lock is
+ * released last. The exit 
+ * status tells the parent whether the epoch is durable. The child keeps 
+ * charging its own copy of the throttle, and inherits the I/O priority of the
+ * checkpoint worker.
+ * 
+ * The child dies along with its [parent]: a crash must not leave an orphan 
+ * writing to the heap file while the next incarnation restores from it.
+ */
+static void nvstore_bgsave_child(const void **sources, off_t *offsets, 
+                                 size_t npages, off_t lockoffset, 
+                                 pid_t parent)
+{
+    uint32_t writelock = 1;
+    size_t pgsize, i;
+    uint64_t start;
+    int fd;
+
+    if (prctl(PR_SET_PDEATHSIG, SIGKILL) == -1 || getppid() != parent)
+        _exit(EXIT_FAILURE);
+
+    fd = fileno(self->nvfs);
+    pgsize = sysconf(_SC_PAGE_SIZE);
+
+    for (i = 0; i < npages; i++)
+    {
+        throttle_acquire(&self->throttle, pgsize);
+
+        if (pwrite(fd, sources[i], pgsize, offsets[i]) != (ssize_t)pgsize)
+            _exit(EXIT_FAILURE);
+    }
+
+    start = crstat_now_ns();
+    if (fsync(fd) == -1)
+        _exit(EXIT_FAILURE);
+
+    crstat_record(CRSTAT_FSYNC_NS, crstat_now_ns() - start);
+
+    if (pwrite(fd, &writelock, sizeof(writelock), lockoffset) 
+        != sizeof(writelock))
+        _exit(EXIT_FAILURE);
+
+    if (fsync(fd) == -1)
+        _exit(EXIT_FAILURE);
+
+    _exit(EXIT_SUCCESS);
+}
+
+/**
+ * Commits the pages captured by [nvstore_capture_everything()] from a forked 
+ * child while this process keeps running, relying on the kernel's copy-on-
+ * write to freeze the child's view of the heap. Only the checkpoint worker 
+ * blocks until the child exits, which keeps background epochs ordered against
+ * every other commit.
+ * 
+ * The fork happens under the capture lock, after choosing for every page 
+ * either its shadow copy or the still write-protected page itself, so the 
+ * child sees exactly the image captured upon submission. The child does not 
+ * inherit the userfaultfd registration, and it only reads pages which were 
+ * present at the time of the fork. Once forked, the child owns its copy and 
+ * the captured pages are released right away. If the child fails, every 
+ * captured page is marked dirty again.
+ * 
+ * Returns the number of pages handed over to the child.
+ */
+static size_t nvstore_commit_background(struct checkpoint *checkpoint)
+{
+    struct vblock *block, *metablock;
+    const void **sources;
+    off_t *offsets;
+    size_t i, pgidx, npages;
+    pid_t child, parent;
+    void *addr;
+    int status;
+
+    npages = checkpoint->captured->len;
+    parent = getpid();
+
+    /* mark the file as under modification before the child starts writing */
+    nvmetadata_lock(self->meta);
+    metablock = vtsaddrtable_find(self->table, self->meta);
+
+    /* resolve file offsets up front - the child must not touch our tables */
+    offsets = mcmalloc((npages + 1) * sizeof(*offsets));
+    sources = mcmalloc((npages + 1) * sizeof(*sources));
+
+    for (i = 0; i < npages; i++)
+    {
+        addr = checkpoint->captured->addrs[i];
+        block = vtsaddrtable_find(self->table, addr);
+        offsets[i] = vblock_pgoffset(block, addr);
+    }
+
+    /* nothing buffered may be flushed twice, once by each process */
+    fflush(self->nvfs);
+
+    pthread_mutex_lock(&self->wplock);
 
-    /* specify the new page to swap back in to finish the pagefault */
-    uffdio_copy.src = (uintptr_t)self->tmppage;
-    uffdio_copy.dst = (uintptr_t)pgstart;
+    for (i = 0; i < npages; i++)
+    {
+        addr = checkpoint->captured->addrs[i];
+        block = vtsaddrtable_find(self->table, addr);
+        pgidx = vblock_pgindex(block, addr);
 
-    uffdio_copy.len = sysconf(_SC_PAGE_SIZE);
-    uffdio_copy.mode = 0;
-    uffdio_copy.copy = 0;
+        sources[i] = block->pgshadow[pgidx] != NULL ? block->pgshadow[pgidx] 
+                                                    : addr;
+    }
 
-    /* finally, copy the new page in - this unblocks the offending thread */
-    assert(ioctl(self->uffd, UFFDIO_COPY, &uffdio_copy) != -1);
-}
+    child = fork();
+    if (child == 0)
+        nvstore_bgsave_child(sources, offsets, npages, 
+                             metablock->offset_pgstart, parent);
 
-/**
- * The worker thread function which services pagefaults. The input argument is
- * not used. Polls for events from two file descriptors - one is the uffd itself
- * and the other is a killfd which signifies when this worker routine is to be
- * killed.
- *
- * Does not return anything meaningful.
- */
-static void *nvstore_tf_uffdworker(__attribute__((unused))void *arg)
-{
-    struct pollfd pollfds[2]; /* 0: uffd, 1: killfd */
-    int nready;
+    for (i = 0; i < npages; i++)
+    {
+        addr = checkpoint->captured->addrs[i];
+        block = vtsaddrtable_find(self->table, addr);
+        pgidx = vblock_pgindex(block, addr);
 
-    pollfds[0].fd = self->uffd;
-    pollfds[0].events = POLLIN;
+        block->pgflags[pgidx] &= ~VBLOCK_PG_INFLIGHT;
+        mcfree(block->pgshadow[pgidx]);
+        block->pgshadow[pgidx] = NULL;
+    }
 
-    pollfds[1].fd = self->killfd;
-    pollfds[1].events = POLLIN;
+    pthread_mutex_unlock(&self->wplock);
 
-    for (;;)
-    {
-        nready = poll(pollfds, 2, -1);
-        assert(nready != -1);
+    status = -1;
+    if (child != -1)
+        while (waitpid(child, &status, 0) == -1)
+            assert(errno == EINTR);
 
-        if ((pollfds[0].revents & POLLIN) != 0)
-            nvstore_handle_pagefault();
+    checkpoint->failed = !WIFEXITED(status) 
+                      || WEXITSTATUS(status) != EXIT_SUCCESS;
 
-        if ((pollfds[1].revents & POLLIN) != 0)
-            break;
+    if (checkpoint->failed)
+    {
+        for (i = 0; i < npages; i++)
+            vtsdirtyset_insert(self->dirty, checkpoint->captured->addrs[i]);
+
+        nvmetadata_unlock(self->meta);
     }
+    else
+        self->meta->writelock = 1;
 
-    return NULL;
+    mcfree(sources);
+    mcfree(offsets);
+    return npages;
 }
 
 /**
- * The worker thread function which services address region checkpoint requests.
- * The input argument is not used. This function continuously polls for new 
- * lists of addresses to checkpoint, checkpoints them, and then notifies the 
- * sender that it is complete with its job.
- * 
- * Does not return anything meaningful.
+ * Reserves the range of address space a relocatable heap is mapped in: at 
+ * [base] if it is free, or anywhere else the kernel sees fit.
  */
-static void *nvstore_tf_crworker(__attribute__((unused))void *arg)
+static int nvstore_initregion(void *base)
 {
-    struct vtslist_elem *tselem;
-    struct checkpoint *checkpoint;
-    struct vblock *block;
-
-    size_t i;
-    void *addr;
+    uint8_t *start, *aligned;
 
-    for (;;)
+    start = MAP_FAILED;
+    if (base != NULL)
     {
-        tselem = vtslist_pop_front(&self->crinput);
-        checkpoint = container_of(tselem, struct checkpoint, tselem);
-
-        /* Provide an escape for if a killswitch message was received. */
-        if (checkpoint->is_kill_message)
-            break;
+        start = mmap(base, NVREGION_SIZE, PROT_NONE, 
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE 
+                     | MAP_FIXED_NOREPLACE, -1, 0);
 
-        /* Otherwise, lock nvfs and checkpoint only the updated regions.*/
-        nvmetadata_lock(self->meta);
-        for (i = 0; i < checkpoint->addrs->len; i++)
+        /* kernels without MAP_FIXED_NOREPLACE take the address as a hint */
+        if (start != MAP_FAILED && start != base)
         {
-            addr = vtsdirtyset_remove(self->dirty, checkpoint->addrs->addrs[i]);
-            if (addr != NULL)
-            {
-                block = vtsaddrtable_find(self->table, addr);
-                vblock_dumpbypage(block, self->nvfs, addr);
-            }
+            munmap(start, NVREGION_SIZE);
+            start = MAP_FAILED;
         }
+    }
 
-        nvmetadata_unlock(self->meta);
-        checkpoint_post_commit_finished(checkpoint);
+    if (start == MAP_FAILED)
+    {
+        start = mmap(NULL, NVREGION_SIZE + NVREGION_ALIGN, PROT_NONE, 
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+        if (start == MAP_FAILED)
+            return E_MMAP;
+
+        /* trim the mapping down to an aligned range */
+        aligned = (uint8_t *)(((uintptr_t)start + NVREGION_ALIGN - 1) 
+                              & ~(NVREGION_ALIGN - 1));
+        if (aligned > start)
+            munmap(start, aligned - start);
+        if (start + NVREGION_ALIGN > aligned)
+            munmap(aligned + NVREGION_SIZE, start + NVREGION_ALIGN - aligned);
+
+        start = aligned;
     }
 
-    return NULL;
+    self->region = self->cursor = start;
+    return 0;
 }
 
 /**
@@ -354,7 +1271,7 @@ static int nvstore_initmmap()
 static int nvstore_inituffdworker()
 {
     struct uffdio_api api;
-    int rc;
+    int rc, probe;
 
     /* initialization of the killswitch for when the fault handler is closed */
     self->killfd = eventfd(0, EFD_SEMAPHORE);
@@ -362,6 +1279,25 @@ static int nvstore_inituffdworker()
     if (self->killfd == -1)
         return E_KSWOPEN;
 
+    /* probe for write-protect support - the API handshake can only be done
+     * once per userfaultfd, so the probe uses a throwaway descriptor */
+    self->wpsupported = false;
+    probe = syscall(__NR_userfaultfd, O_CLOEXEC);
+
+    if (probe == -1)
+        return E_UFFDOPEN;
+
+    api.api = UFFD_API;
+    api.features = 0;
+
+    if (ioctl(probe, UFFDIO_API, &api) != -1)
+        self->wpsupported = (api.features & UFFD_FEATURE_PAGEFAULT_FLAG_WP) != 0;
+
+    close(probe);
+    pthread_mutex_init(&self->wplock, NULL);
+    pthread_mutex_init(&self->alloclock, NULL);
+    list_init(&self->reservations);
+
     /* initialization of the userfaultfd itself */
     self->uffd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
 
@@ -369,7 +1305,7 @@ static int nvstore_inituffdworker()
         return E_UFFDOPEN;
 
     api.api = UFFD_API;
-    api.features = 0;
+    api.features = self->wpsupported ? UFFD_FEATURE_PAGEFAULT_FLAG_WP : 0;
 
     if (ioctl(self->uffd, UFFDIO_API, &api) == -1)
         return E_IOCTL;
@@ -382,13 +1318,27 @@ static int nvstore_inituffdworker()
     return 0;
 }
 
-/** Initializes the worker thread which handles checkpoint commit requests. */
+/**
+ * Initializes the worker thread which handles checkpoint commit requests, and
+ * waits for it to publish its thread id so its I/O priority can be set.
+ */
 static int nvstore_initcrworker()
 {
+    sem_t started;
     int rc;
 
     vtslist_init(&self->crinput);
-    rc = pthread_create(&self->crworker, NULL, nvstore_tf_crworker, NULL);
+    throttle_init(&self->throttle);
+    self->released = vaddrlist_new(NVADDRLIST_INIT_POWER);
+    sem_init(&started, 0, 0);
+
+    rc = pthread_create(&self->crworker, NULL, nvstore_tf_crworker, &started);
+
+    if (rc == 0)
+        while (sem_wait(&started) == -1)
+            assert(errno == EINTR);
+
+    sem_destroy(&started);
 
     if (rc != 0)
         return E_PTHREAD;
@@ -403,6 +1353,9 @@ static int nvstore_initcrworker()
 static void nvstore_initmeta()
 {
     struct vblock *metablock;
+    uint64_t start;
+
+    start = crstat_now_ns();
 
     /* first, set the filesize to 0 and attempt to fetch the metadata */
     self->filesize = 0;
@@ -415,6 +1368,7 @@ static void nvstore_initmeta()
         self->meta = metablock->pgstart;
 
         self->meta->execstate = NV_FIRSTRUN;
+        self->meta->epoch = 0;
 
         /* upon first init, we initialize the lists and the writelock as well */
         nvmetadata_unlock(self->meta);
@@ -431,13 +1385,23 @@ static void nvstore_initmeta()
             self->meta->execstate = NV_RESURRECTED;
 
         while (nvstore_fetchnvfs() != NULL);
+
+        crstat_add(CRSTAT_HEAP_RESTORES, 1);
+        crstat_record(CRSTAT_RESTORE_NS, crstat_now_ns() - start);
     }
 
+    /* a relocatable heap remembers where it is mapped, to tell if it moved */
+    self->relocated = self->region != NULL && self->meta->region != NULL 
+                   && self->meta->region != self->region;
+    if (self->region != NULL)
+        self->meta->region = self->region;
+
     fflush(self->nvfs);
 
     /* use volatile locks for system resources - reinitialize on every boot */
     pthread_mutex_init(&self->meta->threadlock, NULL);
     pthread_mutex_init(&self->meta->mutexlock, NULL);
+    mm_restore(&self->meta->mm);
 };
 
 /**
@@ -449,8 +1413,8 @@ static void nvstore_initmeta()
 static struct vblock *nvstore_fetchnvfs()
 {
     struct vblock *block;
-    size_t nread, npages;
-    void *tmp, *addr;
+    size_t nread, npages, i;
+    void *tmp, *addr, *pg;
 
     fseek(self->nvfs, self->filesize, SEEK_SET);
     nread = fread(&addr, 1, sizeof(addr), self->nvfs);
@@ -458,32 +1422,67 @@ static struct vblock *nvstore_fetchnvfs()
     if (nread != sizeof(addr) || addr == NULL)
         return NULL;
 
+    /* blocks of a relocatable heap go wherever its range is mapped now */
+    if (((uintptr_t)addr & NVRECORD_RELATIVE) != 0)
+    {
+        if (self->region == NULL && nvstore_initregion(NULL) != 0)
+            return NULL;
+
+        addr = self->region + ((uintptr_t)addr & ~NVRECORD_RELATIVE);
+    }
+
     fseek(self->nvfs, self->filesize + sizeof(addr), SEEK_SET);
     nread = fread(&npages, 1, sizeof(npages), self->nvfs);
 
     if (nread != sizeof(npages) || npages == 0)
         return NULL;
 
-    tmp = alloca(npages * sysconf(_SC_PAGE_SIZE));
+    /* blocks of large objects may not fit on the stack */
+    tmp = mcmalloc(npages * sysconf(_SC_PAGE_SIZE));
 
     fseek(self->nvfs, self->filesize + sizeof(addr) + sizeof(npages), SEEK_SET);
     nread = fread(tmp, 1, npages * sysconf(_SC_PAGE_SIZE), self->nvfs);
 
     if (nread != npages * sysconf(_SC_PAGE_SIZE))
+    {
+        mcfree(tmp);
         return NULL;
+    }
 
     block = __nvstore_allocpage(npages, addr);
-    memcpy(block->pgstart, tmp, npages * sysconf(_SC_PAGE_SIZE));
+
+    /* pages of zeroes are left unmapped, to be read from the zero page */
+    for (i = 0; i < npages; i++)
+    {
+        pg = (uint8_t *)tmp + i * sysconf(_SC_PAGE_SIZE);
+
+        if (memcmp(pg, self->tmppage, sysconf(_SC_PAGE_SIZE)) == 0)
+            block->pgflags[i] |= VBLOCK_PG_ZERO;
+        else
+        {
+            memcpy((uint8_t *)block->pgstart + i * sysconf(_SC_PAGE_SIZE), pg,
+                   sysconf(_SC_PAGE_SIZE));
+            self->stats.pages_restored++;
+        }
+    }
+
+    mcfree(tmp);
     return block;
 }
 
-/******************************************************************************/
-/** Public-Facing API: nvstore ---------------------------------------------- */
-/******************************************************************************/
-int nvstore_init(const char *filename)
+/** Initialization shared by pinned and relocatable heaps. */
+static int __nvstore_init(const char *filename)
 {
+    struct timespec now;
     int rc;
 
+    crstat_init();
+
+    /* statistics start out as if a commit had just finished */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    memset(&self->stats, 0, sizeof(self->stats));
+    self->stats.last_commit_ns = now.tv_sec * 1000000000ull + now.tv_nsec;
+
     rc = nvstore_initnvfs(filename);
     if (rc != 0)
         return rc;
@@ -504,16 +1503,229 @@ int nvstore_init(const char *filename)
     return 0;
 }
 
+/******************************************************************************/
+/** Public-Facing API: nvstore ---------------------------------------------- */
+/******************************************************************************/
+int nvstore_init(const char *filename)
+{
+    self->region = NULL;
+    return __nvstore_init(filename);
+}
+
+int nvstore_init_relocatable(const char *filename, void *base)
+{
+    int rc;
+
+    rc = nvstore_initregion(base);
+    if (rc != 0)
+        return rc;
+
+    return __nvstore_init(filename);
+}
+
+void *nvstore_base()
+{
+    return self->region;
+}
+
+bool nvstore_relocated()
+{
+    return self->relocated;
+}
+
 void *nvstore_allocpage(size_t npages)
 {
     struct vblock *block;
 
+    /* allocators on several threads may grow the heap at once */
+    pthread_mutex_lock(&self->alloclock);
     block = __nvstore_allocpage(npages, NULL);
-    return block->pgstart;
+    pthread_mutex_unlock(&self->alloclock);
+    return block == NULL ? NULL : block->pgstart;
+}
+
+void *nvstore_allocpage_reserved(size_t npages, size_t nreserve)
+{
+    struct vblock *block;
+    void *start;
+
+    pthread_mutex_lock(&self->alloclock);
+
+    /* hold the whole range - out of the range of a relocatable heap, or else 
+     * with an inaccessible mapping - then map the block over its front */
+    if (self->region != NULL)
+        start = __nvstore_bump(npages + nreserve);
+    else
+    {
+        start = mmap(NULL, (npages + nreserve) * sysconf(_SC_PAGE_SIZE), 
+                     PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, 
+                     -1, 0);
+
+        if (start == MAP_FAILED)
+            start = NULL;
+    }
+
+    if (start == NULL)
+        block = __nvstore_allocpage(npages, NULL);
+    else
+    {
+        block = vblock_new_fixed(start, npages, self->filesize, true);
+        __nvstore_addblock(block, true);
+        __nvstore_addreservation(block->pgstart 
+                                 + npages * sysconf(_SC_PAGE_SIZE), nreserve);
+    }
+
+    pthread_mutex_unlock(&self->alloclock);
+    return block == NULL ? NULL : block->pgstart;
+}
+
+bool nvstore_reserve(void *start, size_t npages)
+{
+    uint8_t *end;
+    void *addr;
+
+    pthread_mutex_lock(&self->alloclock);
+
+    /* the range of a relocatable heap is held already */
+    if (self->region != NULL)
+    {
+        addr = MAP_FAILED;
+        if (__nvstore_isfree(start, npages))
+        {
+            addr = start;
+
+            end = (uint8_t *)start + npages * sysconf(_SC_PAGE_SIZE);
+            if (end > self->cursor)
+                self->cursor = end;
+        }
+    }
+    else
+    {
+        addr = mmap(start, npages * sysconf(_SC_PAGE_SIZE), PROT_NONE, 
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE 
+                    | MAP_FIXED_NOREPLACE, -1, 0);
+
+        /* kernels without MAP_FIXED_NOREPLACE take the address as a hint */
+        if (addr != MAP_FAILED && addr != start)
+        {
+            munmap(addr, npages * sysconf(_SC_PAGE_SIZE));
+            addr = MAP_FAILED;
+        }
+    }
+
+    if (addr != MAP_FAILED)
+        __nvstore_addreservation(start, npages);
+
+    pthread_mutex_unlock(&self->alloclock);
+    return addr != MAP_FAILED;
+}
+
+bool nvstore_contains(void *addr)
+{
+    return vtsaddrtable_find(self->table, addr) != NULL;
+}
+
+bool nvstore_iszero(void *addr)
+{
+    struct vblock *block;
+
+    block = vtsaddrtable_find(self->table, addr);
+    return block != NULL 
+        && (block->pgflags[vblock_pgindex(block, addr)] & VBLOCK_PG_ZERO) != 0;
+}
+
+void nvstore_release(void *addr, size_t len)
+{
+    struct vblock *block;
+    uint8_t *start, *end, *pg;
+    size_t pgidx;
+
+    start = (uint8_t *)(((uintptr_t)addr + sysconf(_SC_PAGE_SIZE) - 1) 
+                        & ~(sysconf(_SC_PAGE_SIZE) - 1));
+    end = (uint8_t *)(((uintptr_t)addr + len) & ~(sysconf(_SC_PAGE_SIZE) - 1));
+
+    if (start >= end)
+        return;
+
+    /* pages must not be captured between being logged and being dropped */
+    pthread_mutex_lock(&self->wplock);
+
+    for (pg = start; pg < end; pg += sysconf(_SC_PAGE_SIZE))
+    {
+        block = vtsaddrtable_find(self->table, pg);
+        pgidx = vblock_pgindex(block, pg);
+
+        if ((block->pgflags[pgidx] & VBLOCK_PG_ZERO) != 0)
+            continue;
+
+        /* an in-flight commit still has to write what the page held */
+        if ((block->pgflags[pgidx] & VBLOCK_PG_INFLIGHT) != 0 
+            && block->pgshadow[pgidx] == NULL)
+        {
+            block->pgshadow[pgidx] = mcmalloc(sysconf(_SC_PAGE_SIZE));
+            memcpy(block->pgshadow[pgidx], pg, sysconf(_SC_PAGE_SIZE));
+        }
+
+        block->pgflags[pgidx] |= VBLOCK_PG_ZERO;
+        vtsdirtyset_insert(self->dirty, pg);
+    }
+
+    madvise(start, end - start, MADV_DONTNEED);
+    pthread_mutex_unlock(&self->wplock);
+
+    crstat_set(CRSTAT_DIRTY_PAGES, vtsdirtyset_size(self->dirty));
+}
+
+bool nvstore_growpage(void *end, size_t npages)
+{
+    struct nvreservation *reservation = NULL;
+    struct list_elem *elem;
+    struct vblock *block;
+
+    pthread_mutex_lock(&self->alloclock);
+
+    for (elem = list_begin(&self->reservations); 
+         elem != list_end(&self->reservations); elem = list_next(elem))
+    {
+        reservation = list_entry(elem, struct nvreservation, elem);
+        if (reservation->start == end)
+            break;
+
+        reservation = NULL;
+    }
+
+    /* outside of a reservation, only pages nobody has mapped will do - which
+     * in the range of a relocatable heap, held as a whole, is checked here */
+    block = NULL;
+    if (reservation != NULL ? reservation->npages >= npages 
+        : self->region == NULL || __nvstore_isfree(end, npages))
+        block = vblock_new_fixed(end, npages, self->filesize, 
+                                 reservation != NULL || self->region != NULL);
+
+    if (block != NULL)
+    {
+        __nvstore_addblock(block, true);
+
+        if (reservation != NULL)
+        {
+            reservation->start += npages * sysconf(_SC_PAGE_SIZE);
+            reservation->npages -= npages;
+
+            if (reservation->npages == 0)
+            {
+                list_remove(&reservation->elem);
+                mcfree(reservation);
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&self->alloclock);
+    return block != NULL;
 }
 
 int nvstore_shutdown()
 {
+    struct nvreservation *reservation;
     struct checkpoint *checkpoint_killer;
     struct vtslist_elem *tselem;
     struct vblock *block;
@@ -531,6 +1743,7 @@ int nvstore_shutdown()
     pthread_join(self->crworker, NULL);
 
     checkpoint_delete(checkpoint_killer);
+    vaddrlist_delete(self->released);
 
     vtsdirtyset_delete(self->dirty);
     vtsaddrtable_delete(self->table);
@@ -547,39 +1760,123 @@ int nvstore_shutdown()
         vblock_delete(block);
     }
 
+    while (!list_empty(&self->reservations))
+    {
+        reservation = list_entry(list_pop_front(&self->reservations), 
+                                 struct nvreservation, elem);
+        if (self->region == NULL)
+            munmap(reservation->start, 
+                   reservation->npages * sysconf(_SC_PAGE_SIZE));
+        mcfree(reservation);
+    }
+
+    if (self->region != NULL)
+        munmap(self->region, NVREGION_SIZE);
+    self->region = NULL;
+    self->relocated = false;
+
     if (fclose(self->nvfs) != 0)
         return E_NVFS;
     if (close(self->uffd) == -1)
         return E_CLOSE;
     if (close(self->killfd) == -1)
         return E_CLOSE;
+
+    pthread_mutex_destroy(&self->wplock);
+    pthread_mutex_destroy(&self->alloclock);
     
     return 0;
 }
 
 void nvstore_checkpoint_everything()
 {
+    struct checkpoint *checkpoint;
+    struct vtsdirtyset *dirtycopy;
     void *addr;
-    struct vblock *block;
 
-    struct vtsdirtyset *dirtycopy;
-    
+    /* commit through the checkpoint worker so that the file is never written
+     * by two threads, or by a background child and this process, at once */
+    checkpoint = checkpoint_new();
     dirtycopy = vtsdirtyset_copy(self->dirty);
 
-    nvmetadata_lock(self->meta);
-
     while ((addr = vtsdirtyset_remove_any(dirtycopy)) != NULL)
+        vaddrlist_insert(checkpoint->addrs, addr);
+
+    vtsdirtyset_delete(dirtycopy);
+
+    checkpoint_commit(checkpoint);
+    checkpoint_delete(checkpoint);
+}
+
+void nvstore_get_stats(struct nvstats *stats)
+{
+    *stats = self->stats;
+    stats->dirty_pages = vtsdirtyset_size(self->dirty);
+}
+
+void nvstore_set_io_limits(size_t bytes_per_sec, size_t iops)
+{
+    throttle_set_limits(&self->throttle, bytes_per_sec, iops);
+}
+
+int nvstore_set_io_priority(enum nvioclass ioclass, int level)
+{
+    int ioprio;
+
+    if (level < 0 || level >= IOPRIO_NR_LEVELS)
+        return E_IOPRIO;
+
+    switch (ioclass)
     {
-        block = vtsaddrtable_find(self->table, addr);
-        vblock_dumpbypage(block, self->nvfs, addr);
+        case NVIO_CLASS_NONE:   ioprio = IOPRIO_CLASS_NONE; level = 0;  break;
+        case NVIO_CLASS_BE:     ioprio = IOPRIO_CLASS_BE;               break;
+        case NVIO_CLASS_IDLE:   ioprio = IOPRIO_CLASS_IDLE; level = 0;  break;
+        default:                return E_IOPRIO;
     }
 
-    nvmetadata_unlock(self->meta);
+    ioprio = IOPRIO_PRIO_VALUE(ioprio, level);
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, self->crworkertid, ioprio) 
+        == -1)
+        return E_IOPRIO;
 
-    vtsdirtyset_delete(dirtycopy);
+    return 0;
+}
+
+struct checkpoint *nvstore_checkpoint_everything_background()
+{
+    struct checkpoint *checkpoint;
+    struct vtsdirtyset *dirtycopy;
+    void *addr;
+
+    checkpoint = checkpoint_new();
+    checkpoint->is_background = true;
+    checkpoint->inflight = true;
+
+    /* without write-protection, each dirty page is captured by copying it */
+    if (!self->wpsupported)
+    {
+        dirtycopy = vtsdirtyset_copy(self->dirty);
+
+        while ((addr = vtsdirtyset_remove_any(dirtycopy)) != NULL)
+            vaddrlist_insert(checkpoint->addrs, addr);
+
+        vtsdirtyset_delete(dirtycopy);
+    }
+
+    /* the snapshot is captured right here, like an asynchronous commit */
+    nvstore_submit_checkpoint(checkpoint);
+    return checkpoint;
 }
 
 void nvstore_submit_checkpoint(struct checkpoint *checkpoint)
 {
+    if (checkpoint->is_background && self->wpsupported)
+        nvstore_capture_everything(checkpoint);
+    else if (checkpoint->is_async || checkpoint->is_background)
+        nvstore_capture_checkpoint(checkpoint);
+
+    if (!checkpoint->is_kill_message)
+        CRTRACE(CRTRACE_COMMIT_QUEUED, CRTRACE_FLOW_START, checkpoint);
+
     vtslist_push_back(&self->crinput, &checkpoint->tselem);
 }
\ No newline at end of file
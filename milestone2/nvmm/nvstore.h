@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "list.h"
 #include "crmalloc.h"
@@ -17,9 +18,34 @@
 #define E_PTHREAD       45
 #define E_WRITE         46
 #define E_CLOSE         47
+#define E_IOPRIO        48
 
 enum nvexecstate { NV_FIRSTRUN, NV_RESURRECTED, NV_COMPLETED };
 
+/** number of commits the per page commit cost is smoothed over */
+#define NVSTATS_EWMA    8
+
+/**
+ * Measurements of the checkpoint engine, taken since [nvstore_init()]. Times 
+ * are in nanoseconds and timestamps are on the CLOCK_MONOTONIC clock.
+ */
+struct nvstats
+{
+    volatile uint64_t commits;              /* commits finished so far        */
+    volatile uint64_t pages_committed;      /* pages written by those commits */
+    volatile uint64_t commit_ns;            /* time spent committing          */
+    volatile uint64_t ns_per_page;          /* moving average of commit cost  */
+    volatile uint64_t last_commit_ns;       /* when the last commit finished  */
+
+    volatile uint64_t pages_dirtied;        /* faults which dirtied a page    */
+    volatile uint64_t dirty_pages;          /* pages currently dirty          */
+
+    volatile uint64_t pages_restored;       /* non-zero pages read at restore */
+};
+
+/** I/O scheduling classes available to the checkpoint worker */
+enum nvioclass { NVIO_CLASS_NONE, NVIO_CLASS_BE, NVIO_CLASS_IDLE };
+
 /**
  * Metadata stored in non-volatile storage. You can assume that members in this
  * struct are coherent between shutdown and restarts, meaning you should NOT 
@@ -53,6 +79,9 @@ struct nvmetadata
 
     pthread_mutex_t mutexlock;      /* lock for mutex handles container       */
     struct list mutexlist;          /* list of mutex handles                  */
+
+    void *region;                   /* where a relocatable heap was mapped    */
+    uint64_t epoch;                 /* last checkpoint of every crthread      */
 };
 
 /** Used to manually control the write lock for the metadata */
@@ -69,10 +98,113 @@ struct nvmetadata *nvmetadata_instance();
 int nvstore_init(const char *filename);
 int nvstore_shutdown();
 
+/**
+ * Initializes a relocatable heap. Rather than pinning every block to the 
+ * address it was first mapped at, the heap lives in one range of address 
+ * space which is reserved up front - at [base] if it is free, or anywhere 
+ * otherwise - and blocks are recorded in the file by their offset into it. 
+ * Restoring then maps the whole heap wherever the range lands, so restores 
+ * no longer fail on address space taken by something else.
+ *
+ * Pointers stored in the heap have to survive the move: the framework's own 
+ * structures link up with [crptr]s (see crptr.h), which user structures can 
+ * use as well. Threads are not resumed from a heap that moved, as their saved 
+ * contexts hold absolute addresses - see [nvstore_relocated()]. Blocks keep 
+ * the mode they were created in, so a relocatable heap stays relocatable when
+ * restored by [nvstore_init()], and blocks of a pinned one stay pinned.
+ */
+int nvstore_init_relocatable(const char *filename, void *base);
+
+/** Start of the range of a relocatable heap, or NULL for a pinned heap. */
+void *nvstore_base();
+
+/**
+ * Determines whether the heap was restored at another address than it was 
+ * mapped at when last checkpointed. Only relocatable heaps move.
+ */
+bool nvstore_relocated();
+
 void *nvstore_allocpage(size_t npages);
+
+/**
+ * Allocates [npages] pages like [nvstore_allocpage()], followed by [nreserve]
+ * pages of address space which nothing else is mapped into for the rest of 
+ * this boot, so that the allocation can grow in place.
+ */
+void *nvstore_allocpage_reserved(size_t npages, size_t nreserve);
+
+/**
+ * Grows the allocation whose pages end at [end] by [npages] pages mapped right
+ * after it - out of its reservation if it has one, or else out of address 
+ * space nothing is mapped into. The new pages get a block of their own in the
+ * file, so nothing already in the heap is copied or dirtied. Returns false if
+ * the pages after [end] are taken.
+ */
+bool nvstore_growpage(void *end, size_t npages);
+
+/**
+ * Holds back [npages] pages of address space from [start] on, as for the 
+ * reservation of [nvstore_allocpage_reserved()], so that an allocation ending
+ * at [start] can grow in place again after a restart. Returns false if any of
+ * the pages is already mapped.
+ */
+bool nvstore_reserve(void *start, size_t npages);
+
+/** Determines whether [addr] lies in a page of the heap. */
+bool nvstore_contains(void *addr);
+
+/**
+ * Determines whether the heap page containing [addr] is known to hold only 
+ * zeroes, both in memory and in the file. Such a page has not been written 
+ * since it was allocated or restored, so filling it with zeroes is a no-op.
+ */
+bool nvstore_iszero(void *addr);
+
+/**
+ * Gives the whole heap pages within [len] bytes from [addr] back to the OS, 
+ * for a caller which no longer needs their contents. The pages read as zeroes
+ * from then on, and are punched out of the heap file by the next checkpoint 
+ * which covers them.
+ */
+void nvstore_release(void *addr, size_t len);
 void nvstore_checkpoint_everything();
 
-/** Checkpoint only the region specified */
+/**
+ * Checkpoints every dirty page from a forked child process, in the style of a
+ * BGSAVE. The image saved is the heap at the time of the call. With 
+ * write-protection available, capturing it costs one request per block rather
+ * than one per dirty page, and no page is copied unless it is written before
+ * the child is forked. The calling thread does not block - the returned 
+ * checkpoint is a completion handle (see checkpoint.h) which signals once the
+ * child's epoch is durable, and which the caller must delete with 
+ * [checkpoint_delete()].
+ */
+struct checkpoint *nvstore_checkpoint_everything_background();
+
+/**
+ * Caps the rate at which checkpoints are written, so that checkpoint traffic
+ * does not starve the application's own I/O on a shared disk. Both limits are 
+ * token buckets (see throttle.h) charged once per page written, and a limit of
+ * 0 disables it. May be called at any time after [nvstore_init()], including 
+ * while a commit is running.
+ */
+void nvstore_set_io_limits(size_t bytes_per_sec, size_t iops);
+
+/** Takes a snapshot of the checkpoint engine's measurements. */
+void nvstore_get_stats(struct nvstats *stats);
+
+/**
+ * Sets the ioprio_set(2) scheduling class of the checkpoint worker, and with 
+ * it, of the children of background checkpoints. [level] ranges from 0 
+ * (highest) to 7 and only matters for NVIO_CLASS_BE. Returns 0 on success or 
+ * E_IOPRIO if the arguments are invalid or the kernel refused the request.
+ */
+int nvstore_set_io_priority(enum nvioclass ioclass, int level);
+
+/** 
+ * Checkpoint only the region specified. Asynchronous checkpoints have their 
+ * dirty pages captured on the calling thread before this function returns.
+ */
 void nvstore_submit_checkpoint(struct checkpoint *checkpoint);
 
 #endif
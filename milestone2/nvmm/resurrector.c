@@ -3,11 +3,15 @@
 #include "vtsthreadtable.h"
 #include "crheap.h"
 #include "memcheck.h"
+#include "crstat.h"
+#include "crtrace.h"
 
 #include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
 
+#include <unistd.h>
+
 /******************************************************************************/
 /** Macros, Definitions, and Static Variables ------------------------------- */
 /******************************************************************************/
@@ -26,8 +30,9 @@ struct resurrector_msg
 /** Resurrector object context. */
 struct resurrector
 {
-    struct vtslist input;   /* Input queue of messages. */
-    pthread_t resworker;    /* Worker thread handle. */
+    struct vtslist input;   /* Input queue of messages, shared by workers. */
+    pthread_t resworkers[RESURRECTOR_MAX_WORKERS];  /* Worker thread handles. */
+    size_t nworkers;        /* Number of workers in the pool. */
 };
 
 /* Static singleton instance. */
@@ -47,9 +52,14 @@ static void __resurrector_checkpoint(struct crthread *thread);
 static void __resurrector_checkpoint(struct crthread *thread)
 {
     struct checkpoint *checkpoint;
+    uint64_t start;
+
+    start = crstat_now_ns();
 
     /* First, join with the checkpointing thread, which should have exited. */
     pthread_join(thread->ptid, NULL);
+    CRTRACE(CRTRACE_THREAD_EXIT, CRTRACE_INSTANT, thread);
+    CRTRACE(CRTRACE_THREAD_RESTORE, CRTRACE_BEGIN, thread);
 
     /* Remove the thread from the thread table (PTID is about to change). */
     assert(vtsthreadtable_remove(thread->ptid) == thread);
@@ -61,6 +71,10 @@ static void __resurrector_checkpoint(struct crthread *thread)
     /* Finally, simply restore the thread. This should implicitly restore the
      * transient members we destroyed. */
     crthread_restore(thread, false);
+    CRTRACE(CRTRACE_THREAD_RESTORE, CRTRACE_END, 0);
+
+    crstat_add(CRSTAT_THREAD_CHECKPOINTS, 1);
+    crstat_record(CRSTAT_THREAD_CHECKPOINT_NS, crstat_now_ns() - start);
 }
 
 static void *resurrector_taskfunc(__attribute__((unused))void *arg)
@@ -69,6 +83,8 @@ static void *resurrector_taskfunc(__attribute__((unused))void *arg)
     struct resurrector_msg *msg;
     bool running = true;
 
+    crtrace_name_thread("resurrector");
+
     while (running)
     {
         vtselem = vtslist_pop_front(&self->input);
@@ -97,21 +113,45 @@ static void *resurrector_taskfunc(__attribute__((unused))void *arg)
 /******************************************************************************/
 /** Public-Facing API ------------------------------------------------------- */
 /******************************************************************************/
+/**
+ * Starts a pool of workers, one per online CPU up to [RESURRECTOR_MAX_WORKERS].
+ * Each checkpoint request is independent of the others, so any worker can 
+ * take the next one off the shared queue. Commits of threads checkpointing at
+ * once then reach the checkpoint worker together, which writes them as one 
+ * batch instead of one at a time.
+ */
 void resurrector_init()
 {
+    long ncpus;
+    size_t i;
+
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    self->nworkers = ncpus > 0 ? (size_t)ncpus : 1;
+    if (self->nworkers > RESURRECTOR_MAX_WORKERS)
+        self->nworkers = RESURRECTOR_MAX_WORKERS;
+
     vtslist_init(&self->input);
-    pthread_create(&self->resworker, NULL, resurrector_taskfunc, NULL);
+    for (i = 0; i < self->nworkers; i++)
+        pthread_create(&self->resworkers[i], NULL, resurrector_taskfunc, NULL);
 }
 
 void resurrector_shutdown()
 {
     struct resurrector_msg *msg;
+    size_t i;
 
-    msg = mcmalloc(sizeof(*msg));
-    msg->cmd = RESURRECTOR_SHUTDOWN;
-    vtslist_push_back(&self->input, &msg->vtselem);
+    /* Each worker exits on the first shutdown message it takes. */
+    for (i = 0; i < self->nworkers; i++)
+    {
+        msg = mcmalloc(sizeof(*msg));
+        msg->cmd = RESURRECTOR_SHUTDOWN;
+        vtslist_push_back(&self->input, &msg->vtselem);
+    }
+
+    for (i = 0; i < self->nworkers; i++)
+        pthread_join(self->resworkers[i], NULL);
 
-    pthread_join(self->resworker, NULL);
     vtslist_cleanup(&self->input);
 }
 
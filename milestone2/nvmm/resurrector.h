@@ -3,6 +3,9 @@
 
 #include "crthread.h"
 
+/* most workers restoring checkpointed threads at once                        */
+#define RESURRECTOR_MAX_WORKERS     16
+
 /** Initializes the resurrection system. */
 void resurrector_init();
 
@@ -0,0 +1,100 @@
+#include "throttle.h"
+
+#include <errno.h>
+#include <time.h>
+
+/******************************************************************************/
+/** Private Implementation: throttle ---------------------------------------- */
+/******************************************************************************/
+
+/** Tops up a single bucket for [elapsed] seconds, up to its burst capacity. */
+static double __throttle_refill(double level, size_t rate, double elapsed)
+{
+    double capacity;
+
+    if (rate == 0)
+        return 0;
+
+    capacity = (double)rate * THROTTLE_BURST_MS / 1000;
+    level += elapsed * rate;
+
+    return level > capacity ? capacity : level;
+}
+
+/** Returns how many seconds [level] stays in debt at [rate]. */
+static double __throttle_debt(double level, size_t rate)
+{
+    if (rate == 0 || level >= 0)
+        return 0;
+
+    return -level / rate;
+}
+
+/******************************************************************************/
+/** Public-Facing API: throttle --------------------------------------------- */
+/******************************************************************************/
+
+/** Initializes an unlimited throttle. */
+void throttle_init(struct throttle *throttle)
+{
+    throttle->bytes_per_sec = 0;
+    throttle->ops_per_sec = 0;
+    throttle->bytes = 0;
+    throttle->ops = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &throttle->last);
+}
+
+/**
+ * Sets new limits for the throttle. Takes effect starting with the next call 
+ * to [throttle_acquire()].
+ */
+void throttle_set_limits(struct throttle *throttle, 
+                         size_t bytes_per_sec, size_t ops_per_sec)
+{
+    throttle->bytes_per_sec = bytes_per_sec;
+    throttle->ops_per_sec = ops_per_sec;
+}
+
+/**
+ * Charges one operation of [nbytes] bytes against the throttle. Buckets are 
+ * allowed to go into debt, so requests larger than the burst capacity still 
+ * go through - the caller simply sleeps until the debt is paid back.
+ */
+void throttle_acquire(struct throttle *throttle, size_t nbytes)
+{
+    struct timespec now, delay;
+    size_t bytes_per_sec, ops_per_sec;
+    double elapsed, wait, opswait;
+
+    bytes_per_sec = throttle->bytes_per_sec;
+    ops_per_sec = throttle->ops_per_sec;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - throttle->last.tv_sec)
+            + (now.tv_nsec - throttle->last.tv_nsec) / 1e9;
+    throttle->last = now;
+
+    throttle->bytes = __throttle_refill(throttle->bytes, bytes_per_sec, 
+                                        elapsed);
+    throttle->ops = __throttle_refill(throttle->ops, ops_per_sec, elapsed);
+
+    if (bytes_per_sec != 0)
+        throttle->bytes -= nbytes;
+    if (ops_per_sec != 0)
+        throttle->ops -= 1;
+
+    wait = __throttle_debt(throttle->bytes, bytes_per_sec);
+    opswait = __throttle_debt(throttle->ops, ops_per_sec);
+    if (opswait > wait)
+        wait = opswait;
+
+    if (wait <= 0)
+        return;
+
+    delay.tv_sec = (time_t)wait;
+    delay.tv_nsec = (long)((wait - delay.tv_sec) * 1e9);
+
+    while (nanosleep(&delay, &delay) == -1 && errno == EINTR)
+        continue;
+}
@@ -0,0 +1,37 @@
+#ifndef __THROTTLE_H__
+#define __THROTTLE_H__
+
+#include <stddef.h>
+#include <time.h>
+
+/** how much unused budget a bucket may bank, in milliseconds of its rate */
+#define THROTTLE_BURST_MS   10
+
+/**
+ * A pair of token buckets which caps the bandwidth and the operation rate of 
+ * the checkpoint engine. Each write first calls [throttle_acquire()], which 
+ * takes one operation and [nbytes] bytes out of the buckets, sleeping until 
+ * both are paid for. A limit of 0 leaves the corresponding bucket unlimited.
+ * 
+ * Limits may be changed at any time from any thread with 
+ * [throttle_set_limits()]. The bucket levels themselves are NOT thread-safe:
+ * a throttle should only be drained by a single thread, which is how the 
+ * checkpoint worker (and the child of a background checkpoint, which inherits
+ * its own copy) uses it.
+ */
+struct throttle
+{
+    volatile size_t bytes_per_sec;  /* bandwidth cap, 0 for unlimited         */
+    volatile size_t ops_per_sec;    /* operation (IOPS) cap, 0 for unlimited  */
+
+    double bytes;                   /* bytes currently available              */
+    double ops;                     /* operations currently available         */
+    struct timespec last;           /* time of the last refill                */
+};
+
+void throttle_init(struct throttle *throttle);
+void throttle_set_limits(struct throttle *throttle, 
+                         size_t bytes_per_sec, size_t ops_per_sec);
+void throttle_acquire(struct throttle *throttle, size_t nbytes);
+
+#endif
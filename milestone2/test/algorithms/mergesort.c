@@ -1,6 +1,7 @@
 #include "mergesort.h"
 #include "crthread.h"
 #include "crheap.h"
+#include "crarena.h"
 
 #include <unistd.h>
 #include <stdio.h>
@@ -12,6 +13,8 @@
 #define MOVEMENT_RIGHT      "C"
 #define MOVEMENT_LEFT       "D"
 
+bool mergesort_animate = false;
+
 static void move_cursor(int ntimes, const char *direction)
 {
     while (ntimes --> 0)
@@ -293,7 +296,7 @@ static void show_merge(int *arr, int mid, int nmerge)
     // usleep(1000000);
 }
 
-void merge(int *arr, int low, int mid, int high)
+void merge_buffered(int *arr, int *scratch, int low, int mid, int high)
 {
     int left_len, right_len;
     int left_it, right_it, merge_it;
@@ -303,8 +306,8 @@ void merge(int *arr, int low, int mid, int high)
     left_len = mid - low + 1;
     right_len = high - mid;
 
-    leftcpy = crmalloc(left_len * sizeof(*leftcpy));
-    rightcpy = crmalloc(right_len * sizeof(*rightcpy));
+    leftcpy = scratch;
+    rightcpy = scratch + left_len;
 
     for (left_it = 0; left_it < left_len; left_it++)
         leftcpy[left_it] = arr[low + left_it];
@@ -328,14 +331,39 @@ void merge(int *arr, int low, int mid, int high)
     
     while (right_it < right_len)
         arr[merge_it++] = rightcpy[right_it++];
+}
+
+void mergesort_buffered(int *arr, int *scratch, int low, int high)
+{
+    int mid;
 
-    show_subarrays(leftcpy, left_len, rightcpy, right_len);
+    if (low >= high)
+        return;
 
-    crfree(leftcpy);
-    crfree(rightcpy);
+    mid = low + ((high - low) / 2);
+
+    mergesort_buffered(arr, scratch, low, mid);
+    mergesort_buffered(arr, scratch, mid + 1, high);
+
+    merge_buffered(arr, scratch, low, mid, high);
 }
 
-void __mergesort(int *arr, int low, int high)
+void merge(int *arr, struct crarena *scratch, int low, int mid, int high)
+{
+    int *buffer, left_len;
+
+    left_len = mid - low + 1;
+    buffer = crarena_alloc(scratch, (high - low + 1) * sizeof(*buffer));
+
+    merge_buffered(arr, buffer, low, mid, high);
+
+    if (mergesort_animate)
+        show_subarrays(buffer, left_len, buffer + left_len, high - mid);
+
+    crarena_reset(scratch);
+}
+
+void __mergesort(int *arr, struct crarena *scratch, int low, int high)
 {
     int mid;
 
@@ -345,22 +373,37 @@ void __mergesort(int *arr, int low, int high)
     
     mid = low + ((high - low) / 2);
 
-    __mergesort(arr, low, mid);
-    __mergesort(arr, mid + 1, high);
+    __mergesort(arr, scratch, low, mid);
+    __mergesort(arr, scratch, mid + 1, high);
 
-    show_mergesort_array(arr, low, high);
-    usleep(1000000);
+    if (mergesort_animate)
+    {
+        show_mergesort_array(arr, low, high);
+        usleep(1000000);
+    }
+
+    merge(arr, scratch, low, mid, high);
 
-    merge(arr, low, mid, high);
-    show_merge(arr, mid, high - low + 1);
+    if (mergesort_animate)
+        show_merge(arr, mid, high - low + 1);
 
     crthread_checkpoint();
 }
 
 void mergesort(int *arr, int len)
 {
+    struct crarena *scratch;
+
     crthread_checkpoint();
-    __mergesort(arr, 0, len - 1);
-    show_mergesort_array(arr, 0, len - 1);
-    usleep(1000000);
-}
\ No newline at end of file
+
+    /* every merge reuses the same few pages for its temporaries */
+    scratch = crarena_new(len * sizeof(*arr));
+    __mergesort(arr, scratch, 0, len - 1);
+    crarena_destroy(scratch);
+
+    if (mergesort_animate)
+    {
+        show_mergesort_array(arr, 0, len - 1);
+        usleep(1000000);
+    }
+}
@@ -1,10 +1,31 @@
 #ifndef __MERGESORT_H__
 #define __MERGESORT_H__
 
+#include <stdbool.h>
+
+#include "crarena.h"
+
 #define MERGESORT_LENGTH    16
 
-void __mergesort(int *arr, int low, int high);
+/**
+ * When set, [mergesort()] draws every merge step to the terminal and pauses
+ * between them. Only the demo turns this on; it makes timings meaningless.
+ */
+extern bool mergesort_animate;
+
+/**
+ * [__mergesort()] and [merge()] take the temporaries of every merge from
+ * [scratch], which is reset after each merge.
+ */
+void __mergesort(int *arr, struct crarena *scratch, int low, int high);
 void mergesort(int *arr, int len);
-void merge(int *arr, int low, int mid, int high);
+void merge(int *arr, struct crarena *scratch, int low, int mid, int high);
+
+/**
+ * Plain variants which neither animate, checkpoint, nor allocate. [scratch]
+ * must hold at least [high - low + 1] elements.
+ */
+void merge_buffered(int *arr, int *scratch, int low, int mid, int high);
+void mergesort_buffered(int *arr, int *scratch, int low, int high);
 
 #endif
\ No newline at end of file
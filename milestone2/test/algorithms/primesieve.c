@@ -0,0 +1,43 @@
+#include "primesieve.h"
+
+void primesieve_init(bool *sieve, size_t limit)
+{
+    size_t i;
+
+    for (i = 0; i < limit; i++)
+        sieve[i] = i >= 2;
+}
+
+void primesieve_mark(bool *sieve, size_t limit, size_t prime)
+{
+    size_t k;
+
+    for (k = prime * prime; k < limit; k += prime)
+        sieve[k] = false;
+}
+
+void primesieve_segment(bool *sieve, size_t lo, size_t hi)
+{
+    size_t i, k;
+
+    /* composites in [lo, hi) have a factor below sqrt(hi), prime or not */
+    for (i = 2; i * i < hi; i++)
+    {
+        k = ((lo + i - 1) / i) * i;
+        if (k < i * i)
+            k = i * i;
+
+        for (; k < hi; k += i)
+            sieve[k] = false;
+    }
+}
+
+size_t primesieve_count(const bool *sieve, size_t limit)
+{
+    size_t i, count = 0;
+
+    for (i = 0; i < limit; i++)
+        count += sieve[i];
+
+    return count;
+}
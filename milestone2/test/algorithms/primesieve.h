@@ -0,0 +1,19 @@
+#ifndef __PRIMESIEVE_H__
+#define __PRIMESIEVE_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Sieve of Eratosthenes over [sieve], an array of [limit] flags which are left
+ * true exactly at the primes. [primesieve_mark()] crosses off the multiples of
+ * one prime, as the demo does between checkpoints, while [primesieve_segment()]
+ * sieves only the flags in [lo, hi) so that disjoint segments may be sieved by
+ * different threads at the same time.
+ */
+void primesieve_init(bool *sieve, size_t limit);
+void primesieve_mark(bool *sieve, size_t limit, size_t prime);
+void primesieve_segment(bool *sieve, size_t lo, size_t hi);
+size_t primesieve_count(const bool *sieve, size_t limit);
+
+#endif
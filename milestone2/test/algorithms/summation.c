@@ -1,11 +1,10 @@
 #include "summation.h"
 #include "crthread.h"
 #include "checkpoint.h"
+#include "crheap.h"
 
 #include <stdio.h>
 
-#define CHECKPOINT_LIMIT    (1 << 17)
-
 void *summation_tf_checkpointed(void *arg_vp)
 {
     struct summation_args *args;
@@ -30,7 +29,7 @@ intptr_t summation_checkpointed(struct summation_args *args)
 {
     struct checkpoint *checkpoint;
 
-    intptr_t result;
+    intptr_t result = 0;
     size_t i;
 
     for (i = 0; i < args->len; i++)
@@ -38,7 +37,7 @@ intptr_t summation_checkpointed(struct summation_args *args)
         result += args->arr[i];
         fprintf(stderr, "result: %ld\n", result);
 
-        if (i % CHECKPOINT_LIMIT == 0)
+        if (crheap_should_checkpoint())
         {
             checkpoint = checkpoint_new();
             checkpoint_add(checkpoint, args, sizeof(*args));
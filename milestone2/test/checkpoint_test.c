@@ -5,6 +5,7 @@
 #include "memcheck.h"
 #include "contextswitch.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -12,9 +13,23 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <limits.h>
+#include <poll.h>
 
 #define TEST_SIZE           20000
 #define THREAD_STACKSIZE    1048576
+#define BALLAST_SIZE        (2 * 1048576)
+
+#define PIN_R12             0x0123456789abcdefULL
+#define PIN_R13             0xfedcba9876543210ULL
+#define PIN_R14             0x5a5a5a5aa5a5a5a5ULL
+#define PIN_R15             0x8000000000000001ULL
+
+/* A context along with the registers found upon its second return */
+struct pinned_context
+{
+    struct crcontext context;
+    uint64_t got[4];
+};
 
 const char *test_checkpoint_basic()
 {
@@ -66,6 +81,78 @@ const char *test_checkpoint_basic()
     return NULL;
 }
 
+/**
+ * Commits a region asynchronously and immediately overwrites it. The image
+ * restored afterwards must be the one captured when the commit was issued, not
+ * the one written while the commit was in flight. A large ballast commit is 
+ * queued first so that the overwrite reliably races the checkpoint worker.
+ */
+const char *test_checkpoint_async()
+{
+    struct checkpoint *checkpoint, *ballast;
+    struct pollfd pollfd;
+    int *data, *refdata, i;
+    char *ballastdata;
+
+    crheap_init("test_checkpoint_async.heap");
+
+    refdata = mcmalloc(sizeof(*refdata) * TEST_SIZE);
+    data = crmalloc(sizeof(*data) * TEST_SIZE);
+    ballastdata = crmalloc(BALLAST_SIZE);
+
+    for (i = 0; i < TEST_SIZE; i++)
+        data[i] = refdata[i] = rand();
+
+    for (i = 0; i < BALLAST_SIZE; i++)
+        ballastdata[i] = (char)i;
+
+    ballast = checkpoint_new();
+    checkpoint_add(ballast, ballastdata, BALLAST_SIZE);
+    checkpoint_commit_async(ballast);
+
+    checkpoint = checkpoint_new();
+    checkpoint_add(checkpoint, data, TEST_SIZE * sizeof(*data));
+    checkpoint_commit_async(checkpoint);
+
+    for (i = 0; i < TEST_SIZE; i++)
+        data[i] = ~refdata[i];
+
+    pollfd.fd = checkpoint_completion_fd(checkpoint);
+    pollfd.events = POLLIN;
+
+    if (poll(&pollfd, 1, -1) != 1)
+        return "Completion descriptor never became readable.";
+
+    if (!checkpoint_wait_timeout(checkpoint, 1000000))
+        return "Commit did not finish after its completion was signalled.";
+
+    if (!checkpoint_test(checkpoint))
+        return "Finished commit was not reported as complete.";
+
+    for (i = 0; i < TEST_SIZE; i++)
+        if (data[i] != ~refdata[i])
+            return "Writes issued during the commit were lost.";
+
+    checkpoint_delete(checkpoint);
+    checkpoint_delete(ballast);
+
+    crheap_shutdown_nosave();
+
+    crheap_init("test_checkpoint_async.heap");
+
+    for (i = 0; i < TEST_SIZE; i++)
+        if (data[i] != refdata[i])
+            return "Restored data is not the image captured upon commit.";
+
+    crfree(ballastdata);
+    crfree(data);
+
+    crheap_shutdown_nosave();
+
+    mcfree(refdata);
+    return NULL;
+}
+
 /******************************************************************************/
 /** Thread Checkpointing Basics --------------------------------------------- */
 /******************************************************************************/
@@ -91,6 +178,8 @@ static void *stack_variables_tf(void *arr_vp)
     for (i = 0; i < TEST_SIZE; i++)
         stackdata[i] = refdata[i];
 
+    /* The frame is read after returning, so its stores must not be elided */
+    __asm__ volatile ("" : : "r" (stackdata) : "memory");
     helper = (volatile uint64_t)&stackdata[0];
     return (void *)helper;
 }
@@ -109,6 +198,103 @@ static void descend_and_execute(
     }
 }
 
+/**
+ * A context must carry the floating-point controls in effect when it was 
+ * saved, here a rounding mode and an x87 precision other than the defaults,
+ * but not the exception flags raised by then.
+ */
+const char *test_checkpoint_context_controls()
+{
+    struct crcontext context;
+    uint32_t mxcsr, setmxcsr, gotmxcsr;
+    uint16_t fpucw, setfpucw, gotfpucw;
+
+    __asm__ volatile ("stmxcsr %0" : "=m" (mxcsr));
+    __asm__ volatile ("fnstcw %0" : "=m" (fpucw));
+
+    setmxcsr = (mxcsr ^ (3 << 13)) | MXCSR_FLAGS;
+    setfpucw = fpucw ^ (1 << 9);
+
+    __asm__ volatile ("ldmxcsr %0" : : "m" (setmxcsr));
+    __asm__ volatile ("fldcw %0" : : "m" (setfpucw));
+
+    if (save_context(&context) == 0)
+    {
+        __asm__ volatile ("ldmxcsr %0" : : "m" (mxcsr));
+        __asm__ volatile ("fldcw %0" : : "m" (fpucw));
+        load_context(&context);
+    }
+
+    __asm__ volatile ("stmxcsr %0" : "=m" (gotmxcsr));
+    __asm__ volatile ("fnstcw %0" : "=m" (gotfpucw));
+
+    __asm__ volatile ("ldmxcsr %0" : : "m" (mxcsr));
+    __asm__ volatile ("fldcw %0" : : "m" (fpucw));
+
+    if ((gotmxcsr & ~MXCSR_FLAGS) != (setmxcsr & ~MXCSR_FLAGS))
+        return "MXCSR was not restored with the context.";
+
+    if ((gotmxcsr & MXCSR_FLAGS) != 0)
+        return "MXCSR exception flags were restored with the context.";
+
+    if (gotfpucw != setfpucw)
+        return "x87 control word was not restored with the context.";
+
+    return NULL;
+}
+
+/**
+ * A context must carry the values held in r12-r15 when it was saved. The
+ * compiler may spill locals around a call which returns twice, so the values
+ * are pinned, scrambled, and read back by hand - on a stack aligned for the
+ * calls and clear of the red zone.
+ */
+const char *test_checkpoint_context_registers()
+{
+    struct pinned_context pinned;
+    void *pinnedp = &pinned;
+
+    __asm__ volatile (
+        "mov %%rsp, %%rbx\n\t"
+        "lea -128(%%rsp), %%rsp\n\t"
+        "and $-16, %%rsp\n\t"
+        "push %%rax\n\t"
+        "push %%rax\n\t"
+        "movabs %[pin12], %%r12\n\t"
+        "movabs %[pin13], %%r13\n\t"
+        "movabs %[pin14], %%r14\n\t"
+        "movabs %[pin15], %%r15\n\t"
+        "mov (%%rsp), %%rdi\n\t"
+        "call save_context\n\t"
+        "test %%eax, %%eax\n\t"
+        "jnz 1f\n\t"
+        "xor %%r12d, %%r12d\n\t"
+        "xor %%r13d, %%r13d\n\t"
+        "xor %%r14d, %%r14d\n\t"
+        "xor %%r15d, %%r15d\n\t"
+        "mov (%%rsp), %%rdi\n\t"
+        "call load_context\n\t"
+        "1:\n\t"
+        "mov (%%rsp), %%rax\n\t"
+        "mov %%r12, %c[got](%%rax)\n\t"
+        "mov %%r13, %c[got]+8(%%rax)\n\t"
+        "mov %%r14, %c[got]+16(%%rax)\n\t"
+        "mov %%r15, %c[got]+24(%%rax)\n\t"
+        "mov %%rbx, %%rsp"
+        : "+a" (pinnedp)
+        : [pin12] "n" (PIN_R12), [pin13] "n" (PIN_R13), 
+          [pin14] "n" (PIN_R14), [pin15] "n" (PIN_R15),
+          [got] "n" (offsetof(struct pinned_context, got))
+        : "rbx", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11", 
+          "r12", "r13", "r14", "r15", "cc", "memory");
+
+    if (pinned.got[0] != PIN_R12 || pinned.got[1] != PIN_R13 
+        || pinned.got[2] != PIN_R14 || pinned.got[3] != PIN_R15)
+        return "Callee-saved registers were not restored with the context.";
+
+    return NULL;
+}
+
 static void *thread_stub_function(void *arr_vp)
 {
     struct crcontext context;
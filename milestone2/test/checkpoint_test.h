@@ -3,5 +3,8 @@
 
 const char *test_checkpoint_basic();
 const char *test_checkpoint_stack_variables();
+const char *test_checkpoint_context_controls();
+const char *test_checkpoint_context_registers();
+const char *test_checkpoint_async();
 
 #endif
\ No newline at end of file
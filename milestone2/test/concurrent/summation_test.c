@@ -29,7 +29,8 @@ struct checkpoint_tester summation_test =
     .test = summation_ct_test,
     .check_answer = summation_ct_check_answer,
     .num_allowed_crashes = CRASH_FOREVER,
-    .crash_length_us = CRASH_INTERVAL
+    .crash_length_us = CRASH_INTERVAL,
+    .crash_schedule = CRASHSCHED_PERIODIC
 };
 
 /******************************************************************************/
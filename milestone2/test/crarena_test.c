@@ -0,0 +1,90 @@
+#include "crarena_test.h"
+#include "crarena.h"
+#include "crheap.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHUNK_SIZE          4096
+#define NUM_OBJECTS         256
+#define LARGE_SIZE          (4 * CHUNK_SIZE)
+
+const char *test_crarena_basic()
+{
+    struct crarena *arena;
+    uint8_t *objects[NUM_OBJECTS], *first, *large;
+    size_t i, size;
+
+    crheap_init("test_crarena_basic.heap");
+    arena = crarena_new(CHUNK_SIZE);
+
+    for (i = 0; i < NUM_OBJECTS; i++)
+    {
+        size = 1 + (i * 13) % 100;
+        objects[i] = crarena_alloc(arena, size);
+
+        if ((uintptr_t)objects[i] % CRARENA_ALIGN != 0)
+            return "Allocation is not aligned.";
+
+        if (i > 0 && objects[i] == objects[i - 1])
+            return "Allocations overlap.";
+
+        memset(objects[i], (int)i, size);
+    }
+
+    for (i = 0; i < NUM_OBJECTS; i++)
+        if (objects[i][0] != (uint8_t)i)
+            return "Allocations overlap.";
+
+    large = crarena_alloc(arena, LARGE_SIZE);
+    memset(large, 0xAB, LARGE_SIZE);
+
+    first = objects[0];
+    crarena_reset(arena);
+
+    if (crarena_alloc(arena, 1) != first)
+        return "Reset did not hand out the first chunk again.";
+
+    crarena_destroy(arena);
+    crheap_shutdown();
+
+    return NULL;
+}
+
+/**
+ * Objects allocated after the last checkpoint are lost with a crash, so the 
+ * restored cursor hands out their memory again, while objects from before the
+ * checkpoint keep both their memory and their contents.
+ */
+const char *test_crarena_restore()
+{
+    struct crarena *arena;
+    uint8_t *kept, *lost;
+
+    unlink("test_crarena_restore.heap");
+    crheap_init("test_crarena_restore.heap");
+
+    arena = crarena_new(CHUNK_SIZE);
+    kept = crarena_alloc(arena, 100);
+    memset(kept, 0x5A, 100);
+
+    crheap_checkpoint_everything();
+
+    lost = crarena_alloc(arena, 100);
+    memset(lost, 0xA5, 100);
+
+    crheap_shutdown_nosave();
+    crheap_init("test_crarena_restore.heap");
+
+    if (kept[0] != 0x5A || kept[99] != 0x5A)
+        return "Object allocated before the checkpoint was lost.";
+
+    if (crarena_alloc(arena, 100) != lost)
+        return "Cursor was not restored to the checkpoint.";
+
+    crarena_destroy(arena);
+    crheap_shutdown();
+
+    return NULL;
+}
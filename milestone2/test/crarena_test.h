@@ -0,0 +1,7 @@
+#ifndef __CRARENA_TEST_H__
+#define __CRARENA_TEST_H__
+
+const char *test_crarena_basic();
+const char *test_crarena_restore();
+
+#endif
@@ -0,0 +1,108 @@
+#include "crashsched_test.h"
+#include "crashsched.h"
+#include "crstat.h"
+#include "nvstore.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define LONG_LENGTH_US      1000000
+#define MEAN_LENGTH_US      1000
+#define NUM_DELAYS          4096
+#define COMMIT_LENGTH_US    10000
+#define COMMIT_NUM_PAGES    1024
+
+const char *test_crashsched_exit()
+{
+    uint64_t start;
+    int status;
+    pid_t child;
+
+    child = fork();
+    if (child == 0)
+        _exit(3);
+
+    start = crstat_now_ns();
+
+    if (crashsched_wait(CRASHSCHED_PERIODIC, LONG_LENGTH_US, child, &status))
+        return "A child which exited on its own was due to be killed.";
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 3)
+        return "Exit status of the child was not reported.";
+
+    if (crstat_now_ns() - start >= LONG_LENGTH_US * 1000ull)
+        return "Waiting did not end as soon as the child exited.";
+
+    return NULL;
+}
+
+const char *test_crashsched_exponential()
+{
+    uint64_t total = 0;
+    size_t i;
+
+    srand48(1);
+
+    for (i = 0; i < NUM_DELAYS; i++)
+        total += crashsched_delay_us(CRASHSCHED_EXPONENTIAL, MEAN_LENGTH_US);
+
+    if (total / NUM_DELAYS < MEAN_LENGTH_US * 9 / 10 
+        || total / NUM_DELAYS > MEAN_LENGTH_US * 11 / 10)
+        return "Mean delay is off from the requested mean.";
+
+    if (crashsched_delay_us(CRASHSCHED_PERIODIC, MEAN_LENGTH_US) 
+        != MEAN_LENGTH_US)
+        return "Periodic delays should be exact.";
+
+    return NULL;
+}
+
+const char *test_crashsched_during_commit()
+{
+    struct crstat_segment *segment;
+    uint8_t *data;
+    int64_t committing;
+    int status, i;
+    pid_t child;
+
+    unlink("test_crashsched_during_commit.heap");
+
+    child = fork();
+    if (child == 0)
+    {
+        nvstore_init("test_crashsched_during_commit.heap");
+        data = nvstore_allocpage(COMMIT_NUM_PAGES);
+
+        for (;;)
+        {
+            for (i = 0; i < COMMIT_NUM_PAGES; i++)
+                data[i * sysconf(_SC_PAGE_SIZE)]++;
+
+            nvstore_checkpoint_everything();
+        }
+    }
+
+    if (!crashsched_wait(CRASHSCHED_DURING_COMMIT, COMMIT_LENGTH_US, child, 
+                         &status))
+        return "Child exited although it commits forever.";
+
+    segment = crstat_attach(child);
+    if (segment == NULL)
+        return "Child did not publish statistics of its own.";
+
+    committing = segment->gauges[CRSTAT_COMMITTING];
+    crstat_detach(segment);
+
+    crashsched_kill(child);
+
+    if (committing != 1)
+        return "Child was not in the middle of a commit.";
+
+    segment = crstat_attach(child);
+    if (segment != NULL)
+        return "Statistics of the killed child were left behind.";
+
+    return NULL;
+}
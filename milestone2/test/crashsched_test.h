@@ -0,0 +1,8 @@
+#ifndef __CRASHSCHED_TEST_H__
+#define __CRASHSCHED_TEST_H__
+
+const char *test_crashsched_exit();
+const char *test_crashsched_exponential();
+const char *test_crashsched_during_commit();
+
+#endif
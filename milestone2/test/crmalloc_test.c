@@ -1,10 +1,59 @@
 #include "crmalloc_test.h"
 #include "crheap.h"
+#include "nvstore.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define NTRIALS 20
+#define NFRAGMENTS 64
+
+#define NHINTED 64
+
+#define LARGE_INITIAL (512 * 1024)
+#define LARGE_FINAL (4 * 1024 * 1024)
+#define LARGE_GROW_DIRTY 8
+
+#define NCHURN 4096
+#define NCHURN_ROUNDS 4
+#define CHURN_SIZE 64
+#define CHURN_DIRTY 4
+
+#define CALLOC_COUNT 4096
+#define CALLOC_SIZE 256
+#define CALLOC_DIRTY 4
+
+#define RELEASE_OBJECT (4 * 1024 * 1024)
+
+#define RELOCATION_NODES 256
+#define RELOCATION_LARGE (1024 * 1024)
+
+#define NTHREADS 4
+#define NTHREAD_OBJECTS 256
+#define NTHREAD_ROUNDS 64
+
+/* Objects of each thread, freed by the next thread over once it is done */
+static char *thread_objects[NTHREADS][NTHREAD_OBJECTS];
+static pthread_barrier_t thread_barrier;
+
+/* Node of the structures a relocated heap has to keep linked up */
+struct relocation_node
+{
+    struct list_elem elem;
+    crptr next;
+    size_t value;
+};
+
+struct relocation_root
+{
+    struct list nodes;
+    crptr stack;
+    crptr large;
+};
 
 /* From a pointer to a payload, get the block */
 static inline struct block *payload_to_block(void *payload) {
@@ -13,6 +62,11 @@ static inline struct block *payload_to_block(void *payload) {
     );
 }
 
+/* Arena holding the block of a payload */
+static inline struct arena *arena_of(void *payload) {
+    return crptr_get(&payload_to_block(payload)->arena);
+}
+
 /* Getter for right tag in block */
 static inline union boundary_tag *block_right_tag(struct block *b) {
     return (union boundary_tag *) (
@@ -313,3 +367,499 @@ const char *test_crmalloc_integration()
 
     return NULL;
 }
+
+/**
+ * Leaves free blocks of one size class pinned between live blocks of another,
+ * which is where a single first-fit list had to walk past every fragment. A
+ * request of the freed class must reuse one of them.
+ */
+const char *test_crmalloc_size_classes()
+{
+    char *small[NFRAGMENTS], *large[NFRAGMENTS], *reused;
+    int i;
+
+    crheap_init("test_crmalloc_size_classes.heap");
+
+    for (i = 0; i < NFRAGMENTS; i++)
+    {
+        small[i] = crmalloc(24);
+        large[i] = crmalloc(1000);
+    }
+
+    for (i = 0; i < NFRAGMENTS - 1; i++)
+        crfree(large[i]);
+
+    reused = crmalloc(1000);
+    for (i = 0; i < NFRAGMENTS - 1; i++)
+        if (reused == large[i])
+            break;
+
+    if (i == NFRAGMENTS - 1)
+        return "A free block of the requested class was not reused.";
+
+    crfree(reused);
+    crfree(large[NFRAGMENTS - 1]);
+    for (i = 0; i < NFRAGMENTS; i++)
+        crfree(small[i]);
+
+    crheap_shutdown();
+    return NULL;
+}
+
+/* Determine if two objects share a page, at either end of either */
+static bool share_page(char *a, size_t a_size, char *b, size_t b_size)
+{
+    uintptr_t a_lo = (uintptr_t)a / PAGESIZE;
+    uintptr_t a_hi = (uintptr_t)(a + a_size - 1) / PAGESIZE;
+    uintptr_t b_lo = (uintptr_t)b / PAGESIZE;
+    uintptr_t b_hi = (uintptr_t)(b + b_size - 1) / PAGESIZE;
+
+    return a_lo <= b_hi && b_lo <= a_hi;
+}
+
+/**
+ * Objects of every pool are allocated in turn, so that without the hints they
+ * would end up side by side. No two pools may share a page, aligned objects
+ * must be aligned, and a pool must survive crrealloc() and a restart.
+ */
+const char *test_crmalloc_hints()
+{
+    static const unsigned hints[] = {0, CR_HOT, CR_COLD, CR_READONLY};
+    static const size_t sizes[] = {24, 8, 200, 100};
+    char *objects[4][NHINTED], *aligned, *hot;
+    size_t i, j, k, l, size;
+
+    crheap_init("test_crmalloc_hints.heap");
+
+    for (i = 0; i < NHINTED; i++)
+        for (j = 0; j < 4; j++)
+        {
+            objects[j][i] = crmalloc_hint(sizes[j], hints[j]);
+            memset(objects[j][i], (int)j, sizes[j]);
+        }
+
+    for (j = 0; j < 4; j++)
+        for (k = j + 1; k < 4; k++)
+            for (i = 0; i < NHINTED; i++)
+                for (l = 0; l < NHINTED; l++)
+                    if (share_page(objects[j][i], sizes[j], objects[k][l],
+                                   sizes[k]))
+                        return "Objects of different pools share a page.";
+
+    for (size = 1; size < 3 * (size_t)PAGESIZE; size = size * 3 + 1)
+    {
+        aligned = crmalloc_hint(size, CR_CACHE_ALIGNED);
+        if ((uintptr_t)aligned % CACHE_LINE_SIZE != 0)
+            return "Object is not aligned on a cache line.";
+        memset(aligned, 0xAB, size);
+
+        hot = crmalloc_hint(size, CR_HOT | CR_PAGE_ALIGNED);
+        if ((uintptr_t)hot % PAGESIZE != 0)
+            return "Object is not aligned on a page.";
+        memset(hot, 0xCD, size);
+
+        crfree(aligned);
+        crfree(hot);
+    }
+
+    hot = crrealloc(objects[1][0], 3000);
+    if (arena_of(hot)->pool != CR_HOT || hot[7] != 1)
+        return "Reallocated object left its pool.";
+    objects[1][0] = hot;
+
+    for (j = 0; j < 4; j++)
+        for (i = 0; i < NHINTED; i++)
+            if (objects[j][i][0] != (char)j)
+                return "Object was overwritten.";
+
+    crheap_shutdown();
+    crheap_init("test_crmalloc_hints.heap");
+
+    hot = crmalloc_hint(3000, CR_HOT);
+    if (arena_of(hot)->pool != CR_HOT)
+        return "Pool was not restored.";
+    if (share_page(hot, 3000, objects[2][0], sizes[2]))
+        return "Objects of different pools share a page.";
+
+    crfree(hot);
+    for (j = 0; j < 4; j++)
+        for (i = 0; i < NHINTED; i++)
+            crfree(objects[j][i]);
+
+    crheap_shutdown();
+    return NULL;
+}
+
+/* Check the byte written at the start of every page of a large object */
+static bool large_intact(char *array, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i += PAGESIZE)
+        if (array[i] != (char)(i / PAGESIZE))
+            return false;
+
+    return true;
+}
+
+/**
+ * A large object is doubled again and again. It must never move, and each 
+ * growth may only dirty the few pages its boundary tags and free list sit on,
+ * not the pages of the object. After a restart, its contents must be back.
+ */
+const char *test_crmalloc_large_realloc()
+{
+    struct nvstats before, after;
+    char *array, *grown;
+    size_t size, i;
+
+    unlink("test_crmalloc_large_realloc.heap");
+    crheap_init("test_crmalloc_large_realloc.heap");
+
+    array = crmalloc(LARGE_INITIAL);
+    for (i = 0; i < LARGE_INITIAL; i += PAGESIZE)
+        array[i] = (char)(i / PAGESIZE);
+
+    crheap_checkpoint_everything();
+
+    for (size = LARGE_INITIAL; size < LARGE_FINAL; size *= 2)
+    {
+        nvstore_get_stats(&before);
+        grown = crrealloc(array, 2 * size);
+        nvstore_get_stats(&after);
+
+        if (grown != array)
+            return "Large object was moved.";
+        if (after.pages_dirtied - before.pages_dirtied > LARGE_GROW_DIRTY)
+            return "Growing a large object dirtied its pages.";
+
+        for (i = size; i < 2 * size; i += PAGESIZE)
+            array[i] = (char)(i / PAGESIZE);
+    }
+
+    crheap_shutdown();
+    crheap_init("test_crmalloc_large_realloc.heap");
+
+    if (!large_intact(array, LARGE_FINAL))
+        return "Large object was not restored.";
+
+    /* without its reservation, the object may have to move this time */
+    grown = crrealloc(array, 2 * LARGE_FINAL);
+    if (!large_intact(grown, LARGE_FINAL))
+        return "Large object was not kept by crrealloc().";
+
+    crfree(grown);
+    crheap_shutdown();
+    return NULL;
+}
+
+/**
+ * Small objects are freed and allocated again and again, without being
+ * written to. Only the pages of the allocator's own metadata may be dirtied,
+ * never the pages of the objects.
+ */
+const char *test_crmalloc_churn()
+{
+    static char *objects[NCHURN];
+    struct nvstats before, after;
+    size_t i, round;
+
+    unlink("test_crmalloc_churn.heap");
+    crheap_init("test_crmalloc_churn.heap");
+
+    for (i = 0; i < NCHURN; i++)
+    {
+        objects[i] = crmalloc(CHURN_SIZE);
+        memset(objects[i], 0xAB, CHURN_SIZE);
+    }
+
+    crheap_checkpoint_everything();
+    nvstore_get_stats(&before);
+
+    for (round = 0; round < NCHURN_ROUNDS; round++)
+    {
+        for (i = 0; i < NCHURN; i++)
+            crfree(objects[(i * 7) % NCHURN]);
+        for (i = 0; i < NCHURN; i++)
+            objects[i] = crmalloc(CHURN_SIZE);
+    }
+
+    nvstore_get_stats(&after);
+    if (after.pages_dirtied - before.pages_dirtied > CHURN_DIRTY)
+        return "Allocation churn dirtied the pages of the objects.";
+
+    for (i = 0; i < NCHURN; i++)
+        crfree(objects[i]);
+
+    crheap_shutdown();
+    return NULL;
+}
+
+const char *test_crcalloc()
+{
+    struct nvstats before, after;
+    char *big, *small;
+    size_t i;
+
+    unlink("test_crcalloc.heap");
+    crheap_init("test_crcalloc.heap");
+
+    nvstore_get_stats(&before);
+    big = crcalloc(CALLOC_COUNT, CALLOC_SIZE);
+    nvstore_get_stats(&after);
+
+    for (i = 0; i < CALLOC_COUNT * CALLOC_SIZE; i++)
+        if (big[i] != 0)
+            return "Fresh pages were not zeroed.";
+
+    if (after.pages_dirtied - before.pages_dirtied > CALLOC_DIRTY)
+        return "Zeroing fresh pages dirtied them.";
+
+    /* memory which was written before has to be zeroed for real */
+    memset(big, 0xAB, CALLOC_COUNT * CALLOC_SIZE);
+    crfree(big);
+    big = crcalloc(CALLOC_COUNT, CALLOC_SIZE);
+
+    for (i = 0; i < CALLOC_COUNT * CALLOC_SIZE; i++)
+        if (big[i] != 0)
+            return "Reused pages were not zeroed.";
+
+    small = crmalloc(CALLOC_SIZE);
+    memset(small, 0xAB, CALLOC_SIZE);
+    crfree(small);
+    small = crcalloc(1, CALLOC_SIZE);
+
+    for (i = 0; i < CALLOC_SIZE; i++)
+        if (small[i] != 0)
+            return "Reused small object was not zeroed.";
+
+    if (crcalloc(SIZE_MAX / 2, 4) != NULL)
+        return "Overflowing request was not refused.";
+
+    crfree(small);
+    crfree(big);
+
+    crheap_shutdown();
+    return NULL;
+}
+
+/* Number of resident pages among the whole pages of [len] bytes from [ptr] */
+static size_t resident_pages(char *ptr, size_t len)
+{
+    static unsigned char vec[RELEASE_OBJECT / 4096];
+    size_t pgsize = sysconf(_SC_PAGE_SIZE), i, n = 0;
+    char *start = (char *)(((uintptr_t)ptr + pgsize - 1) & ~(pgsize - 1));
+    char *end = (char *)(((uintptr_t)ptr + len) & ~(pgsize - 1));
+
+    if (mincore(start, end - start, vec) != 0)
+        return SIZE_MAX;
+
+    for (i = 0; i < (size_t)(end - start) / pgsize; i++)
+        n += vec[i] & 1;
+
+    return n;
+}
+
+const char *test_crmalloc_release()
+{
+    struct stat before, after;
+    char *object;
+    size_t i;
+
+    unlink("test_crmalloc_release.heap");
+    crheap_init("test_crmalloc_release.heap");
+
+    object = crmalloc(RELEASE_OBJECT);
+    memset(object, 0xAB, RELEASE_OBJECT);
+    crheap_checkpoint_everything();
+    stat("test_crmalloc_release.heap", &before);
+
+    crfree(object);
+    if (resident_pages(object, RELEASE_OBJECT) != 0)
+        return "Freed pages are still resident.";
+
+    crheap_checkpoint_everything();
+    stat("test_crmalloc_release.heap", &after);
+
+    if ((after.st_blocks + RELEASE_OBJECT / 2 / 512) > before.st_blocks)
+        return "Freed pages still take up space in the heap file.";
+
+    /* the released run is reused, and written again, after a restart */
+    object = crmalloc(RELEASE_OBJECT);
+    memset(object, 0xCD, RELEASE_OBJECT);
+    crheap_checkpoint_everything();
+    crheap_shutdown();
+    crheap_init("test_crmalloc_release.heap");
+
+    for (i = 0; i < RELEASE_OBJECT; i++)
+        if (object[i] != (char)0xCD)
+            return "Reused pages were not restored.";
+
+    crfree(object);
+    crheap_shutdown();
+    return NULL;
+}
+
+/**
+ * Builds a list and a stack of nodes - some small enough for slabs, some not -
+ * in a relocatable heap, then restores the heap while its old address is taken
+ * and finds both again from the root's offset.
+ */
+const char *test_crmalloc_relocation()
+{
+    struct relocation_root *root;
+    struct relocation_node *node;
+    struct list_elem *elem;
+    size_t offset, i;
+    void *base, *blocker;
+    char *large;
+
+    unlink("test_crmalloc_relocation.heap");
+    crheap_init_relocatable("test_crmalloc_relocation.heap", NULL);
+
+    root = crmalloc(sizeof(*root));
+    list_init(&root->nodes);
+    root->stack = 0;
+
+    for (i = 0; i < RELOCATION_NODES; i++)
+    {
+        node = crmalloc(sizeof(*node) + (i % 4 == 0 ? 2048 : 0));
+        node->value = i;
+        list_push_back(&root->nodes, &node->elem);
+        crptr_set(&node->next, crptr_get(&root->stack));
+        crptr_set(&root->stack, node);
+    }
+
+    large = crmalloc(RELOCATION_LARGE);
+    memset(large, 0x5A, RELOCATION_LARGE);
+    crptr_set(&root->large, large);
+
+    offset = crheap_offset(root);
+    base = nvstore_base();
+    crheap_checkpoint_everything();
+    crheap_shutdown();
+
+    /* take the old address, so that the heap has to go elsewhere */
+    blocker = mmap(base, PAGESIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS 
+                   | MAP_FIXED_NOREPLACE, -1, 0);
+    if (blocker != base)
+        return "Could not take the address the heap was mapped at.";
+
+    crheap_init_relocatable("test_crmalloc_relocation.heap", base);
+    if (nvstore_base() == base || !nvstore_relocated())
+        return "Heap was restored at the same address.";
+
+    root = crheap_at(offset);
+
+    i = 0;
+    for (elem = list_begin(&root->nodes); elem != list_end(&root->nodes);
+         elem = list_next(elem))
+        if (list_entry(elem, struct relocation_node, elem)->value != i++)
+            return "List was not restored in order.";
+    if (i != RELOCATION_NODES)
+        return "List lost nodes.";
+
+    for (node = crptr_get(&root->stack); node != NULL; 
+         node = crptr_get(&node->next))
+        if (node->value != --i)
+            return "Stack was not restored in order.";
+    if (i != 0)
+        return "Stack lost nodes.";
+
+    /* the allocator keeps working, growing the large object in place */
+    large = crrealloc(crptr_get(&root->large), 4 * RELOCATION_LARGE);
+    if (large != crptr_get(&root->large))
+        return "Large object moved while growing.";
+    for (i = 0; i < RELOCATION_LARGE; i++)
+        if (large[i] != 0x5A)
+            return "Large object was not restored.";
+
+    while (!list_empty(&root->nodes))
+        crfree(list_entry(list_pop_front(&root->nodes), 
+                          struct relocation_node, elem));
+    crfree(large);
+    crfree(root);
+
+    crheap_shutdown();
+    munmap(blocker, PAGESIZE);
+
+    return NULL;
+}
+
+/** Size of the [i]th object a thread allocates in [round] */
+static size_t crmalloc_thread_size(size_t i, int round)
+{
+    return 8 + (i * 37 + round * 11) % ((i % 8 == 0) ? 8192 : 256);
+}
+
+/**
+ * Each thread allocates objects of varying small and large sizes, fills them
+ * with its own byte, and frees them again, so that most of its frees take the
+ * fast path of its own arena. After every round the threads check and free 
+ * each other's objects, which has to go through the remote free queues. A 
+ * thread which finds an overwritten object keeps going to the end, so the 
+ * others are never left waiting at a barrier.
+ */
+static void *crmalloc_thread(void *arg)
+{
+    size_t id = (size_t)arg, neighbour = (id + 1) % NTHREADS, size, i, j;
+    const char *failure = NULL;
+    int round;
+    char *owned;
+
+    for (round = 0; round < NTHREAD_ROUNDS; round++)
+    {
+        for (i = 0; i < NTHREAD_OBJECTS; i++)
+        {
+            size = crmalloc_thread_size(i, round);
+            thread_objects[id][i] = crmalloc(size);
+            memset(thread_objects[id][i], (int)id + 1, size);
+
+            owned = crmalloc(size);
+            memset(owned, 0xFF, size);
+            crfree(owned);
+        }
+
+        pthread_barrier_wait(&thread_barrier);
+
+        for (i = 0; i < NTHREAD_OBJECTS; i++)
+        {
+            owned = thread_objects[neighbour][i];
+            size = crmalloc_thread_size(i, round);
+            for (j = 0; j < size; j++)
+                if (owned[j] != (char)(neighbour + 1))
+                    failure = "Object was overwritten by another thread.";
+
+            crfree(owned);
+        }
+
+        pthread_barrier_wait(&thread_barrier);
+    }
+
+    return (void *)failure;
+}
+
+const char *test_crmalloc_threads()
+{
+    pthread_t threads[NTHREADS];
+    void *message, *failure = NULL;
+    size_t i;
+
+    crheap_init("test_crmalloc_threads.heap");
+    pthread_barrier_init(&thread_barrier, NULL, NTHREADS);
+
+    for (i = 0; i < NTHREADS; i++)
+        pthread_create(&threads[i], NULL, crmalloc_thread, (void *)i);
+
+    for (i = 0; i < NTHREADS; i++)
+    {
+        pthread_join(threads[i], &message);
+        if (message != NULL)
+            failure = message;
+    }
+
+    pthread_barrier_destroy(&thread_barrier);
+    crheap_shutdown();
+
+    return failure;
+}
@@ -5,5 +5,13 @@ const char *test_crmalloc_simple();
 const char *test_crmalloc_complex();
 const char *test_crmalloc_recovery();
 const char *test_crmalloc_integration();
+const char *test_crmalloc_size_classes();
+const char *test_crmalloc_threads();
+const char *test_crmalloc_hints();
+const char *test_crmalloc_large_realloc();
+const char *test_crmalloc_churn();
+const char *test_crcalloc();
+const char *test_crmalloc_release();
+const char *test_crmalloc_relocation();
 
 #endif
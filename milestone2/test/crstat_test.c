@@ -0,0 +1,83 @@
+#include "crstat_test.h"
+#include "crstat.h"
+#include "nvstore.h"
+#include "crmalloc.h"
+
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NUM_PAGES           8
+#define NUM_ALLOCS          32
+
+const char *test_crstat_buckets()
+{
+    if (crstat_bucket(0) != 0)
+        return "Zero is not counted in the first bucket.";
+    if (crstat_bucket(1) != 1)
+        return "One is not counted in the second bucket.";
+    if (crstat_bucket(2) != 2 || crstat_bucket(3) != 2)
+        return "Bucket boundaries are not powers of two.";
+    if (crstat_bucket(1ull << 20) != 21)
+        return "Large values land in the wrong bucket.";
+    if (crstat_bucket(UINT64_MAX) != CRSTAT_NBUCKETS - 1)
+        return "Values beyond the last bucket are not clamped.";
+
+    return NULL;
+}
+
+const char *test_crstat_shared_segment()
+{
+    uint64_t faults, commits, allocs, buckets[CRSTAT_NBUCKETS];
+    struct crstat_segment *segment;
+    void *ptrs[NUM_ALLOCS];
+    uint8_t *data;
+    int i, rc;
+
+    rc = nvstore_init("test_crstat_shared_segment.heap");
+    if (rc != 0)
+        return "Initialization failed.";
+
+    /* read through a second, read-only mapping, the way crstat does */
+    segment = crstat_attach(getpid());
+    if (segment == NULL)
+        return "Could not attach to the published segment.";
+
+    faults = crstat_sum_counter(segment, CRSTAT_FAULTS);
+    commits = crstat_sum_counter(segment, CRSTAT_COMMITS);
+    allocs = crstat_sum_counter(segment, CRSTAT_ALLOCS);
+
+    data = nvstore_allocpage(NUM_PAGES);
+    memset(data, 0x55, NUM_PAGES * sysconf(_SC_PAGE_SIZE));
+
+    /* small objects live in slabs, off the block free lists */
+    for (i = 0; i < NUM_ALLOCS; i++)
+        ptrs[i] = crmalloc(SLAB_MAX_SIZE + i + 1);
+    for (i = 0; i < NUM_ALLOCS; i++)
+        crfree(ptrs[i]);
+
+    nvstore_checkpoint_everything();
+
+    if (crstat_sum_counter(segment, CRSTAT_FAULTS) < faults + NUM_PAGES)
+        return "Faults were not counted.";
+    if (crstat_sum_counter(segment, CRSTAT_COMMITS) != commits + 1)
+        return "Commit was not counted.";
+    if (crstat_sum_counter(segment, CRSTAT_ALLOCS) != allocs + NUM_ALLOCS)
+        return "Allocations were not counted.";
+    if (segment->gauges[CRSTAT_FREELIST_LEN] <= 0)
+        return "Free list length was not published.";
+
+    crstat_sum_histogram(segment, CRSTAT_COMMIT_BYTES, buckets);
+    if (buckets[crstat_bucket(NUM_PAGES * sysconf(_SC_PAGE_SIZE))] == 0 
+        && buckets[crstat_bucket((NUM_PAGES + 1) * sysconf(_SC_PAGE_SIZE))] 
+           == 0)
+        return "Commit size was not recorded.";
+
+    crstat_detach(segment);
+
+    rc = nvstore_shutdown();
+    if (rc != 0)
+        return "Shutdown failed.";
+
+    return NULL;
+}
@@ -0,0 +1,7 @@
+#ifndef __CRSTAT_TEST_H__
+#define __CRSTAT_TEST_H__
+
+const char *test_crstat_buckets();
+const char *test_crstat_shared_segment();
+
+#endif
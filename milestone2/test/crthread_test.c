@@ -3,11 +3,14 @@
 #include "crthread.h"
 #include "fibonacci.h"
 #include "summation.h"
+#include "crstat.h"
 
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -18,6 +21,157 @@
 
 #define NUM_ELEMENTS            (1 << 21)
 
+#define GLOBAL_THREADS          4
+#define GLOBAL_EPOCHS           4
+#define EPOCH_SPIN              10000
+
+#define FIBONACCI_DEPTH_MANY    30
+#define RESURRECT_THREADS       80
+
+#define BURST_THREADS           32
+#define BURST_CHECKPOINTS       8
+
+#define PREEMPT_ITERATIONS      (1 << 26)
+#define PREEMPT_INTERVAL_US     5000
+#define PREEMPT_RESTORE_COUNT   2
+#define PREEMPT_RESTORE_POLLS   2000
+
+#define DEEPFRAME_SIZE          (96 * 1024)
+
+static volatile bool s_global_stop;
+
+/** 
+ * Uses a deep frame without ever checkpointing in it, so that only measuring
+ * the stack itself can find how deep it went.
+ */
+static void *deepframe_tf(void *arg)
+{
+    volatile uint8_t frame[DEEPFRAME_SIZE];
+    size_t i;
+
+    for (i = 0; i < DEEPFRAME_SIZE; i++)
+        frame[i] = (uint8_t)(i + (uintptr_t)arg);
+
+    return (void *)(uintptr_t)frame[DEEPFRAME_SIZE - 1];
+}
+
+/** Spins through safe points until told to stop. */
+static void *global_tf(__attribute__((unused)) void *arg)
+{
+    while (!s_global_stop)
+        crthread_safepoint();
+
+    return NULL;
+}
+
+/** Progress of the threads of an epoch test, kept in the heap */
+struct epoch_progress
+{
+    uint64_t total;
+    uint64_t counts[GLOBAL_THREADS];
+};
+
+static struct epoch_progress *s_epoch_progress;
+
+/** Keeps the counts of an epoch test apart for a while */
+static void epoch_spin()
+{
+    volatile size_t i;
+
+    for (i = 0; i < EPOCH_SPIN; i++);
+}
+
+/**
+ * Counts on its stack and in the heap, both in its own slot and in a total 
+ * shared by every thread, until told to stop. The counts only agree at the 
+ * safe point, which is where threads park, so the counts restored from one
+ * epoch must agree as well - while an image taken of running threads almost
+ * always catches some of them apart. Returns the count kept on its stack.
+ */
+static void *epoch_tf(void *arg)
+{
+    volatile uint64_t count = 0;
+    uintptr_t slot = (uintptr_t)arg;
+
+    while (!s_global_stop)
+    {
+        count++;
+        epoch_spin();
+        s_epoch_progress->counts[slot] = count;
+        epoch_spin();
+        __atomic_fetch_add(&s_epoch_progress->total, 1, __ATOMIC_RELAXED);
+
+        crthread_safepoint();
+    }
+
+    return (void *)(uintptr_t)count;
+}
+
+/** 
+ * Checkpoints itself repeatedly, alongside the other threads of a burst.
+ * Every local is volatile, as only what was saved to the stack survives a 
+ * restart.
+ */
+static void *burst_tf(void *arg)
+{
+    volatile uintptr_t sum = 0;
+    volatile size_t i;
+
+    for (i = 0; i < BURST_CHECKPOINTS; i++)
+    {
+        sum += (uintptr_t)arg;
+        crthread_checkpoint();
+    }
+
+    return (void *)sum;
+}
+
+/** Scrambles a seed for a while, without calls, locks, or safe points. */
+static uint64_t preempt_scramble(uint64_t x)
+{
+    size_t i;
+
+    for (i = 0; i < PREEMPT_ITERATIONS; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+
+    return x;
+}
+
+/** Scrambles its argument in a preemptible region. */
+static void *preempt_tf(void *arg)
+{
+    uint64_t x;
+
+    crthread_preemptible(true);
+    x = preempt_scramble((uintptr_t)arg);
+    crthread_preemptible(false);
+
+    return (void *)(uintptr_t)x;
+}
+
+/** Scrambles its argument, polling for deferred preemptions. */
+static void *safepoint_tf(void *arg)
+{
+    uint64_t x = (uintptr_t)arg;
+    size_t i;
+
+    for (i = 0; i < PREEMPT_ITERATIONS; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+
+        if ((i & 0xfff) == 0)
+            crthread_safepoint();
+    }
+
+    return (void *)(uintptr_t)x;
+}
+
 const char *test_crthread_basic()
 {
     struct crthread *thread;
@@ -88,4 +242,508 @@ const char *test_crthread_restore_graceful()
     }
     
     return NULL;
-}
\ No newline at end of file
+}
+
+const char *test_crthread_stack_usage()
+{
+    struct crthread *thread;
+    size_t stackused, stacksize, pagesize, autosize;
+    uintptr_t result, reference;
+
+    pagesize = sysconf(_SC_PAGE_SIZE);
+    reference = (uint8_t)(DEEPFRAME_SIZE - 1 + 3);
+
+    crheap_init("test_crthread_stack_usage.heap");
+
+    /* A size of 0 is the default size, and never measured. */
+    thread = crthread_new(deepframe_tf, (void *)3, 0);
+    stacksize = thread->stacksize;
+    crthread_delete(thread);
+
+    if (stacksize != DEFAULT_STACKSIZE)
+        return "Stack size of 0 did not give the default size.";
+
+    /* The deep frame is never checkpointed in, but the stack is measured. */
+    thread = crthread_new(deepframe_tf, (void *)3, CRTHREAD_STACK_AUTO);
+    crthread_fork(thread);
+    result = (uintptr_t)crthread_join(thread);
+
+    stackused = thread->stackused;
+    stacksize = thread->stacksize;
+    crthread_delete(thread);
+
+    if (result != reference)
+        return "Thread with a measured stack returned a wrong result.";
+
+    if (stackused < DEEPFRAME_SIZE + PTHREAD_STACK_MIN 
+        || stackused >= stacksize)
+        return "Stack usage was not measured.";
+
+    /* A new thread of the same function is sized from the measured usage. */
+    autosize = (2 * stackused + INTERRUPT_GUARD_SIZE + pagesize - 1) 
+             & ~(pagesize - 1);
+    if (autosize < DEFAULT_STACKSIZE)
+        autosize = DEFAULT_STACKSIZE;
+
+    thread = crthread_new(deepframe_tf, (void *)3, CRTHREAD_STACK_AUTO);
+    stacksize = thread->stacksize;
+    crthread_fork(thread);
+    result = (uintptr_t)crthread_join(thread);
+    crthread_delete(thread);
+
+    crheap_shutdown();
+
+    if (stacksize != autosize)
+        return "Stack was not sized from its measured usage.";
+
+    if (result != reference)
+        return "Thread with an automatically sized stack returned a wrong "
+               "result.";
+    return NULL;
+}
+
+const char *test_crthread_inplace()
+{
+    enum crthread_cpmode modes[] = { CRTHREAD_CP_INPLACE, CRTHREAD_CP_ASYNC };
+    struct crthread *thread;
+    uint64_t restores, checkpoints;
+    intptr_t result, reference;
+    size_t i;
+
+    reference = fibonacci_fast(FIBONACCI_DEPTH_EASY);
+
+    crheap_init("test_crthread_inplace.heap");
+
+    for (i = 0; i < sizeof(modes) / sizeof(*modes); i++)
+    {
+        crthread_set_checkpoint_mode(modes[i]);
+
+        restores = crstat_sum_counter(crstat_self(), CRSTAT_THREAD_RESTORES);
+        checkpoints = crstat_sum_counter(crstat_self(), 
+                                         CRSTAT_THREAD_CHECKPOINTS);
+
+        /* The thread checkpoints before and after running its function. */
+        thread = crthread_new(fibonacci_tf_serial, 
+                              (void *)FIBONACCI_DEPTH_EASY, 0);
+        crthread_fork(thread);
+        result = (intptr_t)crthread_join(thread);
+        crthread_delete(thread);
+
+        if (result != reference)
+            break;
+        if (crstat_sum_counter(crstat_self(), CRSTAT_THREAD_RESTORES) 
+            != restores)
+            break;
+        if (crstat_sum_counter(crstat_self(), CRSTAT_THREAD_CHECKPOINTS) 
+            != checkpoints + 2)
+            break;
+    }
+
+    crthread_set_checkpoint_mode(CRTHREAD_CP_RESTART);
+    crheap_shutdown();
+
+    if (i < sizeof(modes) / sizeof(*modes))
+        return "Thread was not checkpointed in place.";
+    return NULL;
+}
+
+const char *test_crthread_checkpoint_all()
+{
+    struct crthread *threads[GLOBAL_THREADS];
+    struct checkpoint *checkpoint;
+    uint64_t epoch, restored;
+    bool failed, skipped;
+    size_t i;
+
+    crheap_init("test_crthread_checkpoint_all.heap");
+
+    s_global_stop = false;
+    for (i = 0; i < GLOBAL_THREADS; i++)
+    {
+        threads[i] = crthread_new(global_tf, NULL, 0);
+        crthread_fork(threads[i]);
+    }
+
+    /* Each global checkpoint waits for every thread, and bumps the epoch. */
+    epoch = crthread_epoch();
+    skipped = false;
+
+    for (i = 1; i <= GLOBAL_EPOCHS; i++)
+        if (crthread_checkpoint_all() != epoch + i)
+            skipped = true;
+
+    checkpoint = crthread_checkpoint_all_async();
+    checkpoint_wait(checkpoint);
+    failed = checkpoint->failed;
+    checkpoint_delete(checkpoint);
+
+    s_global_stop = true;
+    for (i = 0; i < GLOBAL_THREADS; i++)
+    {
+        crthread_join(threads[i]);
+        crthread_delete(threads[i]);
+    }
+
+    crheap_shutdown();
+
+    /* The epoch counter is restored along with the heap. */
+    crheap_init("test_crthread_checkpoint_all.heap");
+    restored = crthread_epoch();
+    crheap_shutdown();
+
+    if (skipped)
+        return "Global checkpoint did not advance the epoch.";
+    if (failed)
+        return "Non-blocking global checkpoint failed.";
+    if (restored != epoch + GLOBAL_EPOCHS + 1)
+        return "Epoch was not restored with the heap.";
+    return NULL;
+}
+
+/**
+ * Takes global checkpoints while the threads run, then crashes once the last
+ * epoch is durable but long after it, with the threads still running. The 
+ * restored stacks and heap must both be those of the last epoch.
+ */
+const char *test_crthread_checkpoint_all_restore()
+{
+    struct crthread *threads[GLOBAL_THREADS];
+    struct checkpoint *checkpoint;
+    uint64_t counts[GLOBAL_THREADS], total, sum, epoch;
+    int pipefds[2];
+    pid_t child;
+    bool torn;
+    char done;
+    size_t i;
+
+    crheap_init("test_crthread_checkpoint_all_restore.heap");
+
+    s_epoch_progress = crmalloc(sizeof(*s_epoch_progress));
+    memset(s_epoch_progress, 0, sizeof(*s_epoch_progress));
+
+    for (i = 0; i < GLOBAL_THREADS; i++)
+        threads[i] = crthread_new(epoch_tf, (void *)i, 0);
+    crheap_shutdown();
+
+    if (pipe(pipefds) == -1)
+        return "System pipe failed.";
+
+    s_global_stop = false;
+
+    child = fork();
+    if (child == -1)
+        return "System fork failed.";
+
+    if (child == 0)
+    {
+        /* As the child, start every thread from the heap, take the epochs, 
+         * and keep running without committing anything until killed. */
+        crheap_init("test_crthread_checkpoint_all_restore.heap");
+
+        for (i = 0; i < GLOBAL_EPOCHS; i++)
+        {
+            usleep(5000);
+            checkpoint = crthread_checkpoint_all_async();
+            checkpoint_wait(checkpoint);
+            if (checkpoint->failed)
+                _exit(EXIT_FAILURE);
+            checkpoint_delete(checkpoint);
+        }
+
+        done = 1;
+        if (write(pipefds[1], &done, sizeof(done)) != sizeof(done))
+            _exit(EXIT_FAILURE);
+
+        for (;;)
+            pause();
+    }
+
+    close(pipefds[1]);
+    if (read(pipefds[0], &done, sizeof(done)) != sizeof(done))
+        return "Child failed to take the global checkpoints.";
+    close(pipefds[0]);
+
+    usleep(20000);
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+
+    /* Restored threads stop at the safe point they parked at, returning the
+     * count on their stack without touching the heap again. */
+    s_global_stop = true;
+
+    crheap_init("test_crthread_checkpoint_all_restore.heap");
+
+    epoch = crthread_epoch();
+    for (i = 0; i < GLOBAL_THREADS; i++)
+    {
+        counts[i] = (uintptr_t)crthread_join(threads[i]);
+        crthread_delete(threads[i]);
+    }
+
+    torn = false;
+    sum = 0;
+    for (i = 0; i < GLOBAL_THREADS; i++)
+    {
+        if (counts[i] == 0 || counts[i] != s_epoch_progress->counts[i])
+            torn = true;
+        sum += s_epoch_progress->counts[i];
+    }
+    total = s_epoch_progress->total;
+
+    crfree(s_epoch_progress);
+    crheap_shutdown();
+
+    if (epoch != GLOBAL_EPOCHS)
+        return "Restored heap is not the one of the last epoch.";
+    if (torn)
+        return "Restored stack of a thread does not match its heap.";
+    if (sum != total)
+        return "Restored threads come from different epochs.";
+    return NULL;
+}
+
+const char *test_crthread_preemption()
+{
+    enum crthread_cpmode modes[] = { 
+        CRTHREAD_CP_RESTART, CRTHREAD_CP_INPLACE, CRTHREAD_CP_ASYNC 
+    };
+    struct crthread *thread;
+    uint64_t preemptions, checkpoints, result, reference;
+    const char *error = NULL;
+    size_t i;
+
+    reference = preempt_scramble(1);
+
+    crheap_init("test_crthread_preemption.heap");
+    crthread_set_preemption(PREEMPT_INTERVAL_US);
+
+    /* A preemptible thread is checkpointed wherever its timer catches it. */
+    for (i = 0; i < sizeof(modes) / sizeof(*modes) && error == NULL; i++)
+    {
+        crthread_set_checkpoint_mode(modes[i]);
+        preemptions = crstat_sum_counter(crstat_self(), 
+                                         CRSTAT_THREAD_PREEMPTIONS);
+
+        thread = crthread_new(preempt_tf, (void *)1, 0);
+        crthread_fork(thread);
+        result = (uintptr_t)crthread_join(thread);
+        crthread_delete(thread);
+
+        if (result != reference)
+            error = "Preempted thread computed the wrong result.";
+        else if (crstat_sum_counter(crstat_self(), CRSTAT_THREAD_PREEMPTIONS)
+                 == preemptions)
+            error = "Preemptible thread was never preempted.";
+    }
+
+    /* Any other thread is checkpointed at its next safe point instead. */
+    if (error == NULL)
+    {
+        crthread_set_checkpoint_mode(CRTHREAD_CP_RESTART);
+        preemptions = crstat_sum_counter(crstat_self(), 
+                                         CRSTAT_THREAD_PREEMPTIONS);
+        checkpoints = crstat_sum_counter(crstat_self(), 
+                                         CRSTAT_THREAD_CHECKPOINTS);
+
+        thread = crthread_new(safepoint_tf, (void *)1, 0);
+        crthread_fork(thread);
+        result = (uintptr_t)crthread_join(thread);
+        crthread_delete(thread);
+
+        if (result != reference)
+            error = "Deferred preemption computed the wrong result.";
+        else if (crstat_sum_counter(crstat_self(), CRSTAT_THREAD_PREEMPTIONS)
+                 != preemptions)
+            error = "Thread was preempted outside a preemptible region.";
+        else if (crstat_sum_counter(crstat_self(), CRSTAT_THREAD_CHECKPOINTS)
+                 <= checkpoints + 2)
+            error = "Deferred preemption was never taken at a safe point.";
+    }
+
+    crthread_set_preemption(0);
+    crthread_set_checkpoint_mode(CRTHREAD_CP_RESTART);
+    crheap_shutdown();
+
+    return error;
+}
+
+const char *test_crthread_preemption_restore()
+{
+    struct crthread *thread;
+    uint64_t restores, result, reference;
+    int pipefds[2];
+    pid_t child;
+    char done;
+    size_t i;
+
+    reference = preempt_scramble(1);
+
+    crheap_init("test_crthread_preemption_restore.heap");
+    thread = crthread_new(preempt_tf, (void *)1, 0);
+    crheap_shutdown();
+
+    if (pipe(pipefds) == -1)
+        return "System pipe failed.";
+
+    child = fork();
+    if (child == -1)
+        return "System fork failed.";
+
+    if (child == 0)
+    {
+        /* As the child, start the thread from the heap, and let its timer 
+         * checkpoint it where it stands a few times. */
+        crheap_init("test_crthread_preemption_restore.heap");
+        crthread_set_preemption(PREEMPT_INTERVAL_US);
+
+        for (i = 0; i < PREEMPT_RESTORE_POLLS; i++)
+        {
+            if (crstat_sum_counter(crstat_self(), CRSTAT_THREAD_PREEMPTIONS)
+                >= PREEMPT_RESTORE_COUNT)
+                break;
+            usleep(1000);
+        }
+
+        /* Let the last preemptive checkpoint settle, and only report it if
+         * the thread is still running - the last commit is then the one its
+         * timer took, not the one after it returned. */
+        crthread_set_preemption(0);
+        usleep(20000);
+
+        if (i == PREEMPT_RESTORE_POLLS || thread->retval != NULL)
+            _exit(EXIT_FAILURE);
+
+        done = 1;
+        if (write(pipefds[1], &done, sizeof(done)) != sizeof(done))
+            _exit(EXIT_FAILURE);
+
+        for (;;)
+            pause();
+    }
+
+    close(pipefds[1]);
+    if (read(pipefds[0], &done, sizeof(done)) != sizeof(done))
+        return "Thread was not preempted while it ran.";
+    close(pipefds[0]);
+
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+
+    /* The thread is brought back in the middle of its scramble, returning 
+     * from the handler it was preempted in through the frame on its signal 
+     * stack. */
+    restores = crstat_sum_counter(crstat_self(), CRSTAT_THREAD_RESTORES);
+    crheap_init("test_crthread_preemption_restore.heap");
+    restores = crstat_sum_counter(crstat_self(), CRSTAT_THREAD_RESTORES)
+             - restores;
+
+    result = (uintptr_t)crthread_join(thread);
+    crthread_delete(thread);
+
+    crheap_shutdown();
+
+    if (restores == 0)
+        return "Preempted thread was not resurrected.";
+    if (result != reference)
+        return "Restored thread computed the wrong result.";
+    return NULL;
+}
+
+const char *test_crthread_burst()
+{
+    struct crthread *threads[BURST_THREADS];
+    uint64_t checkpoints;
+    bool wrong;
+    size_t i;
+
+    crheap_init("test_crthread_burst.heap");
+
+    checkpoints = crstat_sum_counter(crstat_self(), CRSTAT_THREAD_CHECKPOINTS);
+
+    /* Every thread checkpoints at once, so the resurrector workers and the
+     * checkpoint worker always have several requests queued. */
+    for (i = 0; i < BURST_THREADS; i++)
+    {
+        threads[i] = crthread_new(burst_tf, (void *)(i + 1), 0);
+        crthread_fork(threads[i]);
+    }
+
+    wrong = false;
+    for (i = 0; i < BURST_THREADS; i++)
+    {
+        if ((uintptr_t)crthread_join(threads[i]) 
+            != (i + 1) * BURST_CHECKPOINTS)
+            wrong = true;
+        crthread_delete(threads[i]);
+    }
+
+    checkpoints = crstat_sum_counter(crstat_self(), CRSTAT_THREAD_CHECKPOINTS)
+                - checkpoints;
+
+    crheap_shutdown();
+
+    if (wrong)
+        return "Thread result was not correct.";
+    if (checkpoints != BURST_THREADS * (BURST_CHECKPOINTS + 2))
+        return "Not every thread checkpoint was committed.";
+    return NULL;
+}
+
+const char *test_crthread_resurrect_many()
+{
+    struct crthread *threads[RESURRECT_THREADS];
+    uint64_t restores;
+    pid_t child;
+    intptr_t reference;
+    bool wrong;
+    size_t i;
+
+    reference = fibonacci_fast(FIBONACCI_DEPTH_MANY);
+
+    crheap_init("test_crthread_resurrect_many.heap");
+    for (i = 0; i < RESURRECT_THREADS; i++)
+        threads[i] = crthread_new(fibonacci_tf_serial, 
+                                  (void *)FIBONACCI_DEPTH_MANY, 0);
+    crheap_shutdown();
+
+    child = fork();
+    if (child == -1)
+        return "System fork failed.";
+
+    if (child == 0)
+    {
+        /* As the child, start every thread from the heap, and get killed 
+         * while they run. */
+        crheap_init("test_crthread_resurrect_many.heap");
+
+        for (;;)
+            pause();
+    }
+
+    usleep(50000);
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+
+    /* Every thread, whether it had started, finished, or neither, is brought
+     * back at once, in more than one batch. */
+    restores = crstat_sum_counter(crstat_self(), CRSTAT_THREAD_RESTORES);
+    crheap_init("test_crthread_resurrect_many.heap");
+    restores = crstat_sum_counter(crstat_self(), CRSTAT_THREAD_RESTORES)
+             - restores;
+
+    wrong = false;
+    for (i = 0; i < RESURRECT_THREADS; i++)
+    {
+        if ((intptr_t)crthread_join(threads[i]) != reference)
+            wrong = true;
+        crthread_delete(threads[i]);
+    }
+
+    crheap_shutdown();
+
+    if (restores < RESURRECT_THREADS)
+        return "Not every thread was resurrected.";
+    if (wrong)
+        return "Fibonacci result was not correct.";
+    return NULL;
+}
@@ -4,5 +4,13 @@
 const char *test_crthread_basic();
 const char *test_crthread_restore_graceful();
 const char *test_crthread_long_summation();
+const char *test_crthread_stack_usage();
+const char *test_crthread_inplace();
+const char *test_crthread_checkpoint_all();
+const char *test_crthread_checkpoint_all_restore();
+const char *test_crthread_preemption();
+const char *test_crthread_preemption_restore();
+const char *test_crthread_burst();
+const char *test_crthread_resurrect_many();
 
 #endif
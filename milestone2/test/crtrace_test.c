@@ -0,0 +1,146 @@
+#include "crtrace_test.h"
+#include "crtrace.h"
+#include "nvstore.h"
+#include "memcheck.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define NUM_PAGES           8
+#define TRACE_FILE          "test_crtrace.json"
+
+/** Reads the whole exported trace into a string which must be mcfree()'d. */
+static char *__crtrace_read_export()
+{
+    char *contents;
+    FILE *file;
+    long len;
+
+    file = fopen(TRACE_FILE, "r");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    contents = mcmalloc(len + 1);
+    contents[fread(contents, 1, len, file)] = '\0';
+
+    fclose(file);
+    return contents;
+}
+
+/** Counts the occurrences of [needle] in [haystack]. */
+static size_t __crtrace_count(const char *haystack, const char *needle)
+{
+    size_t count = 0;
+
+    while ((haystack = strstr(haystack, needle)) != NULL)
+    {
+        count++;
+        haystack += strlen(needle);
+    }
+
+    return count;
+}
+
+/** Overflows a fresh thread's ring with instants carrying the thread's tag. */
+static void *__crtrace_tf_overflow(__attribute__((unused))void *arg)
+{
+    size_t i;
+
+    crtrace_name_thread("overflow");
+
+    for (i = 0; i < 2 * CRTRACE_RING_SIZE; i++)
+        CRTRACE(CRTRACE_THREAD_EXIT, CRTRACE_INSTANT, 0xC0FFEE);
+
+    return NULL;
+}
+
+const char *test_crtrace_ring_wraparound()
+{
+    pthread_t thread;
+    char *contents;
+    size_t count;
+
+    crtrace_enable(true);
+    pthread_create(&thread, NULL, __crtrace_tf_overflow, NULL);
+    pthread_join(thread, NULL);
+    crtrace_enable(false);
+
+    if (crtrace_export_chrome(TRACE_FILE) != 0)
+        return "Export failed.";
+
+    contents = __crtrace_read_export();
+    if (contents == NULL)
+        return "Could not read the exported trace.";
+
+    /* the ring may have been handed over to later threads of other tests */
+    count = __crtrace_count(contents, "\"0xc0ffee\"");
+    if (count == 0 || count > CRTRACE_RING_SIZE)
+        return "Ring did not keep only the most recent events.";
+
+    if (__crtrace_count(contents, "\"name\":\"overflow\"") != 1)
+        return "Thread name was not exported.";
+
+    mcfree(contents);
+    unlink(TRACE_FILE);
+    return NULL;
+}
+
+const char *test_crtrace_chrome_export()
+{
+    char *contents;
+    uint8_t *data;
+    int rc;
+
+    crtrace_enable(true);
+
+    rc = nvstore_init("test_crtrace_chrome_export.heap");
+    if (rc != 0)
+        return "Initialization failed.";
+
+    data = nvstore_allocpage(NUM_PAGES);
+    memset(data, 0x55, NUM_PAGES * sysconf(_SC_PAGE_SIZE));
+    nvstore_checkpoint_everything();
+
+    rc = nvstore_shutdown();
+    if (rc != 0)
+        return "Shutdown failed.";
+
+    crtrace_enable(false);
+
+    if (crtrace_export_chrome(TRACE_FILE) != 0)
+        return "Export failed.";
+
+    contents = __crtrace_read_export();
+    if (contents == NULL)
+        return "Could not read the exported trace.";
+
+    if (strncmp(contents, "{\"displayTimeUnit\"", 18) != 0 
+        || strstr(contents, "\n]}\n") == NULL)
+        return "Export is not a trace event JSON object.";
+
+    if (__crtrace_count(contents, "\"name\":\"fault\",\"cat\":\"cr\",\"ph\":\"B\"")
+        < NUM_PAGES)
+        return "Faults were not traced.";
+
+    if (__crtrace_count(contents, "\"name\":\"commit\",\"cat\":\"cr\",\"ph\":\"E\"")
+        == 0)
+        return "Commits were not traced.";
+
+    if (__crtrace_count(contents, "\"ph\":\"s\"") == 0 
+        || __crtrace_count(contents, "\"ph\":\"f\"") == 0)
+        return "Commit queueing was not traced as a flow.";
+
+    if (strstr(contents, "\"name\":\"crworker\"") == NULL)
+        return "Checkpoint worker was not named.";
+
+    mcfree(contents);
+    unlink(TRACE_FILE);
+    return NULL;
+}
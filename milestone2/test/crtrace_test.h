@@ -0,0 +1,7 @@
+#ifndef __CRTRACE_TEST_H__
+#define __CRTRACE_TEST_H__
+
+const char *test_crtrace_ring_wraparound();
+const char *test_crtrace_chrome_export();
+
+#endif
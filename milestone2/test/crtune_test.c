@@ -0,0 +1,69 @@
+#include "crtune_test.h"
+#include "crtune.h"
+#include "nvstore.h"
+
+#include <unistd.h>
+#include <stdint.h>
+#include <math.h>
+
+#define NUM_PAGES           16
+
+const char *test_crtune_daly()
+{
+    double interval;
+
+    /* one second checkpoints at a one hour MTBF land just under Young's 85s */
+    interval = crtune_daly_interval(1, 3600);
+    if (fabs(interval - 84.18) > 0.01)
+        return "Interval does not match Daly's formula.";
+
+    if (interval >= sqrt(2 * 1 * 3600))
+        return "Interval is not below Young's approximation.";
+
+    if (crtune_daly_interval(0, 3600) != 0)
+        return "Free checkpoints should be taken continuously.";
+
+    if (crtune_daly_interval(10, 4) != 4)
+        return "Checkpoints costlier than twice the MTBF should be taken once "
+               "per MTBF.";
+
+    return NULL;
+}
+
+const char *test_crtune_should_checkpoint()
+{
+    uint8_t *data;
+    int i, rc;
+
+    rc = nvstore_init("test_crtune_should_checkpoint.heap");
+    if (rc != 0)
+        return "Initialization failed.";
+
+    data = nvstore_allocpage(NUM_PAGES);
+    for (i = 0; i < NUM_PAGES * sysconf(_SC_PAGE_SIZE); i++)
+        data[i] = (uint8_t)i;
+
+    if (!crtune_should_checkpoint())
+        return "Unmeasured commit cost did not ask for a first checkpoint.";
+
+    nvstore_checkpoint_everything();
+
+    for (i = 0; i < NUM_PAGES * sysconf(_SC_PAGE_SIZE); i++)
+        data[i]++;
+
+    crtune_set_mtbf(1e9);
+    if (crtune_should_checkpoint())
+        return "Asked for a checkpoint long before the optimal interval.";
+
+    crtune_set_mtbf(1e-9);
+    if (!crtune_should_checkpoint())
+        return "Did not ask for a checkpoint past the optimal interval.";
+
+    crtune_set_mtbf(CRTUNE_DEFAULT_MTBF);
+
+    rc = nvstore_shutdown();
+    if (rc != 0)
+        return "Shutdown failed.";
+
+    return NULL;
+}
@@ -0,0 +1,7 @@
+#ifndef __CRTUNE_TEST_H__
+#define __CRTUNE_TEST_H__
+
+const char *test_crtune_daly();
+const char *test_crtune_should_checkpoint();
+
+#endif
@@ -4,6 +4,7 @@
 
 #include "fibonacci.h"
 #include "mergesort.h"
+#include "primesieve.h"
 
 #include <stdio.h>
 #include <stdbool.h>
@@ -15,15 +16,14 @@
 
 static void *demo_primesieve_tf(void *arg)
 {
-    size_t i, j, k;
+    size_t i;
     bool sievearr[SIEVE_LIMIT];
 
     (void)arg;
 
     printf("Started sieve for %d elements.\n", SIEVE_LIMIT);
 
-    for (i = 0; i < SIEVE_LIMIT; i++)
-        sievearr[i] = true;
+    primesieve_init(sievearr, SIEVE_LIMIT);
 
     crthread_checkpoint();
     printf("Prepopulation and checkpointing finished.\n");
@@ -33,15 +33,7 @@ static void *demo_primesieve_tf(void *arg)
         if (!sievearr[i])
             continue;
         
-        for (j = 0; j < SIEVE_LIMIT; j++)
-        {
-            k = (i * i) + (j * i);
-
-            if (k >= SIEVE_LIMIT)
-                break;
-
-            sievearr[k] = false;
-        }
+        primesieve_mark(sievearr, SIEVE_LIMIT, i);
 
         printf("Determined N=%ld is prime, checkpointing...", i);
         crthread_checkpoint();
@@ -131,6 +123,8 @@ void demo_mergesort()
 
     crheap_init(NULL);
 
+    mergesort_animate = true;
+
     printf("Starting mergesort demo...\n");
     if (crheap_get_last_progress() == NV_FIRSTRUN)
     {
@@ -253,4 +253,157 @@ const char *test_nvstore_checkpoint_without_shutdown()
         mcfree(refdatamany[i]);
 
     return NULL;
-}
\ No newline at end of file
+}
+
+const char *test_nvstore_checkpoint_background()
+{
+    struct checkpoint *checkpoint;
+    uint8_t *data;
+    int i, rc;
+
+    rc = nvstore_init("test_nvstore_checkpoint_background.heap");
+    if (rc != 0)
+        return "First initialization failed.";
+
+    data = nvstore_allocpage(LARGE_NUM_PAGES);
+
+    for (i = 0; i < LARGE_NUM_PAGES * sysconf(_SC_PAGE_SIZE); i++)
+        data[i] = 0x55;
+
+    checkpoint = nvstore_checkpoint_everything_background();
+
+    /* writes made while the child runs must not leak into its snapshot */
+    for (i = 0; i < LARGE_NUM_PAGES * sysconf(_SC_PAGE_SIZE); i++)
+        data[i] = 0xAA;
+
+    checkpoint_wait(checkpoint);
+
+    if (checkpoint->failed)
+        return "Background checkpoint failed.";
+
+    checkpoint_delete(checkpoint);
+
+    for (i = 0; i < LARGE_NUM_PAGES * sysconf(_SC_PAGE_SIZE); i++)
+        if (data[i] != 0xAA)
+            return "Contents do not match after background checkpoint.";
+
+    rc = nvstore_shutdown();
+    if (rc != 0)
+        return "First shutdown failed.";
+
+    rc = nvstore_init("test_nvstore_checkpoint_background.heap");
+    if (rc != 0)
+        return "Second initialization failed.";
+
+    for (i = 0; i < LARGE_NUM_PAGES * sysconf(_SC_PAGE_SIZE); i++)
+        if (data[i] != 0x55)
+            return "Contents do not match the background snapshot.";
+
+    rc = nvstore_shutdown();
+    if (rc != 0)
+        return "Second shutdown failed.";
+
+    return NULL;
+}
+
+const char *test_nvstore_io_limits()
+{
+    uint8_t *data;
+    int i, rc;
+
+    rc = nvstore_init("test_nvstore_io_limits.heap");
+    if (rc != 0)
+        return "First initialization failed.";
+
+    if (nvstore_set_io_priority(NVIO_CLASS_IDLE, 0) != 0)
+        return "Could not move checkpoints to the idle I/O class.";
+    if (nvstore_set_io_priority(NVIO_CLASS_BE, 8) != E_IOPRIO)
+        return "Out of range I/O priority level was accepted.";
+
+    nvstore_set_io_limits(LARGE_NUM_PAGES * sysconf(_SC_PAGE_SIZE), 
+                          LARGE_NUM_PAGES);
+
+    data = nvstore_allocpage(LARGE_NUM_PAGES);
+    for (i = 0; i < LARGE_NUM_PAGES * sysconf(_SC_PAGE_SIZE); i++)
+        data[i] = (uint8_t)i;
+
+    nvstore_checkpoint_everything();
+
+    rc = nvstore_shutdown();
+    if (rc != 0)
+        return "First shutdown failed.";
+
+    rc = nvstore_init("test_nvstore_io_limits.heap");
+    if (rc != 0)
+        return "Second initialization failed.";
+
+    for (i = 0; i < LARGE_NUM_PAGES * sysconf(_SC_PAGE_SIZE); i++)
+        if (data[i] != (uint8_t)i)
+            return "Contents do not match after throttled checkpoint.";
+
+    rc = nvstore_shutdown();
+    if (rc != 0)
+        return "Second shutdown failed.";
+
+    return NULL;
+}
+
+const char *test_nvstore_zeropage()
+{
+    struct nvstats before, after;
+    size_t sum;
+    uint8_t *data;
+    int i, rc;
+
+    unlink("test_nvstore_zeropage.heap");
+    rc = nvstore_init("test_nvstore_zeropage.heap");
+    if (rc != 0)
+        return "First initialization failed.";
+
+    data = nvstore_allocpage(LARGE_NUM_PAGES);
+    nvstore_get_stats(&before);
+
+    for (i = 0, sum = 0; i < LARGE_NUM_PAGES * sysconf(_SC_PAGE_SIZE); i++)
+        sum += data[i];
+
+    nvstore_get_stats(&after);
+    if (sum != 0)
+        return "Fresh pages do not read as zeroes.";
+    if (after.pages_dirtied != before.pages_dirtied)
+        return "Reading fresh pages dirtied them.";
+    if (!nvstore_iszero(data + sysconf(_SC_PAGE_SIZE)))
+        return "Read pages are not known to be zero.";
+
+    data[SMALL_NUM_PAGES * sysconf(_SC_PAGE_SIZE)] = 0x55;
+
+    nvstore_get_stats(&after);
+    if (after.pages_dirtied != before.pages_dirtied + 1)
+        return "Writing a zero page did not dirty it.";
+    if (nvstore_iszero(data + SMALL_NUM_PAGES * sysconf(_SC_PAGE_SIZE)))
+        return "Written page is still known to be zero.";
+
+    nvstore_checkpoint_everything();
+
+    rc = nvstore_shutdown();
+    if (rc != 0)
+        return "First shutdown failed.";
+
+    rc = nvstore_init("test_nvstore_zeropage.heap");
+    if (rc != 0)
+        return "Second initialization failed.";
+
+    if (!nvstore_iszero(data) 
+        || nvstore_iszero(data + SMALL_NUM_PAGES * sysconf(_SC_PAGE_SIZE)))
+        return "Restored pages are not known to be zero.";
+
+    for (i = 0; i < LARGE_NUM_PAGES * sysconf(_SC_PAGE_SIZE); i++)
+        if (data[i] != (i == SMALL_NUM_PAGES * sysconf(_SC_PAGE_SIZE) 
+                        ? 0x55 : 0))
+            return "Contents do not match after restoration.";
+
+    rc = nvstore_shutdown();
+    if (rc != 0)
+        return "Second shutdown failed.";
+
+    return NULL;
+}
@@ -7,5 +7,8 @@ const char *test_nvstore_alloc_complex();
 const char *test_nvstore_checkpoint_simple();
 const char *test_nvstore_checkpoint_complex();
 const char *test_nvstore_checkpoint_without_shutdown();
+const char *test_nvstore_checkpoint_background();
+const char *test_nvstore_io_limits();
+const char *test_nvstore_zeropage();
 
 #endif
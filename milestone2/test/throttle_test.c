@@ -0,0 +1,80 @@
+#include "throttle_test.h"
+#include "throttle.h"
+
+#include <stddef.h>
+#include <time.h>
+
+#define NUM_REQUESTS        64
+#define REQUEST_SIZE        4096
+
+/** 64 requests of 4 KiB at 1 MiB/s, or 64 requests at 256 IOPS: 250 ms */
+#define BANDWIDTH_LIMIT     (1 << 20)
+#define IOPS_LIMIT          256
+#define EXPECTED_SECONDS    0.25
+
+/** Charges [NUM_REQUESTS] requests and returns how long it took in seconds. */
+static double __throttle_time_requests(struct throttle *throttle)
+{
+    struct timespec start, end;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < NUM_REQUESTS; i++)
+        throttle_acquire(throttle, REQUEST_SIZE);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+const char *test_throttle_unlimited()
+{
+    struct throttle throttle;
+
+    throttle_init(&throttle);
+
+    if (__throttle_time_requests(&throttle) > EXPECTED_SECONDS / 10)
+        return "Unlimited throttle delayed requests.";
+
+    return NULL;
+}
+
+const char *test_throttle_bandwidth()
+{
+    struct throttle throttle;
+    double elapsed;
+
+    throttle_init(&throttle);
+    throttle_set_limits(&throttle, BANDWIDTH_LIMIT, 0);
+
+    elapsed = __throttle_time_requests(&throttle);
+    if (elapsed < EXPECTED_SECONDS * 0.9)
+        return "Bandwidth limit was exceeded.";
+    if (elapsed > EXPECTED_SECONDS * 2)
+        return "Bandwidth limit was far from saturated.";
+
+    /* lifting the limit at runtime takes effect right away */
+    throttle_set_limits(&throttle, 0, 0);
+    if (__throttle_time_requests(&throttle) > EXPECTED_SECONDS / 10)
+        return "Lifted limit still delayed requests.";
+
+    return NULL;
+}
+
+const char *test_throttle_iops()
+{
+    struct throttle throttle;
+    double elapsed;
+
+    throttle_init(&throttle);
+    throttle_set_limits(&throttle, 0, IOPS_LIMIT);
+
+    elapsed = __throttle_time_requests(&throttle);
+    if (elapsed < EXPECTED_SECONDS * 0.9)
+        return "IOPS limit was exceeded.";
+    if (elapsed > EXPECTED_SECONDS * 2)
+        return "IOPS limit was far from saturated.";
+
+    return NULL;
+}
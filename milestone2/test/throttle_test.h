@@ -0,0 +1,8 @@
+#ifndef __THROTTLE_TEST_H__
+#define __THROTTLE_TEST_H__
+
+const char *test_throttle_unlimited();
+const char *test_throttle_bandwidth();
+const char *test_throttle_iops();
+
+#endif
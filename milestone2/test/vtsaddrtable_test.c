@@ -121,3 +121,31 @@ const char *test_vtsaddrtable_large_entries()
 
     return NULL;
 }
+
+const char *test_vtsaddrtable_large_block()
+{
+    struct vtsaddrtable *table;
+    struct vblock *block, *find;
+    size_t i;
+
+    block = vblock_new(NULL, LARGE_SIZE, 0);
+    table = vtsaddrtable_new(SMALL_POWER);
+
+    vtsaddrtable_insert(table, block);
+
+    if (table->nelem != LARGE_SIZE)
+        return "Expansion counted pages of the block more than once.";
+
+    for (i = 0; i < LARGE_SIZE; i++)
+    {
+        find = vtsaddrtable_find(table, block->pgstart 
+                                        + i * sysconf(_SC_PAGE_SIZE));
+        if (find != block)
+            return "Searching for a page of a large block failed.";
+    }
+
+    vtsaddrtable_delete(table);
+    vblock_delete(block);
+
+    return NULL;
+}
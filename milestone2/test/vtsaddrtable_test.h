@@ -5,5 +5,6 @@ const char *test_vtsaddrtable_init();
 const char *test_vtsaddrtable_basic_insertion();
 const char *test_vtsaddrtable_expansion();
 const char *test_vtsaddrtable_large_entries();
+const char *test_vtsaddrtable_large_block();
 
 #endif 
@@ -1,5 +1,6 @@
 #include "contextswitch.h"
 #include <stdio.h>
+#include <string.h>
 
 void display_context(struct crcontext *volatile context)
 {
@@ -18,4 +19,22 @@ void display_context(struct crcontext *volatile context)
            context->rbp, *(uint64_t *)context->rbp);
 
     printf("    return address [*(rbp + 8)]: 0x%lx\n", returnaddr);
-}
\ No newline at end of file
+}
+
+void make_context(volatile struct crcontext *context, 
+                  void (*func) (volatile struct crcontext *), void *stacktop)
+{
+    uintptr_t top = (uintptr_t)stacktop;
+
+    memset((void *)context, 0, sizeof(*context));
+
+    /* Enter [func] as if called: the stack is 16-byte aligned before the
+     * call pushes its return address, which [func] never uses. */
+    context->addr = (uintptr_t)func;
+    context->rsp = (top & ~(uintptr_t)0xf) - sizeof(void *);
+    context->rdi = (uintptr_t)context;
+
+    __asm__ volatile ("stmxcsr %0" : "=m" (context->mxcsr));
+    __asm__ volatile ("fnstcw %0" : "=m" (context->fpucw));
+    context->mxcsr &= ~MXCSR_FLAGS;
+}
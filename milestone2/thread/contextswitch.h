@@ -3,6 +3,22 @@
 
 #include <stdint.h>
 
+#define MXCSR_FLAGS 0x3f    /* sticky exception flags, never part of a context */
+
+/**
+ * An execution context saved by [save_context()]. Besides the stack and the
+ * program counter, it holds every register which the System V ABI has a 
+ * callee preserve across a call - and so which code built at any optimization
+ * level may keep live values in across [save_context()] - along with the 
+ * argument registers used by contexts made with [make_context()].
+ * 
+ * Vector registers are all caller-saved, so no value is live in them across
+ * the call, and their contents are not part of a context. Only the control 
+ * bits of MXCSR and of the x87 control word are callee-saved, so a context 
+ * is loaded with no exception flags raised in MXCSR. A thread which is 
+ * checkpointed asynchronously, by a signal, has its full extended state saved
+ * by the kernel in the signal frame instead.
+ */
 struct crcontext
 {
     volatile uint64_t addr;
@@ -13,11 +29,30 @@ struct crcontext
     volatile uint64_t rdx;
     volatile uint64_t rsi;
     volatile uint64_t rdi;
+    volatile uint64_t r12;
+    volatile uint64_t r13;
+    volatile uint64_t r14;
+    volatile uint64_t r15;
+    volatile uint32_t mxcsr;
+    volatile uint16_t fpucw;
 };
 
-extern int save_context(volatile struct crcontext *volatile context);
+/**
+ * Returns 0 upon saving the context, and 1 whenever the context is loaded 
+ * again - like setjmp(), which the compiler is told it behaves like.
+ */
+extern int save_context(volatile struct crcontext *volatile context) 
+    __attribute__((returns_twice));
 extern int load_context(volatile struct crcontext *volatile context);
 
+/**
+ * Makes [context] call [func] with the context itself as its argument, on the
+ * stack below [stacktop], and with the floating-point controls of the caller.
+ * [func] must never return.
+ */
+void make_context(volatile struct crcontext *context, 
+                  void (*func) (volatile struct crcontext *), void *stacktop);
+
 void display_context(struct crcontext *volatile context);
 
-#endif
\ No newline at end of file
+#endif
@@ -4,15 +4,119 @@
 #include "vtsthreadtable.h"
 #include "resurrector.h"
 #include "contextswitch.h"
+#include "crstat.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <assert.h>
 
+#include <ucontext.h>
+#include <sys/syscall.h>
+
 /******************************************************************************/
 /** Macros, Definitions, and Static Variables ------------------------------- */
 /******************************************************************************/
 
+/** Deepest stack seen so far by the threads of a task function */
+struct crthread_stackusage
+{
+    void *(*taskfunc) (void *);
+    size_t highwater;
+};
+
+/** 
+ * Stack high-water marks of recently joined threads, used to size the stacks
+ * of new threads. The table is direct-mapped on the task function's address,
+ * and a colliding task function simply evicts the previous one.
+ */
+static struct crthread_stackusage s_stackusage[STACKUSAGE_TABLE_SIZE];
+static pthread_mutex_t s_stackusage_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** How threads commit themselves when checkpointing */
+static volatile enum crthread_cpmode s_cpmode = CRTHREAD_CP_RESTART;
+
+/** 
+ * Barrier of the global checkpoints taken by [crthread_checkpoint_all()]. A
+ * global checkpoint is pending while [requested] is ahead of [completed].
+ */
+struct crthread_barrier
+{
+    pthread_mutex_t coordinator;    /* serializes global checkpoints          */
+    pthread_mutex_t lock;           /* protects every member below            */
+    pthread_cond_t arrived;         /* signalled as threads park or exit      */
+    pthread_cond_t resumed;         /* broadcast once the epoch is captured   */
+    size_t nthreads;                /* crthreads currently running            */
+    size_t nparked;                 /* crthreads parked for [requested]       */
+    volatile uint64_t requested;    /* last global checkpoint requested       */
+    volatile uint64_t completed;    /* last global checkpoint captured        */
+};
+
+static struct crthread_barrier s_barrier = {
+    .coordinator = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .arrived = PTHREAD_COND_INITIALIZER,
+    .resumed = PTHREAD_COND_INITIALIZER
+};
+
+/* Named by glibc only for _GNU_SOURCE, which would make PTHREAD_STACK_MIN, 
+ * and so every stack size, a call to sysconf() in this file alone.          */
+#ifndef REG_RSP
+#define REG_RSP                 15
+#endif
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id  _sigev_un._tid
+#endif
+
+/**
+ * Transient state of the threads resurrected from file, mapped as one slab:
+ * their join semaphores, packed together, then their recovery stacks.
+ */
+struct crthread_slab
+{
+    uint8_t *base;                  /* start of the mapping, or NULL          */
+    size_t len;                     /* length of the mapping                  */
+};
+
+static struct crthread_slab s_slab;
+
+/** Gate which resurrected threads wait at until every one has been created */
+struct crthread_gate
+{
+    pthread_mutex_t lock;           /* protects [closed]                      */
+    pthread_cond_t opened;          /* broadcast once [closed] is cleared     */
+    volatile bool closed;           /* set while threads are being created    */
+};
+
+static struct crthread_gate s_gate = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .opened = PTHREAD_COND_INITIALIZER,
+    .closed = false
+};
+
+/** Share of the resurrected threads which one helper creates */
+struct crthread_range
+{
+    struct crthread **threads;
+    size_t nthreads;
+};
+
+/** Interval of preemptive checkpoints in microseconds, or 0 if disabled */
+static volatile unsigned long s_preempt_interval = 0;
+
+/** The crthread running on this pthread, for the preemption handler */
+static __thread struct crthread *s_self = NULL;
+
+/** Set while this pthread is inside [crthread_checkpoint()] */
+static __thread volatile sig_atomic_t s_busy = 0;
+
+/** Set when a preemptive checkpoint was deferred to the next safe point */
+static __thread volatile sig_atomic_t s_preempted = 0;
+
+/** Set while the preemption signal is blocked on this pthread */
+static __thread bool s_held = false;
+
 /** Used as a wrapper for restoration hook on subsequent runs */
 static void *crthread_stub(void *thread_vp);
 
@@ -24,6 +128,66 @@ static void *crthread_stub(void *thread_vp);
  */
 static void crthread_descend_and_run(struct crthread *thread, void *callstk);
 
+/** Used instead of a restoration when the heap was restored elsewhere */
+static void crthread_abandon(struct crthread *thread);
+
+/** Releases the transient fields of a thread */
+static void crthread_release(struct crthread *thread);
+
+/** Restores every thread of the heap from file at once */
+static void crthread_resurrect(struct crthread **threads, size_t nthreads);
+
+/** Creates the pthreads of a share of the resurrected threads */
+static void *crthread_resurrect_range(void *range_vp);
+
+/** Holds a starting thread until the resurrected threads are all created */
+static void crthread_wait_gate();
+
+/** Adds the thread handle and its stack from [sp] up to its checkpoint */
+static void crthread_track_stack(struct crthread *thread, uint8_t *sp);
+
+/** Commits a thread whose restore point was just saved. Does not return. */
+static void crthread_commit(struct crthread *thread);
+
+/** Returns the slot of the stack usage table used for [taskfunc] */
+static struct crthread_stackusage *crthread_stackusage_slot(
+    void *(*taskfunc) (void *));
+
+/** Picks a stack size for a new thread running [taskfunc] */
+static size_t crthread_autosize(void *(*taskfunc) (void *));
+
+/** Paints a thread's stack, then measures how much of it the thread used */
+static void crthread_paint_stack(struct crthread *thread);
+static size_t crthread_measure_stack(struct crthread *thread);
+
+/** Switches the calling thread over to its recovery stack to run [parked] */
+static void crthread_park(struct crthread *thread, 
+                          void (*parked) (volatile struct crcontext *));
+
+/** Commits a parked thread, then resumes it. Runs on the recovery stack. */
+static void crthread_parked(volatile struct crcontext *parkpoint);
+
+/** Holds a parked thread at the barrier of a global checkpoint. */
+static void crthread_quiesced(volatile struct crcontext *parkpoint);
+
+/** Adds to or removes from the crthreads a global checkpoint waits for */
+static void crthread_count_running(long delta);
+
+/** Takes a global checkpoint, either committing or capturing every page */
+static struct checkpoint *crthread_checkpoint_global(bool async);
+
+/** Sets up preemption on a new pthread, with its signal held until resumed */
+static void crthread_start_preemption(struct crthread *thread);
+
+/** Tears down preemption of a pthread which is about to exit */
+static void crthread_stop_preemption(struct crthread *thread);
+
+/** Arms or disarms the preemption timer of a thread with the interval set */
+static void crthread_arm_preemption(struct crthread *thread, void *aux);
+
+/** Handler of [PREEMPT_SIGNAL]. Runs on the thread's signal stack. */
+static void crthread_preempt(int signo, siginfo_t *info, void *ucontext_vp);
+
 /******************************************************************************/
 /** Private Implementation -------------------------------------------------- */
 /******************************************************************************/
@@ -42,6 +206,13 @@ static void crthread_descend_and_run(struct crthread *thread, void *callstk)
         crthread_descend_and_run(thread, callstk);
     else
     {
+        /* Frames above this one are never returned to, and share the top of
+         * the stack with the thread control block and static TLS - the stack
+         * is only ever live below this frame. */
+        thread->stackroot = (uint8_t *)__builtin_frame_address(0) 
+                          + 2 * sizeof(void *) 
+                          - (uint8_t *)crptr_get(&thread->stack);
+
         /* TODO: Checkpoint BEFORE AND AFTER, KEEP CONTEXTS IN MIND */
         crthread_checkpoint();
 
@@ -50,6 +221,7 @@ static void crthread_descend_and_run(struct crthread *thread, void *callstk)
 
         retval = userfunc(arg);
         thread->retval = retval;
+        thread->preemptible = false;
 
         crthread_checkpoint();
         load_context(&thread->exitpoint);
@@ -65,20 +237,26 @@ static void *crthread_stub(void *crthread_vp)
     /* Initialization of Transient Fields                                     */
     /* ---------------------------------------------------------------------- */
 
+    /* Set up preemption before the thread can be found in the table. */
+    crthread_start_preemption(thread);
+
     /* Add thread to volatile global thread table. */
     vtsthreadtable_insert(thread);
 
-    /* Create thread checkpoint object, specifying what memory to checkpoint. */
+    /* Create thread checkpoint object. What memory to checkpoint is only 
+     * known once the thread checkpoints, as it depends on the stack pointer. */
     thread->checkpoint = checkpoint_new();
-    checkpoint_add(thread->checkpoint, thread, sizeof(*thread));
-    checkpoint_add(thread->checkpoint, thread->stack, thread->stacksize);
 
     /* EXIT POINT 1: 
      * The thread exited normally. */
     if (save_context(&thread->exitpoint) != 0)
     {
+        /* Global checkpoints no longer wait for this thread. */
+        crthread_count_running(-1);
+
         /* Remove the thread from the volatile global thread table. */
         vtsthreadtable_remove(thread->ptid);
+        crthread_stop_preemption(thread);
 
         /* Destroy thread checkpoint object. */
         checkpoint_delete(thread->checkpoint);
@@ -96,9 +274,13 @@ static void *crthread_stub(void *crthread_vp)
     {
         /* Simply exit for real. Do NOT post to userjoin and leave transient 
          * fields alone. */
+        crthread_stop_preemption(thread);
         pthread_exit(NULL);
     }
 
+    /* Resurrected threads only run once every one of them is ready. */
+    crthread_wait_gate();
+
     if (thread->firstrun)
     {
         thread->firstrun = false;
@@ -117,6 +299,446 @@ static void *crthread_stub(void *crthread_vp)
     abort();
 }
 
+/**
+ * The saved contexts and stack frames of a thread hold absolute addresses, so
+ * a thread cannot be resumed from a heap restored at another address. It is 
+ * left where it stopped instead, and joining it returns at once - with the 
+ * result of a thread which had finished before the heap was moved.
+ */
+static void crthread_abandon(struct crthread *thread)
+{
+    thread->userjoin = mcmmap(NULL, sysconf(_SC_PAGE_SIZE), 
+                              PROT_READ | PROT_WRITE, 
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    sem_init(thread->userjoin, 0, 1);
+    thread->recoverystack = NULL;
+    thread->ptid = -1;
+}
+
+static void crthread_release(struct crthread *thread)
+{
+    uint8_t *userjoin = (uint8_t *)thread->userjoin;
+
+    sem_destroy(thread->userjoin);
+
+    /* Threads resurrected together are released along with their slab. */
+    if (userjoin >= s_slab.base && userjoin < s_slab.base + s_slab.len)
+        return;
+
+    mcmunmap(thread->userjoin, sysconf(_SC_PAGE_SIZE));
+
+    if (thread->recoverystack != NULL)
+        mcmunmap(thread->recoverystack, RECOVERY_STACKSIZE);
+}
+
+/**
+ * Restoring threads one at a time costs two mappings and a pthread each, and
+ * lets the first ones run while the rest are still being created. Instead, 
+ * the transient state of every thread is carved out of a single mapping, and
+ * the pthreads are created by as many helpers as there are CPUs to spare, 
+ * each of which prepares its own timer, signal stack and checkpoint object. 
+ * The threads then wait at a gate, which is opened once all of them exist.
+ */
+static void crthread_resurrect(struct crthread **threads, size_t nthreads)
+{
+    struct crthread_range *ranges;
+    pthread_t *helpers;
+    size_t pagesize, joinlen, nhelpers, share, i;
+    long ncpus;
+
+    pagesize = sysconf(_SC_PAGE_SIZE);
+    joinlen = (nthreads * sizeof(sem_t) + pagesize - 1) & ~(pagesize - 1);
+
+    s_slab.len = joinlen + nthreads * RECOVERY_STACKSIZE;
+    s_slab.base = mcmmap(NULL, s_slab.len, PROT_READ | PROT_WRITE, 
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    for (i = 0; i < nthreads; i++)
+    {
+        threads[i]->userjoin = (sem_t *)s_slab.base + i;
+        sem_init(threads[i]->userjoin, 0, 0);
+        threads[i]->recoverystack = s_slab.base + joinlen 
+                                  + i * RECOVERY_STACKSIZE;
+    }
+
+    crthread_count_running(nthreads);
+    s_gate.closed = true;
+
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nhelpers = (nthreads + RESURRECT_BATCH_SIZE - 1) / RESURRECT_BATCH_SIZE;
+    if (ncpus > 0 && nhelpers > (size_t)ncpus)
+        nhelpers = ncpus;
+
+    if (nhelpers <= 1)
+    {
+        for (i = 0; i < nthreads; i++)
+            crthread_restore(threads[i], false);
+    }
+    else
+    {
+        helpers = mcmalloc(nhelpers * sizeof(*helpers));
+        ranges = mcmalloc(nhelpers * sizeof(*ranges));
+        share = (nthreads + nhelpers - 1) / nhelpers;
+
+        for (i = 0; i < nhelpers; i++)
+        {
+            ranges[i].threads = threads + i * share;
+            ranges[i].nthreads = i * share + share <= nthreads 
+                               ? share : nthreads - i * share;
+            pthread_create(&helpers[i], NULL, crthread_resurrect_range, 
+                           &ranges[i]);
+        }
+
+        for (i = 0; i < nhelpers; i++)
+            pthread_join(helpers[i], NULL);
+
+        mcfree(ranges);
+        mcfree(helpers);
+    }
+
+    pthread_mutex_lock(&s_gate.lock);
+    s_gate.closed = false;
+    pthread_cond_broadcast(&s_gate.opened);
+    pthread_mutex_unlock(&s_gate.lock);
+}
+
+static void *crthread_resurrect_range(void *range_vp)
+{
+    struct crthread_range *range = range_vp;
+    size_t i;
+
+    for (i = 0; i < range->nthreads; i++)
+        crthread_restore(range->threads[i], false);
+
+    return NULL;
+}
+
+static void crthread_wait_gate()
+{
+    if (!s_gate.closed)
+        return;
+
+    pthread_mutex_lock(&s_gate.lock);
+    while (s_gate.closed)
+        pthread_cond_wait(&s_gate.opened, &s_gate.lock);
+    pthread_mutex_unlock(&s_gate.lock);
+}
+
+/**
+ * The live part of the stack spans from the stack pointer saved in the 
+ * thread's restore point (less the red zone, which the interrupted frame may
+ * still be using) up to the frame the task function was started from. 
+ * 
+ * The thread control block above that frame is left out: it is rebuilt along
+ * with the pthread upon restoration, and a thread committing itself in place 
+ * keeps writing to its TLS, which must never be write-protected under it.
+ */
+static void crthread_track_stack(struct crthread *thread, uint8_t *sp)
+{
+    uint8_t *stack, *root, *live;
+
+    stack = crptr_get(&thread->stack);
+    root = stack + thread->stackroot;
+    live = sp - STACK_REDZONE_SIZE;
+
+    assert(live >= stack && live < root);
+
+    checkpoint_clear(thread->checkpoint);
+    checkpoint_add(thread->checkpoint, thread, sizeof(*thread));
+    checkpoint_add(thread->checkpoint, live, (size_t)(root - live));
+
+    crstat_record(CRSTAT_THREAD_STACK_BYTES, (size_t)(root - live));
+}
+
+static void crthread_commit(struct crthread *thread)
+{
+    /* A pending global checkpoint covers this one - join it instead. */
+    if (s_barrier.requested != s_barrier.completed)
+        crthread_park(thread, crthread_quiesced);
+
+    /* Commit in place, resuming from the marker on the same pthread. */
+    if (s_cpmode != CRTHREAD_CP_RESTART)
+        crthread_park(thread, crthread_parked);
+
+    /* Otherwise, first submit this thread for checkpointing. */
+    resurrector_checkpoint(thread);
+
+    /* Then, jump to thread's checkpoint exit location. */
+    load_context(&thread->cpexitpoint);
+
+    /* Function should never reach this point. */
+    abort();
+}
+
+static struct crthread_stackusage *crthread_stackusage_slot(
+    void *(*taskfunc) (void *))
+{
+    uintptr_t hash = (uintptr_t)taskfunc;
+
+    hash ^= hash >> 17;
+    return &s_stackusage[(hash >> 4) % STACKUSAGE_TABLE_SIZE];
+}
+
+/**
+ * The stack is given twice the deepest usage measured, as the depth of a task
+ * may depend on its input, on top of the guard needed to service interrupts.
+ * Stacks live in the heap without a guard page, so an overflow would corrupt
+ * its neighbours silently - which is why no stack is ever sized below the 
+ * default.
+ */
+static size_t crthread_autosize(void *(*taskfunc) (void *))
+{
+    struct crthread_stackusage *slot;
+    size_t stacksize = DEFAULT_STACKSIZE;
+    size_t pagesize = sysconf(_SC_PAGE_SIZE);
+
+    pthread_mutex_lock(&s_stackusage_lock);
+    slot = crthread_stackusage_slot(taskfunc);
+    if (slot->taskfunc == taskfunc && slot->highwater != 0)
+        stacksize = 2 * slot->highwater + INTERRUPT_GUARD_SIZE;
+    pthread_mutex_unlock(&s_stackusage_lock);
+
+    stacksize = (stacksize + pagesize - 1) & ~(pagesize - 1);
+    if (stacksize < DEFAULT_STACKSIZE)
+        stacksize = DEFAULT_STACKSIZE;
+
+    return stacksize;
+}
+
+/**
+ * Usage is measured by painting the whole stack before the thread starts, 
+ * and finding the lowest byte no longer painted once it is joined. A thread 
+ * resurrected from a crash may find parts of its stack which were never 
+ * committed unpainted, which can only overestimate its usage.
+ */
+static void crthread_paint_stack(struct crthread *thread)
+{
+    memset(crptr_get(&thread->stack), STACK_PAINT, thread->stacksize);
+}
+
+static size_t crthread_measure_stack(struct crthread *thread)
+{
+    uint8_t *stack;
+    size_t i;
+
+    stack = crptr_get(&thread->stack);
+    for (i = 0; i < thread->stacksize && stack[i] == STACK_PAINT; i++);
+
+    return thread->stacksize - i;
+}
+
+/**
+ * The thread is moved to its recovery stack by loading a context crafted to
+ * call [parked], which [load_context()] passes its own address. The upper 
+ * half of the recovery stack may be in use, by the stub frame and the thread
+ * control block of a thread restored onto it, so parking uses the lower half.
+ * [parked] resumes the thread by loading its restore point.
+ */
+static void crthread_park(struct crthread *thread, 
+                          void (*parked) (volatile struct crcontext *))
+{
+    make_context(&thread->parkpoint, parked, 
+                 (char *)thread->recoverystack + RECOVERY_STACKSIZE / 2);
+    load_context(&thread->parkpoint);
+}
+
+static void crthread_parked(volatile struct crcontext *parkpoint)
+{
+    struct crthread *thread;
+    uint64_t start;
+
+    thread = container_of(parkpoint, struct crthread, parkpoint);
+    start = crstat_now_ns();
+
+    if (s_cpmode == CRTHREAD_CP_ASYNC)
+        checkpoint_commit_async(thread->checkpoint);
+    else
+        checkpoint_commit(thread->checkpoint);
+
+    crstat_add(CRSTAT_THREAD_CHECKPOINTS, 1);
+    crstat_record(CRSTAT_THREAD_CHECKPOINT_NS, crstat_now_ns() - start);
+
+    load_context(&thread->restorepoint);
+
+    /* Function should never reach this point. */
+    abort();
+}
+
+/**
+ * The thread's stack is not written while it waits here, so its image is the
+ * one at its restore point, whether or not the global checkpoint commits it 
+ * before the thread is released.
+ */
+static void crthread_quiesced(volatile struct crcontext *parkpoint)
+{
+    struct crthread *thread;
+    uint64_t epoch;
+
+    thread = container_of(parkpoint, struct crthread, parkpoint);
+
+    pthread_mutex_lock(&s_barrier.lock);
+
+    epoch = s_barrier.requested;
+    s_barrier.nparked++;
+    pthread_cond_signal(&s_barrier.arrived);
+
+    while (s_barrier.completed < epoch)
+        pthread_cond_wait(&s_barrier.resumed, &s_barrier.lock);
+
+    pthread_mutex_unlock(&s_barrier.lock);
+
+    load_context(&thread->restorepoint);
+
+    /* Function should never reach this point. */
+    abort();
+}
+
+/**
+ * The preemption signal is held until the thread resumes from its restore 
+ * point: either in [crthread_checkpoint()], or by returning from the handler
+ * it was preempted in, which restores the signal mask of the interrupted 
+ * code. A restored thread must not be preempted before it is back on its own
+ * stack.
+ */
+static void crthread_start_preemption(struct crthread *thread)
+{
+    struct sigevent event;
+    sigset_t signals;
+    stack_t altstack;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, PREEMPT_SIGNAL);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    s_held = true;
+    s_self = thread;
+
+    altstack.ss_sp = crptr_get(&thread->altstack);
+    altstack.ss_size = ALTSTACK_SIZE;
+    altstack.ss_flags = 0;
+    sigaltstack(&altstack, NULL);
+
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = PREEMPT_SIGNAL;
+    event.sigev_notify_thread_id = syscall(SYS_gettid);
+
+    timer_create(CLOCK_MONOTONIC, &event, &thread->preempttimer);
+    crthread_arm_preemption(thread, NULL);
+}
+
+static void crthread_stop_preemption(struct crthread *thread)
+{
+    timer_delete(thread->preempttimer);
+}
+
+static void crthread_arm_preemption(struct crthread *thread, 
+                                    __attribute__((unused)) void *aux)
+{
+    struct itimerspec interval;
+    unsigned long interval_us = s_preempt_interval;
+
+    interval.it_interval.tv_sec = interval_us / 1000000;
+    interval.it_interval.tv_nsec = (interval_us % 1000000) * 1000;
+    interval.it_value = interval.it_interval;
+
+    timer_settime(thread->preempttimer, 0, &interval, NULL);
+}
+
+/**
+ * Checkpointing from a signal handler is only safe because the interrupted
+ * code holds no locks, which is what a preemptible region promises. The 
+ * restore point is saved on the signal stack, above which the kernel keeps 
+ * the interrupted registers (general purpose, flags, and extended state), so
+ * the live parts of both stacks are committed. Loading the restore point, 
+ * either in place or in a new pthread, returns from this handler to the 
+ * interrupted code.
+ */
+static void crthread_preempt(__attribute__((unused)) int signo, 
+                             __attribute__((unused)) siginfo_t *info, 
+                             void *ucontext_vp)
+{
+    struct crthread *volatile thread = s_self;
+    volatile int olderrno = errno;
+    ucontext_t *volatile uc = ucontext_vp;
+    uint8_t *altstack, *live;
+
+    if (thread == NULL)
+        return;
+
+    if (!thread->preemptible || s_busy)
+    {
+        s_preempted = 1;
+        return;
+    }
+
+    crstat_add(CRSTAT_THREAD_PREEMPTIONS, 1);
+
+    if (save_context(&thread->restorepoint) == 0)
+    {
+        s_preempted = 0;
+        crthread_track_stack(thread, (uint8_t *)uc->uc_mcontext.gregs[REG_RSP]);
+
+        altstack = crptr_get(&thread->altstack);
+        live = (uint8_t *)(uintptr_t)thread->restorepoint.rsp 
+             - STACK_REDZONE_SIZE;
+        checkpoint_add(thread->checkpoint, live, 
+                       (size_t)(altstack + ALTSTACK_SIZE - live));
+
+        crthread_commit(thread);
+    }
+
+    errno = olderrno;
+}
+
+static void crthread_count_running(long delta)
+{
+    pthread_mutex_lock(&s_barrier.lock);
+    s_barrier.nthreads += delta;
+    pthread_cond_signal(&s_barrier.arrived);
+    pthread_mutex_unlock(&s_barrier.lock);
+}
+
+/**
+ * Requests a global checkpoint, and waits for every running crthread to park
+ * at its next safe point. With all of them quiesced, the heap - which holds 
+ * their stacks and handles - is checkpointed as a whole along with the bumped
+ * epoch counter, and the threads are released. An asynchronous checkpoint 
+ * releases them as soon as the dirty pages are captured, and returns the 
+ * completion handle of the commit.
+ */
+static struct checkpoint *crthread_checkpoint_global(bool async)
+{
+    struct nvmetadata *meta;
+    struct checkpoint *checkpoint = NULL;
+
+    assert(vtsthreadtable_find(pthread_self()) == NULL);
+    meta = nvmetadata_instance();
+
+    pthread_mutex_lock(&s_barrier.coordinator);
+    pthread_mutex_lock(&s_barrier.lock);
+
+    s_barrier.nparked = 0;
+    s_barrier.requested++;
+
+    while (s_barrier.nparked < s_barrier.nthreads)
+        pthread_cond_wait(&s_barrier.arrived, &s_barrier.lock);
+
+    meta->epoch++;
+
+    if (async)
+        checkpoint = nvstore_checkpoint_everything_background();
+    else
+        nvstore_checkpoint_everything();
+
+    s_barrier.completed = s_barrier.requested;
+    pthread_cond_broadcast(&s_barrier.resumed);
+
+    pthread_mutex_unlock(&s_barrier.lock);
+    pthread_mutex_unlock(&s_barrier.coordinator);
+
+    return checkpoint;
+}
+
 /******************************************************************************/
 /** Public-Facing API ------------------------------------------------------- */
 /******************************************************************************/
@@ -126,25 +748,45 @@ void crthread_init_system()
 {
     struct nvmetadata *meta;
     struct list_elem *elem;
-    struct crthread *thread;
+    struct crthread **threads;
+    struct sigaction action;
+    size_t nthreads, i;
 
     meta = nvmetadata_instance();
 
     vtsthreadtable_init();
     resurrector_init();
 
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = crthread_preempt;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(PREEMPT_SIGNAL, &action, NULL);
+
+    /* Threads are all joined before shutdown, so none are running yet. */
+    s_barrier.nthreads = 0;
+
     pthread_mutex_lock(&meta->threadlock);
 
+    nthreads = list_size(&meta->threadlist);
+    threads = mcmalloc((nthreads + 1) * sizeof(*threads));
+
+    i = 0;
     elem = list_begin(&meta->threadlist);
     while (elem != list_end(&meta->threadlist))
     {
-        thread = container_of(elem, struct crthread, elem);
-        crthread_restore(thread, true);
-
+        threads[i++] = container_of(elem, struct crthread, elem);
         elem = list_next(elem);
     }
 
+    if (nvstore_relocated())
+        for (i = 0; i < nthreads; i++)
+            crthread_abandon(threads[i]);
+    else if (nthreads != 0)
+        crthread_resurrect(threads, nthreads);
+
     pthread_mutex_unlock(&meta->threadlock);
+    mcfree(threads);
 }
 
 void crthread_shutdown_system()
@@ -162,10 +804,16 @@ void crthread_shutdown_system()
     while (elem != list_end(&meta->threadlist))
     {
         thread = container_of(elem, struct crthread, elem);
-        sem_destroy(thread->userjoin);
-        mcmunmap(thread->userjoin, sysconf(_SC_PAGE_SIZE));
+        crthread_release(thread);
         elem = list_next(elem);
     }
+
+    if (s_slab.base != NULL)
+    {
+        mcmunmap(s_slab.base, s_slab.len);
+        s_slab.base = NULL;
+        s_slab.len = 0;
+    }
 }
 
 struct crthread *crthread_new(void *(*taskfunc) (void *), 
@@ -173,18 +821,34 @@ struct crthread *crthread_new(void *(*taskfunc) (void *),
 {
     struct crthread *crthread;
     struct nvmetadata *meta;
+    size_t pagesize;
 
     meta = nvmetadata_instance();
+    pagesize = sysconf(_SC_PAGE_SIZE);
 
-    crthread = crmalloc(sizeof(*crthread));
+    /* Each thread commits the pages of its own handle, so those pages must 
+     * not hold the handle of another thread: its new restore point would be
+     * committed without the stack it returns to. */
+    crthread = crmalloc_hint((sizeof(*crthread) + pagesize - 1) 
+                             & ~(pagesize - 1), CR_PAGE_ALIGNED);
 
-    crthread->stacksize = DEFAULT_STACKSIZE;
-    if (stacksize > DEFAULT_STACKSIZE)
+    crthread->autostack = stacksize == CRTHREAD_STACK_AUTO;
+
+    if (crthread->autostack)
+        crthread->stacksize = crthread_autosize(taskfunc);
+    else if (stacksize > DEFAULT_STACKSIZE)
         crthread->stacksize = stacksize & ~(sysconf(_SC_PAGE_SIZE) - 1);
+    else
+        crthread->stacksize = DEFAULT_STACKSIZE;
 
-    crthread->stack = crmalloc(crthread->stacksize);
+    crptr_set(&crthread->stack, crmalloc(crthread->stacksize));
+    crthread->stackused = 0;
+    crthread->stackroot = crthread->stacksize;
     crthread->arg = arg;
 
+    crptr_set(&crthread->altstack, crmalloc(ALTSTACK_SIZE));
+    crthread->preemptible = false;
+
     /* Semaphore is initialized outside of task function so that main thread can
      * join with this crthread. */
     crthread->userjoin = mcmmap(NULL, sysconf(_SC_PAGE_SIZE), 
@@ -192,6 +856,12 @@ struct crthread *crthread_new(void *(*taskfunc) (void *),
                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
     sem_init(crthread->userjoin, 0, 0);
 
+    /* The recovery stack is only used to jump back into the thread's stack, 
+     * so it is kept out of the heap and never checkpointed. */
+    crthread->recoverystack = mcmmap(NULL, RECOVERY_STACKSIZE, 
+                                     PROT_READ | PROT_WRITE, 
+                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
     crthread->taskfunc = taskfunc;
 
     crthread->firstrun = true;
@@ -216,9 +886,9 @@ void crthread_delete(struct crthread *crthread)
     list_remove(&crthread->elem);
     pthread_mutex_unlock(&meta->threadlock);
 
-    sem_destroy(crthread->userjoin);
-    mcfree(crthread->userjoin);
-    crfree(crthread->stack);
+    crthread_release(crthread);
+    crfree(crptr_get(&crthread->altstack));
+    crfree(crptr_get(&crthread->stack));
     crfree(crthread);
 }
 
@@ -226,19 +896,50 @@ void crthread_fork(struct crthread *thread)
 {
     pthread_attr_t attrs;
 
+    if (thread->autostack)
+        crthread_paint_stack(thread);
+
     pthread_attr_init(&attrs);
-    pthread_attr_setstack(&attrs, thread->stack, thread->stacksize);
+    pthread_attr_setstack(&attrs, crptr_get(&thread->stack), 
+                          thread->stacksize);
     pthread_attr_setguardsize(&attrs, 0);
 
+    crthread_count_running(1);
+
     pthread_create(&thread->ptid, &attrs, crthread_stub, thread);
     pthread_attr_destroy(&attrs);
 }
 
 void *crthread_join(struct crthread *thread)
 {
+    struct crthread_stackusage *slot;
+
     sem_wait(thread->userjoin);
     thread->inprogress = false;
 
+    /* The thread posts before it exits, possibly from its own stack, which 
+     * also holds its thread control block - reap it before the stack can be
+     * freed. Abandoned threads never ran in this process. */
+    if (thread->ptid != (pthread_t)-1)
+        pthread_join(thread->ptid, NULL);
+    thread->ptid = -1;
+
+    if (!thread->autostack)
+        return (void *)thread->retval;
+
+    thread->stackused = crthread_measure_stack(thread);
+
+    pthread_mutex_lock(&s_stackusage_lock);
+    slot = crthread_stackusage_slot(thread->taskfunc);
+    if (slot->taskfunc != thread->taskfunc)
+    {
+        slot->taskfunc = thread->taskfunc;
+        slot->highwater = 0;
+    }
+    if (thread->stackused > slot->highwater)
+        slot->highwater = thread->stackused;
+    pthread_mutex_unlock(&s_stackusage_lock);
+
     return (void *)thread->retval;
 }
 
@@ -257,13 +958,15 @@ void *crthread_join(struct crthread *thread)
  *      A return code of 1 implies that the thread jumped to this location. This
  *      implies that we are attempting to RESTORE the program execution context.
  * 
- *  3.) If a checkpoint is requested, we commit the calling thread's current
- *      stack and other miscellaneous thread members.
+ *  3.) If a checkpoint is requested, we commit the live part of the calling
+ *      thread's current stack and other miscellaneous thread members - either
+ *      from the resurrector, or in place (see [enum crthread_cpmode]).
  */
 void crthread_checkpoint()
 {
     struct crthread *volatile thread = NULL;
     struct crcontext *volatile context;
+    sigset_t signals;
 
     pthread_t ptid;
 
@@ -273,34 +976,108 @@ void crthread_checkpoint()
     assert(thread != NULL);
     context = (struct crcontext *volatile)&thread->restorepoint;
 
+    /* Preemption must not nest in here, and this checkpoint covers any which
+     * was deferred. */
+    s_busy = 1;
+    s_preempted = 0;
+
     /* Set a marker to which to jump. Then, submit this thread to the 
      * resurrector and exit for restoration. */
     if (save_context(context) == 0)
     {
-        /* First, submit this thread for checkpointing. */
-        resurrector_checkpoint(thread);
+        crthread_track_stack(thread, (uint8_t *)(uintptr_t)context->rsp);
+        crthread_commit(thread);
+    }
 
-        /* Then, jump to thread's checkpoint exit location. */
-        load_context(&thread->cpexitpoint);
+    s_busy = 0;
+
+    /* A restored thread can be preempted again now that it is resumed. */
+    if (s_held)
+    {
+        sigemptyset(&signals);
+        sigaddset(&signals, PREEMPT_SIGNAL);
+        pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+        s_held = false;
     }
 }
 
+void crthread_safepoint()
+{
+    if (s_barrier.requested == s_barrier.completed && !s_preempted)
+        return;
+
+    crthread_checkpoint();
+}
+
+void crthread_set_preemption(unsigned long interval_us)
+{
+    s_preempt_interval = interval_us;
+    vtsthreadtable_foreach(crthread_arm_preemption, NULL);
+}
+
+void crthread_preemptible(bool preemptible)
+{
+    assert(s_self != NULL);
+    s_self->preemptible = preemptible;
+}
+
+uint64_t crthread_checkpoint_all()
+{
+    crthread_checkpoint_global(false);
+    return nvmetadata_instance()->epoch;
+}
+
+struct checkpoint *crthread_checkpoint_all_async()
+{
+    return crthread_checkpoint_global(true);
+}
+
+uint64_t crthread_epoch()
+{
+    return nvmetadata_instance()->epoch;
+}
+
+void crthread_set_checkpoint_mode(enum crthread_cpmode mode)
+{
+    s_cpmode = mode;
+}
+
+enum crthread_cpmode crthread_get_checkpoint_mode()
+{
+    return s_cpmode;
+}
+
 void crthread_restore(struct crthread *thread, bool from_file)
 {
     pthread_attr_t attrs;
 
     pthread_attr_init(&attrs);
-    pthread_attr_setstack(&attrs, thread->recoverystack, DEFAULT_STACKSIZE);
-    pthread_attr_setguardsize(&attrs, 0);
-
     if (from_file)
     {
         thread->userjoin = mcmmap(NULL, sysconf(_SC_PAGE_SIZE), 
                                   PROT_READ | PROT_WRITE, 
                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
         sem_init(thread->userjoin, 0, 0);
+
+        thread->recoverystack = mcmmap(NULL, RECOVERY_STACKSIZE, 
+                                       PROT_READ | PROT_WRITE, 
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        crthread_count_running(1);
     }
 
+    /* A thread which never reached its first checkpoint has nothing on its 
+     * stack to return to, and starts over on it as it would when forked. */
+    if (thread->firstrun)
+        pthread_attr_setstack(&attrs, crptr_get(&thread->stack), 
+                              thread->stacksize);
+    else
+        pthread_attr_setstack(&attrs, thread->recoverystack, 
+                              RECOVERY_STACKSIZE);
+    pthread_attr_setguardsize(&attrs, 0);
+
     pthread_create(&thread->ptid, &attrs, crthread_stub, thread);
     pthread_attr_destroy(&attrs);
+
+    crstat_add(CRSTAT_THREAD_RESTORES, 1);
 }
@@ -14,9 +14,52 @@
 
 #include <unistd.h>
 #include <signal.h>
+#include <time.h>
 
 #define INTERRUPT_GUARD_SIZE    (2 * PTHREAD_STACK_MIN)
 #define DEFAULT_STACKSIZE       ((8 * PTHREAD_STACK_MIN) + INTERRUPT_GUARD_SIZE)
+#define RECOVERY_STACKSIZE      DEFAULT_STACKSIZE
+
+/* stack size which has [crthread_new()] size the stack from past threads     */
+#define CRTHREAD_STACK_AUTO     ((size_t)-1)
+
+/* x86-64 System V red zone, which may hold live data below the saved [rsp]   */
+#define STACK_REDZONE_SIZE      128
+
+/* byte written over automatically sized stacks, to measure their usage      */
+#define STACK_PAINT             0xa5
+
+/* number of task functions whose stack high-water marks are remembered       */
+#define STACKUSAGE_TABLE_SIZE   64
+
+/* fewest threads worth creating from a helper of their own upon resurrection */
+#define RESURRECT_BATCH_SIZE    64
+
+/* signal stack of a thread, which holds the interrupted registers when the 
+ * thread is checkpointed from the preemption signal's handler                */
+#define ALTSTACK_SIZE           (4 * PTHREAD_STACK_MIN)
+#define PREEMPT_SIGNAL          SIGRTMIN
+
+/** 
+ * How [crthread_checkpoint()] commits the calling thread.
+ * 
+ * [CRTHREAD_CP_RESTART] exits the pthread, has the resurrector commit it, and
+ * creates a replacement pthread which jumps back into the saved context.
+ * 
+ * [CRTHREAD_CP_INPLACE] parks the calling thread instead: it switches over to
+ * its recovery stack, commits its checkpoint from there, and jumps back into
+ * its own stack on the same pthread. As nothing runs on the thread's stack 
+ * while it is parked, the commit never races with the thread dirtying it.
+ * 
+ * [CRTHREAD_CP_ASYNC] parks the thread just as long as it takes to capture 
+ * and write-protect its dirty pages, and resumes it while they are written.
+ */
+enum crthread_cpmode
+{
+    CRTHREAD_CP_RESTART,
+    CRTHREAD_CP_INPLACE,
+    CRTHREAD_CP_ASYNC
+};
 
 /* internal crthread handle - used to represent a non-volatile thread */
 struct crthread
@@ -29,9 +72,13 @@ struct crthread
 
     /* normal thread variables                                                */
     /* ---------------------------------------------------------------------- */
-    void *stack;                                /* crmalloc'd stack           */
-    uint8_t recoverystack[DEFAULT_STACKSIZE];   /* recovery stack to longjmp  */
+    crptr stack;                                /* crmalloc'd stack           */
     size_t stacksize;                           /* size of main stack         */
+    size_t stackused;                           /* deepest stack, upon join   */
+    bool autostack;                             /* stack sized and measured   */
+    size_t stackroot;                           /* offset of task's frame     */
+    crptr altstack;                             /* crmalloc'd signal stack    */
+    volatile bool preemptible;                  /* preempt without safe point */
     void *(*taskfunc) (void *);                 /* task function              */
     void *volatile arg;                         /* the argument for thread    */
     void *volatile retval;                      /* result of execution        */
@@ -46,6 +93,9 @@ struct crthread
     /* ---------------------------------------------------------------------- */
     pthread_t ptid;                 /* the original thread ID variable        */
     sem_t *userjoin;                /* User should use this over pthread_join */
+    void *recoverystack;            /* stack to longjmp from on restoration   */
+    volatile struct crcontext parkpoint;    /* jmp here to park in place      */
+    timer_t preempttimer;           /* signals this thread to checkpoint      */
     struct vtslist_elem vtselem;    /* used for insertions into vthreadtable  */
     struct checkpoint *checkpoint;  /* checkpoint object for committing self  */
 };
@@ -71,6 +121,13 @@ void crthread_shutdown_system();
 /** 
  * Constructs a new thread. Unlike the pthread library, creating a new thread
  * does not instantly fork off the new function to be executed concurrently.
+ * 
+ * A [stacksize] of [CRTHREAD_STACK_AUTO] sizes the stack automatically: twice
+ * the deepest stack used by threads of the same [taskfunc] joined so far, and
+ * never less than [DEFAULT_STACKSIZE]. Such a thread has its stack measured 
+ * when it is joined, at the cost of writing its whole stack when it is forked.
+ * Any other size is rounded down to whole pages, and raised to 
+ * [DEFAULT_STACKSIZE] if smaller - including 0.
  */
 struct crthread *crthread_new(void *(*taskfunc) (void *), 
                               void *arg, size_t stacksize);
@@ -105,10 +162,94 @@ void *crthread_join(struct crthread *thread);
  * thread - other threads must manually call this function for them to also be
  * checkpointed.
  * 
+ * If a global checkpoint is pending (see [crthread_checkpoint_all()]), the
+ * thread parks for it instead, as it covers this checkpoint.
+ * 
+ * Only the live part of the thread's stack - from the saved stack pointer up
+ * to the frame the task function was started from - is committed along with 
+ * the thread handle. Frames below it are dead, and frames above it are never
+ * returned to, so neither is read again after a restoration.
+ * 
  * Users can call this function.
  */
 void crthread_checkpoint();
 
+/**
+ * Polls for a global checkpoint requested by [crthread_checkpoint_all()], or
+ * for a preemptive checkpoint deferred by [crthread_set_preemption()], and 
+ * checkpoints the calling thread if there is one. Polling costs three loads 
+ * when neither is pending, so it can sit in the hot loop of a thread. 
+ * [crthread_checkpoint()] is a safe point as well.
+ * 
+ * Users can call this function from crthreads.
+ */
+void crthread_safepoint();
+
+/**
+ * Checkpoints every running crthread and the rest of the heap as one globally
+ * consistent epoch. The call blocks until every crthread has parked at its 
+ * next safe point, commits the whole heap - thread stacks and handles 
+ * included - while they are held there, then releases them and returns the 
+ * number of the epoch.
+ * 
+ * Threads only park at safe points, so a thread blocked on another crthread
+ * (through a lock, say) must reach a safe point some other way, or the global
+ * checkpoint waits forever. This should never be called from a crthread.
+ * 
+ * Users can call this function.
+ */
+uint64_t crthread_checkpoint_all();
+
+/**
+ * Non-blocking variant of [crthread_checkpoint_all()]. The threads are 
+ * released as soon as the heap's dirty pages are captured, and are written 
+ * in the background while they keep running. The returned completion handle
+ * behaves as the one of [nvstore_checkpoint_everything_background()], and
+ * the epoch is durable once it completes without failure.
+ * 
+ * Users can call this function.
+ */
+struct checkpoint *crthread_checkpoint_all_async();
+
+/** Returns the number of the last global checkpoint taken of this heap. */
+uint64_t crthread_epoch();
+
+/**
+ * Checkpoints every crthread preemptively, every [interval_us] microseconds 
+ * of wall-clock time, or never if [interval_us] is 0 (the default). The 
+ * interval can be changed at any time, and applies to running threads too.
+ * 
+ * Each crthread gets a timer which signals it with [PREEMPT_SIGNAL]. The 
+ * handler runs on the thread's signal stack, which lives in the heap, and:
+ * 
+ *  - If the thread is in a preemptible region (see [crthread_preemptible()]),
+ *    checkpoints it right there, signal frame included. Once the thread is
+ *    resumed, returning from the handler restores every register of the 
+ *    interrupted code - even in a new pthread after a crash.
+ * 
+ *  - Otherwise, defers the checkpoint to the thread's next safe point, as the
+ *    interrupted code may hold locks the checkpoint needs.
+ * 
+ * Users can call this function.
+ */
+void crthread_set_preemption(unsigned long interval_us);
+
+/**
+ * Marks the start or the end of a preemptible region of the calling thread,
+ * in which it can be checkpointed by the preemption signal without reaching a
+ * safe point - such as a tight loop without calls. Code in such a region must
+ * not take locks or allocate memory.
+ * 
+ * Users can call this function from crthreads.
+ */
+void crthread_preemptible(bool preemptible);
+
+/** Sets how threads commit themselves from [crthread_checkpoint()]. */
+void crthread_set_checkpoint_mode(enum crthread_cpmode mode);
+
+/** Returns how threads commit themselves from [crthread_checkpoint()]. */
+enum crthread_cpmode crthread_get_checkpoint_mode();
+
 /**
  * Restores a thread which has been checkpointed by performing a longjmp to the
  * appropriate location in the thread's saved stack.
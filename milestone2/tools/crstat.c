@@ -0,0 +1,149 @@
+/**
+ * crstat: prints the live statistics of a process running the checkpoint-
+ * restore framework, in the spirit of vmstat.
+ *
+ *     usage: crstat <pid> [interval-seconds] [count]
+ *
+ * Every interval, the rate of each counter, the value of each gauge, and the
+ * count, median, and 99th percentile of each histogram over that interval are
+ * printed. Percentiles are reported as the upper bound of their log2 bucket.
+ */
+#include "crstat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define DEFAULT_INTERVAL    1
+
+/** A sample of every statistic, summed over all threads. */
+struct crstat_sample
+{
+    uint64_t counters[CRSTAT_NCOUNTERS];
+    uint64_t histograms[CRSTAT_NHISTOGRAMS][CRSTAT_NBUCKETS];
+    uint64_t time_ns;
+};
+
+static void crstat_take_sample(struct crstat_segment *segment, 
+                               struct crstat_sample *sample)
+{
+    size_t i;
+
+    sample->time_ns = crstat_now_ns();
+
+    for (i = 0; i < CRSTAT_NCOUNTERS; i++)
+        sample->counters[i] = crstat_sum_counter(segment, i);
+
+    for (i = 0; i < CRSTAT_NHISTOGRAMS; i++)
+        crstat_sum_histogram(segment, i, sample->histograms[i]);
+}
+
+/** Upper bound of the bucket holding the [fraction] quantile of [buckets]. */
+static uint64_t crstat_quantile(const uint64_t *buckets, uint64_t total, 
+                                double fraction)
+{
+    uint64_t seen = 0;
+    size_t i;
+
+    for (i = 0; i < CRSTAT_NBUCKETS; i++)
+    {
+        seen += buckets[i];
+        if (seen > 0 && seen >= fraction * total)
+            return i == 0 ? 0 : (1ull << i) - 1;
+    }
+
+    return 0;
+}
+
+static void crstat_print(struct crstat_segment *segment, 
+                         struct crstat_sample *prev, 
+                         struct crstat_sample *curr)
+{
+    uint64_t delta[CRSTAT_NBUCKETS], total;
+    double elapsed;
+    size_t i, j;
+
+    elapsed = (curr->time_ns - prev->time_ns) / 1e9;
+
+    printf("--- pid %d, %.2fs ---\n", segment->pid, elapsed);
+    printf("%-24s %16s %14s\n", "counter", "total", "per second");
+
+    for (i = 0; i < CRSTAT_NCOUNTERS; i++)
+        printf("%-24s %16lu %14.1f\n", crstat_counter_names[i], 
+               curr->counters[i], 
+               (curr->counters[i] - prev->counters[i]) / elapsed);
+
+    printf("%-24s %16s\n", "gauge", "value");
+
+    for (i = 0; i < CRSTAT_NGAUGES; i++)
+        printf("%-24s %16ld\n", crstat_gauge_names[i], segment->gauges[i]);
+
+    printf("%-24s %16s %14s %14s\n", "histogram", "count", "p50 <=", "p99 <=");
+
+    for (i = 0; i < CRSTAT_NHISTOGRAMS; i++)
+    {
+        total = 0;
+        for (j = 0; j < CRSTAT_NBUCKETS; j++)
+        {
+            delta[j] = curr->histograms[i][j] - prev->histograms[i][j];
+            total += delta[j];
+        }
+
+        printf("%-24s %16lu %14lu %14lu\n", crstat_histogram_names[i], total,
+               crstat_quantile(delta, total, 0.50), 
+               crstat_quantile(delta, total, 0.99));
+    }
+
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    struct crstat_sample samples[2];
+    struct crstat_segment *segment;
+    long interval, count, i;
+    pid_t pid;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <pid> [interval-seconds] [count]\n", 
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    pid = atoi(argv[1]);
+    interval = argc > 2 ? atol(argv[2]) : DEFAULT_INTERVAL;
+    count = argc > 3 ? atol(argv[3]) : -1;
+
+    if (interval <= 0)
+        interval = DEFAULT_INTERVAL;
+
+    segment = crstat_attach(pid);
+    if (segment == NULL)
+    {
+        fprintf(stderr, "%s: process %d does not publish statistics\n", 
+                argv[0], pid);
+        return EXIT_FAILURE;
+    }
+
+    crstat_take_sample(segment, &samples[0]);
+
+    for (i = 0; count < 0 || i < count; i++)
+    {
+        sleep(interval);
+
+        /* stop once the process is gone */
+        if (kill(pid, 0) == -1)
+            break;
+
+        crstat_take_sample(segment, &samples[(i + 1) % 2]);
+        crstat_print(segment, &samples[i % 2], &samples[(i + 1) % 2]);
+    }
+
+    crstat_detach(segment);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+#include "crashsched.h"
+#include "crstat.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <assert.h>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+const char *const crashsched_names[CRASHSCHED_NSCHEDULES] = {
+    "periodic", "exponential", "during_commit"
+};
+
+/** Delay after a (re)start before [schedule] considers killing the child. */
+unsigned int crashsched_delay_us(enum crashsched schedule, 
+                                 unsigned int length_us)
+{
+    if (schedule == CRASHSCHED_EXPONENTIAL)
+        return (unsigned int)(-log(1.0 - drand48()) * length_us);
+
+    return length_us;
+}
+
+/**
+ * Waits for the kill [schedule] to come due on the freshly (re)started [child].
+ * Returns true once the child should be killed, or false if it exited first,
+ * in which case it has been reaped and its wait status stored in [status].
+ */
+bool crashsched_wait(enum crashsched schedule, unsigned int length_us, 
+                     pid_t child, int *status)
+{
+    struct crstat_segment *segment = NULL;
+    uint64_t deadline;
+    bool due = false;
+    pid_t rc;
+
+    deadline = crstat_now_ns() 
+             + crashsched_delay_us(schedule, length_us) * 1000ull;
+
+    while (!due)
+    {
+        rc = waitpid(child, status, WNOHANG);
+        if (rc == child)
+            break;
+
+        assert(rc == 0 || errno == EINTR);
+
+        if (crstat_now_ns() >= deadline)
+        {
+            if (schedule != CRASHSCHED_DURING_COMMIT)
+                due = true;
+            else if (segment != NULL || (segment = crstat_attach(child)))
+                due = segment->gauges[CRSTAT_COMMITTING] != 0;
+        }
+
+        if (!due)
+            usleep(CRASHSCHED_POLL_US);
+    }
+
+    if (segment != NULL)
+        crstat_detach(segment);
+
+    return due;
+}
+
+/** Kills and reaps [child], cleaning up what it could not on its way out. */
+void crashsched_kill(pid_t child)
+{
+    int status;
+
+    kill(child, SIGKILL);
+    while (waitpid(child, &status, 0) == -1)
+        assert(errno == EINTR);
+
+    crstat_remove(child);
+}
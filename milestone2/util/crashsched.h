@@ -0,0 +1,38 @@
+#ifndef __CRASHSCHED_H__
+#define __CRASHSCHED_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define CRASHSCHED_POLL_US      100
+
+/**
+ * Schedules on which a child process running checkpointed work is killed, for
+ * crash tests and the recovery benchmark. [length_us] sets the scale of each:
+ * 
+ *  - [CRASHSCHED_PERIODIC] kills [length_us] after every (re)start.
+ *  - [CRASHSCHED_EXPONENTIAL] kills after exponentially distributed delays 
+ *    with a mean of [length_us], as independent failures would arrive. Delays
+ *    are drawn from [drand48()], so seed it for repeatable schedules.
+ *  - [CRASHSCHED_DURING_COMMIT] waits [length_us], then kills as soon as the
+ *    child's checkpoint worker is observed in the middle of a commit, using 
+ *    the gauge the child publishes through crstat.
+ */
+enum crashsched
+{
+    CRASHSCHED_PERIODIC,
+    CRASHSCHED_EXPONENTIAL,
+    CRASHSCHED_DURING_COMMIT,
+    CRASHSCHED_NSCHEDULES
+};
+
+extern const char *const crashsched_names[CRASHSCHED_NSCHEDULES];
+
+unsigned int crashsched_delay_us(enum crashsched schedule, 
+                                 unsigned int length_us);
+
+bool crashsched_wait(enum crashsched schedule, unsigned int length_us, 
+                     pid_t child, int *status);
+void crashsched_kill(pid_t child);
+
+#endif
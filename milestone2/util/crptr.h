@@ -0,0 +1,51 @@
+#ifndef __CRPTR_H__
+#define __CRPTR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Self-relative pointers, for links kept inside the persistent heap. A [crptr]
+ * holds the distance from its own address to its target, with 0 standing for
+ * NULL. A link between two objects of the heap then stays valid wherever the
+ * heap is mapped, as long as both ends move together - which is what lets a
+ * relocatable heap (see [nvstore_init_relocatable()]) be restored at another
+ * address than the one it was saved from.
+ *
+ * Two rules follow from the encoding:
+ *
+ *  1.) A [crptr] must never be copied by value to another location, as the
+ *      copy would then point elsewhere. Read it with [crptr_get()] and store
+ *      the pointer again with [crptr_set()].
+ *
+ *  2.) A [crptr] cannot point at itself, as that distance encodes NULL.
+ */
+typedef intptr_t crptr;
+
+/** Reads the pointer stored in [ptr]. */
+static inline void *crptr_get(const volatile crptr *ptr)
+{
+    crptr offset = *ptr;
+
+    return offset == 0 ? NULL : (uint8_t *)ptr + offset;
+}
+
+/** Encodes [addr] as it would be stored in [ptr], for atomic updates. */
+static inline crptr crptr_encode(const volatile crptr *ptr, const void *addr)
+{
+    return addr == NULL ? 0 : (uint8_t *)addr - (uint8_t *)ptr;
+}
+
+/** Makes [ptr] point to [addr]. */
+static inline void crptr_set(volatile crptr *ptr, const void *addr)
+{
+    *ptr = crptr_encode(ptr, addr);
+}
+
+/** Decodes [offset] as if it had been read from [ptr]. */
+static inline void *crptr_decode(const volatile crptr *ptr, crptr offset)
+{
+    return offset == 0 ? NULL : (uint8_t *)ptr + offset;
+}
+
+#endif
@@ -0,0 +1,296 @@
+#include "crstat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <pthread.h>
+
+/******************************************************************************/
+/** Macros, Definitions, and Static Variables: crstat ----------------------- */
+/******************************************************************************/
+#define CRSTAT_SHM_NAMELEN      32
+
+const char *const crstat_counter_names[CRSTAT_NCOUNTERS] = {
+    "faults", "wpfaults", "zerofaults", "pages_dirtied", "commits", 
+    "bytes_written", "pages_released", "heap_restores", "thread_checkpoints", "thread_restores", 
+    "thread_preemptions", "allocs", "frees"
+};
+
+const char *const crstat_gauge_names[CRSTAT_NGAUGES] = {
+    "dirty_pages", "freelist_len", "committing"
+};
+
+const char *const crstat_histogram_names[CRSTAT_NHISTOGRAMS] = {
+    "fault_ns", "commit_ns", "commit_bytes", "commit_batch", "fsync_ns", 
+    "restore_ns", "thread_checkpoint_ns", "thread_stack_bytes"
+};
+
+/** segment used until (or if) the shared one cannot be created */
+static struct crstat_segment s_private;
+static struct crstat_segment *volatile s_segment = &s_private;
+
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static pthread_key_t s_slotkey;
+static char s_shmname[CRSTAT_SHM_NAMELEN];
+
+/** slot claimed by the calling thread, and the segment it was claimed in */
+static __thread struct crstat_thread *t_slot;
+static __thread struct crstat_segment *t_segment;
+
+/******************************************************************************/
+/** Private Implementation: crstat ------------------------------------------ */
+/******************************************************************************/
+
+/** Hands the slot of an exiting thread back to the segment. */
+static void __crstat_release_slot(void *slot_vp)
+{
+    struct crstat_thread *slot = slot_vp;
+
+    __atomic_store_n(&slot->tid, 0, __ATOMIC_RELEASE);
+}
+
+/** Removes the segment at exit, unless it was inherited from a parent. */
+static void __crstat_unlink()
+{
+    if (s_segment->pid == getpid())
+        shm_unlink(s_shmname);
+}
+
+/**
+ * Creates and maps the shared segment, over the [inherited] mapping unless it
+ * is NULL, switching all threads over to it.
+ */
+static void __crstat_create(struct crstat_segment *inherited)
+{
+    struct crstat_segment *segment;
+    int fd;
+
+    /* should the segment not be created, keep the private one for good */
+    s_private.pid = getpid();
+    s_segment = &s_private;
+
+    snprintf(s_shmname, sizeof(s_shmname), CRSTAT_SHM_NAME, getpid());
+
+    fd = shm_open(s_shmname, O_CREAT | O_TRUNC | O_RDWR, 0600);
+    if (fd == -1)
+        return;
+
+    if (ftruncate(fd, sizeof(*segment)) == -1)
+    {
+        close(fd);
+        shm_unlink(s_shmname);
+        return;
+    }
+
+    segment = mmap(inherited, sizeof(*segment), PROT_READ | PROT_WRITE, 
+                   MAP_SHARED | (inherited != NULL ? MAP_FIXED : 0), fd, 0);
+    close(fd);
+
+    if (segment == MAP_FAILED)
+    {
+        shm_unlink(s_shmname);
+        return;
+    }
+
+    segment->pid = getpid();
+    __atomic_store_n(&segment->magic, CRSTAT_MAGIC, __ATOMIC_RELEASE);
+
+    s_segment = segment;
+}
+
+static void __crstat_init_once()
+{
+    pthread_key_create(&s_slotkey, __crstat_release_slot);
+    atexit(__crstat_unlink);
+
+    __crstat_create(NULL);
+}
+
+/** Returns the slot of the calling thread, claiming one if necessary. */
+static struct crstat_thread *__crstat_slot()
+{
+    struct crstat_segment *segment;
+    pid_t tid, unclaimed;
+    size_t i;
+
+    segment = s_segment;
+    if (t_segment == segment)
+        return t_slot;
+
+    tid = syscall(SYS_gettid);
+    t_slot = &segment->threads[CRSTAT_MAX_THREADS - 1];
+
+    /* out of slots, the last one is shared - atomics keep it consistent */
+    for (i = 0; i < CRSTAT_MAX_THREADS; i++)
+    {
+        unclaimed = 0;
+        if (__atomic_compare_exchange_n(&segment->threads[i].tid, &unclaimed, 
+                                        tid, false, __ATOMIC_ACQUIRE, 
+                                        __ATOMIC_RELAXED))
+        {
+            t_slot = &segment->threads[i];
+            break;
+        }
+    }
+
+    t_segment = segment;
+    if (segment != &s_private)
+        pthread_setspecific(s_slotkey, t_slot);
+
+    return t_slot;
+}
+
+/******************************************************************************/
+/** Public-Facing API: crstat ----------------------------------------------- */
+/******************************************************************************/
+
+/**
+ * Publishes the statistics of this process in shared memory. Safe to call any
+ * number of times. The segment is removed when the process exits normally.
+ * 
+ * A child forked after initialization keeps adding to its parent's segment 
+ * until it calls this itself, upon which it publishes a fresh segment of its 
+ * own.
+ */
+void crstat_init()
+{
+    struct crstat_segment *inherited;
+
+    pthread_once(&s_once, __crstat_init_once);
+
+    inherited = s_segment;
+    if (inherited->pid == getpid())
+        return;
+
+    /* replace the parent's mapping in place rather than opening a new hole */
+    __crstat_create(inherited != &s_private ? inherited : NULL);
+
+    if (inherited != &s_private && inherited != s_segment)
+        munmap(inherited, sizeof(*inherited));
+}
+
+void crstat_add(enum crstat_counter counter, uint64_t n)
+{
+    __atomic_fetch_add(&__crstat_slot()->counters[counter], n, 
+                       __ATOMIC_RELAXED);
+}
+
+void crstat_set(enum crstat_gauge gauge, int64_t value)
+{
+    __atomic_store_n(&s_segment->gauges[gauge], value, __ATOMIC_RELAXED);
+}
+
+void crstat_record(enum crstat_histogram histogram, uint64_t value)
+{
+    __atomic_fetch_add(&__crstat_slot()->histograms[histogram]
+                                                   [crstat_bucket(value)], 
+                       1, __ATOMIC_RELAXED);
+}
+
+/** Current time on the clock used for every latency statistic. */
+uint64_t crstat_now_ns()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/** Histogram bucket of [value], see [struct crstat_thread]. */
+size_t crstat_bucket(uint64_t value)
+{
+    size_t bucket;
+
+    bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+    return bucket < CRSTAT_NBUCKETS ? bucket : CRSTAT_NBUCKETS - 1;
+}
+
+/** The segment this process publishes to. */
+struct crstat_segment *crstat_self()
+{
+    return s_segment;
+}
+
+/**
+ * Maps the segment published by process [pid] read-only. Returns NULL if the
+ * process does not publish statistics.
+ */
+struct crstat_segment *crstat_attach(pid_t pid)
+{
+    char shmname[CRSTAT_SHM_NAMELEN];
+    struct crstat_segment *segment;
+    int fd;
+
+    snprintf(shmname, sizeof(shmname), CRSTAT_SHM_NAME, pid);
+
+    fd = shm_open(shmname, O_RDONLY, 0);
+    if (fd == -1)
+        return NULL;
+
+    segment = mmap(NULL, sizeof(*segment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (segment == MAP_FAILED)
+        return NULL;
+
+    if (__atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) != CRSTAT_MAGIC)
+    {
+        munmap(segment, sizeof(*segment));
+        return NULL;
+    }
+
+    return segment;
+}
+
+void crstat_detach(struct crstat_segment *segment)
+{
+    munmap(segment, sizeof(*segment));
+}
+
+/** Removes the segment left behind by [pid] if it was killed before exit. */
+void crstat_remove(pid_t pid)
+{
+    char shmname[CRSTAT_SHM_NAMELEN];
+
+    snprintf(shmname, sizeof(shmname), CRSTAT_SHM_NAME, pid);
+    shm_unlink(shmname);
+}
+
+/** Sums a counter over every thread which ever published to [segment]. */
+uint64_t crstat_sum_counter(struct crstat_segment *segment, 
+                            enum crstat_counter counter)
+{
+    uint64_t sum = 0;
+    size_t i;
+
+    for (i = 0; i < CRSTAT_MAX_THREADS; i++)
+        sum += __atomic_load_n(&segment->threads[i].counters[counter], 
+                               __ATOMIC_RELAXED);
+
+    return sum;
+}
+
+/** Sums a histogram over every thread which ever published to [segment]. */
+void crstat_sum_histogram(struct crstat_segment *segment, 
+                          enum crstat_histogram histogram, 
+                          uint64_t buckets[CRSTAT_NBUCKETS])
+{
+    size_t i, j;
+
+    memset(buckets, 0, CRSTAT_NBUCKETS * sizeof(*buckets));
+
+    for (i = 0; i < CRSTAT_MAX_THREADS; i++)
+        for (j = 0; j < CRSTAT_NBUCKETS; j++)
+            buckets[j] += __atomic_load_n(
+                &segment->threads[i].histograms[histogram][j], 
+                __ATOMIC_RELAXED);
+}
@@ -0,0 +1,114 @@
+#ifndef __CRSTAT_H__
+#define __CRSTAT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define CRSTAT_MAGIC            0x3154415453524331ull   /* "1CRSTAT1"     */
+#define CRSTAT_SHM_NAME         "/crstat.%d"            /* formatted with pid */
+#define CRSTAT_MAX_THREADS      128
+#define CRSTAT_NBUCKETS         48
+
+/** Monotonically increasing event counters */
+enum crstat_counter
+{
+    CRSTAT_FAULTS,                  /* missing page faults serviced           */
+    CRSTAT_WPFAULTS,                /* write-protect faults serviced          */
+    CRSTAT_ZEROFAULTS,              /* read faults mapped to the zero page    */
+    CRSTAT_PAGES_DIRTIED,           /* pages added to the dirty set           */
+    CRSTAT_COMMITS,                 /* commits finished by the worker         */
+    CRSTAT_BYTES_WRITTEN,           /* bytes written to the heap file         */
+    CRSTAT_PAGES_RELEASED,          /* pages punched out of the heap file     */
+    CRSTAT_HEAP_RESTORES,           /* heaps restored from file on init       */
+    CRSTAT_THREAD_CHECKPOINTS,      /* threads checkpointed by resurrector    */
+    CRSTAT_THREAD_RESTORES,         /* threads restarted from a checkpoint    */
+    CRSTAT_THREAD_PREEMPTIONS,      /* threads checkpointed by their timer    */
+    CRSTAT_ALLOCS,                  /* calls to crmalloc()                    */
+    CRSTAT_FREES,                   /* calls to crfree()                      */
+    CRSTAT_NCOUNTERS
+};
+
+/** Instantaneous values, owned by the whole process rather than a thread */
+enum crstat_gauge
+{
+    CRSTAT_DIRTY_PAGES,             /* pages currently in the dirty set       */
+    CRSTAT_FREELIST_LEN,            /* blocks on the crmalloc free list       */
+    CRSTAT_COMMITTING,              /* 1 while the worker is in a commit      */
+    CRSTAT_NGAUGES
+};
+
+/** Distributions, kept as log2 histograms */
+enum crstat_histogram
+{
+    CRSTAT_FAULT_NS,                /* fault service latency                  */
+    CRSTAT_COMMIT_NS,               /* commit latency                         */
+    CRSTAT_COMMIT_BYTES,            /* bytes written per commit               */
+    CRSTAT_COMMIT_BATCH,            /* checkpoints written per commit         */
+    CRSTAT_FSYNC_NS,                /* fsync latency                          */
+    CRSTAT_RESTORE_NS,              /* heap restore time on init              */
+    CRSTAT_THREAD_CHECKPOINT_NS,    /* thread exit to restart in resurrector  */
+    CRSTAT_THREAD_STACK_BYTES,      /* live stack bytes per thread checkpoint */
+    CRSTAT_NHISTOGRAMS
+};
+
+/**
+ * Statistics of one thread. A thread claims a free slot on its first update,
+ * and only that thread writes to it until it exits, at which point the slot 
+ * (and its accumulated counts) is handed to the next thread which needs one.
+ * 
+ * Bucket 0 of a histogram counts zeroes, and bucket k counts values in the 
+ * range [2^(k-1), 2^k).
+ */
+struct crstat_thread
+{
+    volatile pid_t tid;             /* owning thread, or 0 if unclaimed       */
+    volatile uint64_t counters[CRSTAT_NCOUNTERS];
+    volatile uint64_t histograms[CRSTAT_NHISTOGRAMS][CRSTAT_NBUCKETS];
+} __attribute__((aligned(64)));
+
+/**
+ * Runtime statistics published in a POSIX shared memory segment named after 
+ * the process, which the crstat tool attaches to. All updates are lock-free: 
+ * each thread only touches its own slot, with relaxed atomic additions so that
+ * a background checkpoint's child, which inherits its parent's slot, can 
+ * safely add to it as well. Readers sum the slots of all threads.
+ * 
+ * Updates made before [crstat_init()] land in a private segment and are never
+ * published.
+ */
+struct crstat_segment
+{
+    uint64_t magic;                 /* CRSTAT_MAGIC once fully initialized    */
+    pid_t pid;                      /* publishing process                     */
+    volatile int64_t gauges[CRSTAT_NGAUGES];
+    struct crstat_thread threads[CRSTAT_MAX_THREADS];
+};
+
+extern const char *const crstat_counter_names[CRSTAT_NCOUNTERS];
+extern const char *const crstat_gauge_names[CRSTAT_NGAUGES];
+extern const char *const crstat_histogram_names[CRSTAT_NHISTOGRAMS];
+
+/** Publishing side */
+void crstat_init();
+
+void crstat_add(enum crstat_counter counter, uint64_t n);
+void crstat_set(enum crstat_gauge gauge, int64_t value);
+void crstat_record(enum crstat_histogram histogram, uint64_t value);
+
+uint64_t crstat_now_ns();
+size_t crstat_bucket(uint64_t value);
+
+/** Reading side */
+struct crstat_segment *crstat_self();
+struct crstat_segment *crstat_attach(pid_t pid);
+void crstat_detach(struct crstat_segment *segment);
+void crstat_remove(pid_t pid);
+
+uint64_t crstat_sum_counter(struct crstat_segment *segment, 
+                            enum crstat_counter counter);
+void crstat_sum_histogram(struct crstat_segment *segment, 
+                          enum crstat_histogram histogram, 
+                          uint64_t buckets[CRSTAT_NBUCKETS]);
+
+#endif
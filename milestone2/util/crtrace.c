@@ -0,0 +1,256 @@
+#include "crtrace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <syscall.h>
+#include <sys/mman.h>
+
+#include <pthread.h>
+
+/******************************************************************************/
+/** Macros, Definitions, and Static Variables: crtrace ---------------------- */
+/******************************************************************************/
+volatile bool crtrace_enabled = false;
+
+static const char *const s_pointnames[CRTRACE_NPOINTS] = {
+    "fault", "commit", "commit_queued", "thread_exit", "thread_restore", 
+    "crmalloc_slowpath"
+};
+
+static struct crtrace_ring *volatile s_rings[CRTRACE_MAX_RINGS];
+static volatile size_t s_nrings;
+
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static pthread_key_t s_ringkey;
+
+/** ring of the calling thread, NULL until its first event */
+static __thread struct crtrace_ring *t_ring;
+static __thread bool t_noring;
+
+/******************************************************************************/
+/** Private Implementation: crtrace ----------------------------------------- */
+/******************************************************************************/
+
+/** Hands the ring of an exiting thread over to the next thread. */
+static void __crtrace_release_ring(void *ring_vp)
+{
+    struct crtrace_ring *ring = ring_vp;
+
+    __atomic_store_n(&ring->owner, 0, __ATOMIC_RELEASE);
+}
+
+static void __crtrace_init_key()
+{
+    pthread_key_create(&s_ringkey, __crtrace_release_ring);
+}
+
+/**
+ * Claims a released ring or creates a new one for the calling thread. Threads
+ * beyond [CRTRACE_MAX_RINGS] live ones go untraced.
+ */
+static struct crtrace_ring *__crtrace_claim_ring()
+{
+    struct crtrace_ring *ring;
+    pid_t tid, unclaimed;
+    size_t i, nrings;
+
+    pthread_once(&s_once, __crtrace_init_key);
+    tid = syscall(SYS_gettid);
+
+    nrings = __atomic_load_n(&s_nrings, __ATOMIC_ACQUIRE);
+    for (i = 0; i < nrings; i++)
+    {
+        ring = s_rings[i];
+        unclaimed = 0;
+
+        if (ring != NULL 
+            && __atomic_compare_exchange_n(&ring->owner, &unclaimed, tid, 
+                                           false, __ATOMIC_ACQUIRE, 
+                                           __ATOMIC_RELAXED))
+            goto claimed;
+    }
+
+    i = __atomic_fetch_add(&s_nrings, 1, __ATOMIC_ACQ_REL);
+    if (i >= CRTRACE_MAX_RINGS)
+    {
+        __atomic_store_n(&s_nrings, CRTRACE_MAX_RINGS, __ATOMIC_RELEASE);
+        return NULL;
+    }
+
+    ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, 
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+        return NULL;
+
+    ring->owner = tid;
+    __atomic_store_n(&s_rings[i], ring, __ATOMIC_RELEASE);
+
+claimed:
+    pthread_setspecific(s_ringkey, ring);
+    return ring;
+}
+
+static struct crtrace_ring *__crtrace_ring()
+{
+    if (t_ring == NULL && !t_noring)
+    {
+        t_ring = __crtrace_claim_ring();
+        t_noring = t_ring == NULL;
+    }
+
+    return t_ring;
+}
+
+/** Writes a JSON string, escaping what needs to be escaped. */
+static void __crtrace_write_string(FILE *file, const char *str)
+{
+    fputc('"', file);
+
+    for (; *str != '\0'; str++)
+    {
+        if (*str == '"' || *str == '\\')
+            fputc('\\', file);
+        if ((unsigned char)*str >= 0x20)
+            fputc(*str, file);
+    }
+
+    fputc('"', file);
+}
+
+/** Writes every event of one ring, oldest first. */
+static void __crtrace_write_ring(FILE *file, struct crtrace_ring *ring, 
+                                 pid_t pid, bool *first)
+{
+    struct crtrace_event *event;
+    uint64_t head, i;
+
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    i = head > CRTRACE_RING_SIZE ? head - CRTRACE_RING_SIZE : 0;
+
+    if (ring->name[0] != '\0')
+    {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                      "\"tid\":%d,\"args\":{\"name\":", 
+                *first ? "" : ",\n", pid, ring->nametid);
+        __crtrace_write_string(file, ring->name);
+        fprintf(file, "}}");
+        *first = false;
+    }
+
+    for (; i < head; i++)
+    {
+        event = &ring->events[i & (CRTRACE_RING_SIZE - 1)];
+
+        fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"cr\",\"ph\":\"%c\","
+                      "\"ts\":%lu.%03lu,\"pid\":%d,\"tid\":%d", 
+                *first ? "" : ",\n", s_pointnames[event->point], 
+                event->phase, event->ts / 1000, event->ts % 1000, pid, 
+                event->tid);
+
+        if (event->phase == CRTRACE_FLOW_START 
+            || event->phase == CRTRACE_FLOW_END)
+            fprintf(file, ",\"id\":\"0x%lx\"%s", event->arg, 
+                    event->phase == CRTRACE_FLOW_END ? ",\"bp\":\"e\"" : "");
+        else if (event->phase == CRTRACE_INSTANT)
+            fprintf(file, ",\"s\":\"t\",\"args\":{\"arg\":\"0x%lx\"}", 
+                    event->arg);
+        else if (event->phase == CRTRACE_BEGIN)
+            fprintf(file, ",\"args\":{\"arg\":\"0x%lx\"}", event->arg);
+
+        fprintf(file, "}");
+        *first = false;
+    }
+}
+
+/******************************************************************************/
+/** Public-Facing API: crtrace ---------------------------------------------- */
+/******************************************************************************/
+
+/** Turns recording at the trace points on or off. Off by default. */
+void crtrace_enable(bool enabled)
+{
+    crtrace_enabled = enabled;
+}
+
+/** Records an event in the calling thread's ring. Use [CRTRACE()] instead. */
+void crtrace_record(enum crtrace_point point, enum crtrace_phase phase, 
+                    uint64_t arg)
+{
+    struct crtrace_event *event;
+    struct crtrace_ring *ring;
+    struct timespec now;
+
+    ring = __crtrace_ring();
+    if (ring == NULL)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    event = &ring->events[ring->head & (CRTRACE_RING_SIZE - 1)];
+    event->ts = now.tv_sec * 1000000000ull + now.tv_nsec;
+    event->arg = arg;
+    event->tid = ring->owner;
+    event->point = point;
+    event->phase = phase;
+
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+/** Names the calling thread on the exported timeline. */
+void crtrace_name_thread(const char *name)
+{
+    struct crtrace_ring *ring;
+
+    ring = __crtrace_ring();
+    if (ring == NULL)
+        return;
+
+    strncpy(ring->name, name, CRTRACE_NAMELEN - 1);
+    ring->name[CRTRACE_NAMELEN - 1] = '\0';
+    ring->nametid = ring->owner;
+}
+
+/**
+ * Writes the events of every ring to [path] in the Chrome trace event format,
+ * which chrome://tracing and Perfetto both load. Rings are read while their 
+ * owners may still be recording, so the oldest events of a busy ring can be 
+ * overwritten mid-export; stop tracing first for an exact dump.
+ * 
+ * Returns 0 on success or -1 if the file could not be written.
+ */
+int crtrace_export_chrome(const char *path)
+{
+    struct crtrace_ring *ring;
+    size_t i, nrings;
+    bool first = true;
+    FILE *file;
+    pid_t pid;
+
+    file = fopen(path, "w");
+    if (file == NULL)
+        return -1;
+
+    pid = getpid();
+    nrings = __atomic_load_n(&s_nrings, __ATOMIC_ACQUIRE);
+    if (nrings > CRTRACE_MAX_RINGS)
+        nrings = CRTRACE_MAX_RINGS;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    for (i = 0; i < nrings; i++)
+    {
+        ring = __atomic_load_n(&s_rings[i], __ATOMIC_ACQUIRE);
+        if (ring != NULL)
+            __crtrace_write_ring(file, ring, pid, &first);
+    }
+
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0)
+        return -1;
+
+    return 0;
+}
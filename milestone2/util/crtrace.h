@@ -0,0 +1,80 @@
+#ifndef __CRTRACE_H__
+#define __CRTRACE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define CRTRACE_RING_SIZE       4096    /* events per ring, a power of two    */
+#define CRTRACE_MAX_RINGS       256
+#define CRTRACE_NAMELEN         16
+
+/** Instrumented points of the framework */
+enum crtrace_point
+{
+    CRTRACE_FAULT,                  /* uffd fault, received to resolved       */
+    CRTRACE_COMMIT,                 /* commit, started to finished on worker  */
+    CRTRACE_COMMIT_QUEUED,          /* flow from submission to commit start   */
+    CRTRACE_THREAD_EXIT,            /* resurrector joined a checkpointing one */
+    CRTRACE_THREAD_RESTORE,         /* resurrector commit and restart         */
+    CRTRACE_CRMALLOC_SLOWPATH,      /* crmalloc() had to grow the heap        */
+    CRTRACE_NPOINTS
+};
+
+/**
+ * Event phases, named after the Chrome trace event format: slices begin and
+ * end, instants stand alone, and flows link an event on one thread to the 
+ * slice which picks it up on another.
+ */
+enum crtrace_phase
+{
+    CRTRACE_BEGIN       = 'B',
+    CRTRACE_END         = 'E',
+    CRTRACE_INSTANT     = 'i',
+    CRTRACE_FLOW_START  = 's',
+    CRTRACE_FLOW_END    = 'f',
+};
+
+struct crtrace_event
+{
+    uint64_t ts;                    /* CLOCK_MONOTONIC, in nanoseconds        */
+    uint64_t arg;                   /* address or flow id                     */
+    pid_t tid;                      /* thread which recorded the event        */
+    uint16_t point;
+    char phase;
+};
+
+/**
+ * A single producer ring of the most recent events of one thread. The owning
+ * thread writes the slot at [head] and then publishes it by advancing [head],
+ * so recording never takes a lock. Like crstat slots, a ring is handed over to
+ * another thread once its owner exits - events keep the id of the thread which
+ * recorded them, so the history of the previous owner stays valid until it is
+ * overwritten.
+ */
+struct crtrace_ring
+{
+    volatile uint64_t head;         /* number of events ever recorded         */
+    volatile pid_t owner;           /* owning thread, or 0 if unclaimed       */
+    char name[CRTRACE_NAMELEN];     /* name of a thread, if it has one        */
+    pid_t nametid;                  /* thread which [name] belongs to         */
+    struct crtrace_event events[CRTRACE_RING_SIZE];
+};
+
+/** Checked at every trace point, so tracing is a single branch when off. */
+extern volatile bool crtrace_enabled;
+
+#define CRTRACE(POINT, PHASE, ARG)                                            \
+    do {                                                                      \
+        if (crtrace_enabled)                                                  \
+            crtrace_record((POINT), (PHASE), (uint64_t)(ARG));                \
+    } while (0)
+
+void crtrace_enable(bool enabled);
+void crtrace_record(enum crtrace_point point, enum crtrace_phase phase, 
+                    uint64_t arg);
+void crtrace_name_thread(const char *name);
+
+int crtrace_export_chrome(const char *path);
+
+#endif
@@ -31,42 +31,72 @@
  * checking on some operations, which can be valuable.) 
  */
 
+/**
+ * Links are [crptr]s, relative to the element holding them, so that lists kept
+ * in the persistent heap survive the heap being mapped elsewhere. They are only
+ * ever read and written through the four helpers below.
+ */
+
+/* Returns the element before ELEM, or NULL for a head. */
+static inline struct list_elem *prev_of(const struct list_elem *elem)
+{
+    return crptr_get(&elem->prev);
+}
+
+/* Returns the element after ELEM, or NULL for a tail. */
+static inline struct list_elem *next_of(const struct list_elem *elem)
+{
+    return crptr_get(&elem->next);
+}
+
+/* Links ELEM to PREV, which may be NULL. */
+static inline void set_prev(struct list_elem *elem, struct list_elem *prev)
+{
+    crptr_set(&elem->prev, prev);
+}
+
+/* Links ELEM to NEXT, which may be NULL. */
+static inline void set_next(struct list_elem *elem, struct list_elem *next)
+{
+    crptr_set(&elem->next, next);
+}
+
 static bool is_sorted(struct list_elem *a, struct list_elem *b,
                       list_less_func *less, void *aux);
 
 /* Returns true if ELEM is a head, false otherwise. */
 static inline bool is_head(struct list_elem *elem)
 {
-    return elem != NULL && elem->prev == NULL && elem->next != NULL;
+    return elem != NULL && elem->prev == 0 && elem->next != 0;
 }
 
 /* Returns true if ELEM is an interior element, false otherwise. */
 static inline bool is_interior(struct list_elem *elem)
 {
-    return elem != NULL && elem->prev != NULL && elem->next != NULL;
+    return elem != NULL && elem->prev != 0 && elem->next != 0;
 }
 
 /* Returns true if ELEM is a tail, false otherwise. */
 static inline bool is_tail(struct list_elem *elem)
 {
-    return elem != NULL && elem->prev != NULL && elem->next == NULL;
+    return elem != NULL && elem->prev != 0 && elem->next == 0;
 }
 
 /* Initializes LIST as an empty list. */
 void list_init(struct list *list)
 {
     assert(list != NULL);
-    list->head.prev = NULL;
-    list->head.next = &list->tail;
-    list->tail.prev = &list->head;
-    list->tail.next = NULL;
+    set_prev(&list->head, NULL);
+    set_next(&list->head, &list->tail);
+    set_prev(&list->tail, &list->head);
+    set_next(&list->tail, NULL);
 }
 
 /* Returns the beginning of LIST. */
 struct list_elem *list_begin(struct list *list)
 {
     assert(list != NULL);
-    return list->head.next;
+    return next_of(&list->head);
 }
 
 /**
@@ -77,7 +107,7 @@ struct list_elem *list_begin(struct list *list)
 struct list_elem *list_next(struct list_elem *elem)
 {
     assert(is_head(elem) || is_interior(elem));
-    return elem->next;
+    return next_of(elem);
 }
 
 /**
@@ -97,7 +127,7 @@ struct list_elem *list_end(struct list *list)
 struct list_elem *list_rbegin(struct list *list) 
 {
     assert(list != NULL);
-    return list->tail.prev;
+    return prev_of(&list->tail);
 }
 
 /**
@@ -108,7 +138,7 @@ struct list_elem *list_rbegin(struct list *list)
 struct list_elem *list_prev(struct list_elem *elem)
 {
     assert(is_interior(elem) || is_tail(elem));
-    return elem->prev;
+    return prev_of(elem);
 }
 
 /**
@@ -164,10 +194,10 @@ void list_insert(struct list_elem *before, struct list_elem *elem)
     assert(is_interior(before) || is_tail(before));
     assert(elem != NULL);
 
-    elem->prev = before->prev;
-    elem->next = before;
-    before->prev->next = elem;
-    before->prev = elem;
+    set_prev(elem, prev_of(before));
+    set_next(elem, before);
+    set_next(prev_of(before), elem);
+    set_prev(before, elem);
 }
 
 /**
@@ -187,14 +217,14 @@ void list_splice(struct list_elem *before, struct list_elem *first,
     assert(is_interior(last));
 
     /* Cleanly remove FIRST...LAST from its current list. */
-    first->prev->next = last->next;
-    last->next->prev = first->prev;
+    set_next(prev_of(first), next_of(last));
+    set_prev(next_of(last), prev_of(first));
 
     /* Splice FIRST...LAST into new list. */
-    first->prev = before->prev;
-    last->next = before;
-    before->prev->next = first;
-    before->prev = last;
+    set_prev(first, prev_of(before));
+    set_next(last, before);
+    set_next(prev_of(before), first);
+    set_prev(before, last);
 }
 
 /* 
@@ -245,10 +275,12 @@ void list_push_back(struct list *list, struct list_elem *elem)
  */
 struct list_elem *list_remove(struct list_elem *elem)
 {
+    struct list_elem *prev = prev_of(elem), *next = next_of(elem);
+
     assert(is_interior(elem));
-    elem->prev->next = elem->next;
-    elem->next->prev = elem->prev;
-    return elem->next;
+    set_next(prev, next);
+    set_prev(next, prev);
+    return next;
 }
 
 /**
@@ -277,14 +309,14 @@ struct list_elem *list_pop_back(struct list *list)
 struct list_elem *list_front(struct list *list)
 {
     assert(!list_empty(list));
-    return list->head.next;
+    return next_of(&list->head);
 }
 
 /* Returns the back element in LIST. Undefined behavior if LIST is empty. */
 struct list_elem *list_back(struct list *list)
 {
     assert(!list_empty(list));
-    return list->tail.prev;
+    return prev_of(&list->tail);
 }
 
 /**
@@ -307,12 +339,12 @@ bool list_empty(struct list *list)
     return list_begin(list) == list_end(list);
 }
 
-/* Swaps the `struct list_elem *'s that A and B point to. */
-static void swap(struct list_elem **a, struct list_elem **b) 
+/* Swaps the links of ELEM. */
+static void swap(struct list_elem *elem) 
 {
-    struct list_elem *t = *a;
-    *a = *b;
-    *b = t;
+    struct list_elem *t = prev_of(elem);
+    set_prev(elem, next_of(elem));
+    set_next(elem, t);
 }
 
 /* Reverses the order of LIST. */
@@ -320,12 +352,15 @@ void list_reverse(struct list *list)
 {
     if (!list_empty(list)) 
     {
+        struct list_elem *front = list_front(list), *back = list_back(list);
         struct list_elem *e;
 
-        for (e = list_begin(list); e != list_end(list); e = e->prev)
-            swap (&e->prev, &e->next);
-        swap(&list->head.next, &list->tail.prev);
-        swap(&list->head.next->prev, &list->tail.prev->next);
+        for (e = front; e != list_end(list); e = prev_of(e))
+            swap(e);
+        set_next(&list->head, back);
+        set_prev(&list->tail, front);
+        set_prev(back, &list->head);
+        set_next(front, &list->tail);
     }
 }
 
@@ -75,15 +75,21 @@
  *     real list element. An empty list does not have any interior elements.
  */
 
+#include "crptr.h"
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
-/* List element. */
+/**
+ * List element. Links are self-relative (see crptr.h), so that a list kept in
+ * the persistent heap stays linked wherever the heap is mapped. Elements and 
+ * lists must therefore never be copied by value.
+ */
 struct list_elem 
 {
-    struct list_elem *prev;     /* Previous list element. */
-    struct list_elem *next;     /* Next list element. */
+    crptr prev;                 /* Previous list element. */
+    crptr next;                 /* Next list element. */
 };
 
 /* List. */
@@ -47,7 +47,7 @@ void run_concurrent_test(struct checkpoint_tester *tester,
     int nprint, ndot, status;
     size_t ncrash;
 
-    pid_t child, waitrc;
+    pid_t child;
 
     printf(ANSI_COLOR_YELLOW "[TEST] " ANSI_COLOR_RESET);
     nprint = snprintf(buffer, BUFSIZE - 1, "%s: %s", name, description);
@@ -75,17 +75,13 @@ void run_concurrent_test(struct checkpoint_tester *tester,
         }
         else
         {
-            usleep(tester->crash_length_us);
-            waitrc = waitpid(child, &status, WNOHANG);
-
             /* If execution done, exit crash loop. Otherwise, kill / restart */
-            if (waitrc == child)
+            if (!crashsched_wait(tester->crash_schedule, 
+                                 tester->crash_length_us, child, &status))
                 break;
-            else
-            {
-                printf("Killing...\n");
-                kill(child, SIGKILL);
-            }
+
+            printf("Killing...\n");
+            crashsched_kill(child);
         }
     }
 
@@ -10,6 +10,7 @@
 #define ANSI_COLOR_RESET    "\x1b[0m"
 
 #include <stddef.h>
+#include "crashsched.h"
 
 #define CRASH_FOREVER   (0xFFFFFFFF)
 #define CRASH_INTERVAL  (1000000)
@@ -23,6 +24,7 @@ struct checkpoint_tester
 
     size_t num_allowed_crashes;
     unsigned int crash_length_us;
+    enum crashsched crash_schedule;
 };
 
 void run_test(const char *(*test)(), const char *name, const char *description);
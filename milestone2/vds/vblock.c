@@ -3,6 +3,8 @@
 
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/falloc.h>
 
 #include <assert.h>
 #include <alloca.h>
@@ -11,11 +13,11 @@
 #include <stddef.h>
 #include <stdio.h>
 
-struct vblock *vblock_new(void *pgaddr, size_t npages, off_t offset)
+/** Sets up the bookkeeping of a block mapped at [pgstart]. */
+static struct vblock *__vblock_init(void *pgstart, size_t npages, off_t offset)
 {
     struct vblock *block = NULL;
 
-    assert(npages > 0);
     block = mcmalloc(sizeof(*block));
 
     block->offset = offset;
@@ -23,22 +25,75 @@ struct vblock *vblock_new(void *pgaddr, size_t npages, off_t offset)
         + sizeof(block->pgstart) + sizeof(block->npages);
 
     block->npages = npages;
-    block->pgstart = mcmmap(pgaddr, npages * sysconf(_SC_PAGE_SIZE), 
-                             PROT_READ | PROT_WRITE | PROT_EXEC, 
-                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    block->pgflags = mccalloc(npages, sizeof(*block->pgflags));
+    block->pgshadow = mccalloc(npages, sizeof(*block->pgshadow));
+    block->pgstart = pgstart;
+    block->nvaddr = pgstart;
+
+    return block;
+}
+
+struct vblock *vblock_new(void *pgaddr, size_t npages, off_t offset)
+{
+    void *pgstart;
+
+    assert(npages > 0);
+
+    pgstart = mcmmap(pgaddr, npages * sysconf(_SC_PAGE_SIZE), 
+                     PROT_READ | PROT_WRITE | PROT_EXEC, 
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
     if (pgaddr != NULL)
     {
-        if (pgaddr != block->pgstart)
-            printf("pgaddr=%p, pgstart=%p\n", pgaddr, block->pgstart);
-        assert(pgaddr == block->pgstart);
+        if (pgaddr != pgstart)
+            printf("pgaddr=%p, pgstart=%p\n", pgaddr, pgstart);
+        assert(pgaddr == pgstart);
     }
 
-    return block;
+    return __vblock_init(pgstart, npages, offset);
+}
+
+/**
+ * Maps the block at exactly [pgaddr]. With [replace], the pages replace any
+ * mapping already there, which must belong to the caller. Otherwise, NULL is
+ * returned if any of the pages is already mapped.
+ */
+struct vblock *vblock_new_fixed(void *pgaddr, size_t npages, off_t offset,
+                                bool replace)
+{
+    void *pgstart;
+
+    assert(npages > 0);
+
+    pgstart = mcmmap(pgaddr, npages * sysconf(_SC_PAGE_SIZE), 
+                     PROT_READ | PROT_WRITE | PROT_EXEC, 
+                     MAP_PRIVATE | MAP_ANONYMOUS 
+                     | (replace ? MAP_FIXED : MAP_FIXED_NOREPLACE), -1, 0);
+
+    if (pgstart == MAP_FAILED)
+        return NULL;
+
+    /* kernels without MAP_FIXED_NOREPLACE take the address as a hint */
+    if (pgstart != pgaddr)
+    {
+        mcmunmap(pgstart, npages * sysconf(_SC_PAGE_SIZE));
+        return NULL;
+    }
+
+    return __vblock_init(pgstart, npages, offset);
 }
 
 void vblock_delete(struct vblock *block)
 {
+    size_t i;
+
+    for (i = 0; i < block->npages; i++)
+        if (block->pgshadow[i] != NULL)
+            mcfree(block->pgshadow[i]);
+
+    mcfree(block->pgshadow);
+    mcfree(block->pgflags);
+
     mcmunmap(block->pgstart, block->npages * sysconf(_SC_PAGE_SIZE));
     mcfree(block);
 }
@@ -64,14 +119,20 @@ off_t vblock_pgoffset(struct vblock *block, void *addr)
     return trueoffset;
 }
 
+size_t vblock_pgindex(struct vblock *block, void *addr)
+{
+    return ((uintptr_t)addr - (uintptr_t)block->pgstart) 
+         / sysconf(_SC_PAGE_SIZE);
+}
+
 void vblock_dumptofile(struct vblock *block, FILE *file)
 {
     size_t nwrite;
 
     /* first, write the address */
     fseek(file, block->offset, SEEK_SET);
-    nwrite = fwrite(&block->pgstart, 1, sizeof(block->pgstart), file);
-    assert(nwrite == sizeof(block->pgstart));
+    nwrite = fwrite(&block->nvaddr, 1, sizeof(block->nvaddr), file);
+    assert(nwrite == sizeof(block->nvaddr));
 
     /* second, write the number of pages */
     fseek(file, block->offset + sizeof(block->pgstart), SEEK_SET);
@@ -103,3 +164,38 @@ void vblock_dumpbypage(struct vblock *block, FILE *file, void *addr)
     madvise(pgstart, sysconf(_SC_PAGE_SIZE), MADV_DONTNEED);
     memcpy(pgstart, pgcpy, sysconf(_SC_PAGE_SIZE));
 }
+
+/**
+ * Writes [src] as the file image of the page containing [addr]. Unlike
+ * [vblock_dumpbypage()], the live page is neither read nor dropped, which lets
+ * callers persist a copy of a page taken at an earlier point in time.
+ */
+void vblock_writepage(struct vblock *block, FILE *file, void *addr, 
+                      const void *src)
+{
+    off_t pgoffset, nwrite;
+
+    pgoffset = vblock_pgoffset(block, addr);
+    fseek(file, pgoffset, SEEK_SET);
+    nwrite = fwrite(src, 1, sysconf(_SC_PAGE_SIZE), file);
+    assert(nwrite == sysconf(_SC_PAGE_SIZE));
+}
+
+/**
+ * Makes the file images of the [npages] pages from the one containing [addr]
+ * read as zeroes by punching a hole over them. Page images are not aligned to
+ * filesystem blocks, so only the blocks lying wholly inside the hole are given
+ * back to the filesystem. Returns false if the filesystem cannot punch holes,
+ * in which case the caller has to write the zeroes itself.
+ */
+bool vblock_punchpages(struct vblock *block, FILE *file, void *addr, 
+                       size_t npages)
+{
+    /* nothing still buffered may land in the hole afterwards */
+    fflush(file);
+
+    return syscall(SYS_fallocate, fileno(file), 
+                   FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 
+                   vblock_pgoffset(block, addr), 
+                   npages * sysconf(_SC_PAGE_SIZE)) == 0;
+}
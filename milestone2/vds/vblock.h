@@ -5,8 +5,14 @@
 
 #include <sys/types.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 
+/* per-page state flags, stored in [pgflags] of the owning block */
+#define VBLOCK_PG_INFLIGHT      0x01    /* captured by an in-flight commit    */
+#define VBLOCK_PG_ZERO          0x02    /* all zeroes, in memory and in file  */
+
 /**
  * Non-volatile blocks of data, allocated through mmap. Despite its name having
  * the subtitle "non-volatile", the actual behavior of this block still needs 
@@ -42,21 +48,35 @@ struct vblock
     struct vtslist_elem tselem; /* so that we can insert into a vtslist       */
     size_t npages;              /* number of pages allocated in this block    */
     void *pgstart;              /* the actual start of the page               */
+    void *nvaddr;               /* address recorded in the file, [pgstart] by */
+                                /* default                                    */
 
     /* offset data                                                            */
     /* ---------------------------------------------------------------------- */
     off_t offset;               /* offset in file where block data is stored  */
     off_t offset_pgstart;       /* offset in file where page data is stored   */
+
+    /* per-page state, guarded by the owner of this block (nvstore)           */
+    /* ---------------------------------------------------------------------- */
+    uint8_t *pgflags;           /* VBLOCK_PG_* flags, one entry per page      */
+    void **pgshadow;            /* pre-write copies of in-flight pages        */
 };
 
 /* constructor and destructor functions for a non-volatile block */
 struct vblock *vblock_new(void *pgaddr, size_t npages, off_t offset);
+struct vblock *vblock_new_fixed(void *pgaddr, size_t npages, off_t offset,
+                                bool replace);
 void vblock_delete(struct vblock *block);
 
 off_t vblock_nvfsize(struct vblock *block);
 off_t vblock_pgoffset(struct vblock *block, void *addr);
+size_t vblock_pgindex(struct vblock *block, void *addr);
 
 void vblock_dumptofile(struct vblock *block, FILE *file);
 void vblock_dumpbypage(struct vblock *block, FILE *file, void *addr);
+void vblock_writepage(struct vblock *block, FILE *file, void *addr, 
+                      const void *src);
+bool vblock_punchpages(struct vblock *block, FILE *file, void *addr, 
+                       size_t npages);
 
 #endif
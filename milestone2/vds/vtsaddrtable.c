@@ -12,6 +12,8 @@
 static void __vtsaddrtable_expand(struct vtsaddrtable *table);
 static void __vtsaddrtable_insert(struct vtsaddrtable *table, 
                                   struct vblock *block);
+static void __vtsaddrtable_insert_page(struct vtsaddrtable *table, 
+                                       void *pgstart, struct vblock *block);
 static struct ventry *__vtsaddrtable_find(struct vtsaddrtable *table, 
                                           void *key);
 
@@ -54,22 +56,41 @@ static void __vtsaddrtable_expand(struct vtsaddrtable *table)
     oldcap = table->cap;
 
     table->cap <<= 1;
+    table->nelem = 0;
     table->entries = mccalloc(table->cap, sizeof(*table->entries));
 
     for (i = 0; i < oldcap; i++)
         if (oldentries[i].value != NULL)
-            __vtsaddrtable_insert(table, oldentries[i].value);
+            __vtsaddrtable_insert_page(table, oldentries[i].key, 
+                                       oldentries[i].value);
 
     mcfree(oldentries);
 }
 
+/** 
+ * Maps a single page to its block. Only the page itself is rehashed, since the
+ * other pages of its block have entries of their own.
+ */
+static void __vtsaddrtable_insert_page(struct vtsaddrtable *table, 
+                                       void *pgstart, struct vblock *block)
+{
+    struct ventry *entry;
+
+    entry = __vtsaddrtable_find(table, pgstart);
+
+    if (entry->key == NULL)
+        table->nelem++;
+
+    entry->key = pgstart;
+    entry->value = block;
+}
+
 /** 
  * Inserts unsafely into table. Implementation separated from public insertion
  * in order to support expand-insert operations.
  */
 static void __vtsaddrtable_insert(struct vtsaddrtable *table, struct vblock *block)
 {
-    struct ventry *entry;
     void *pgstart;
     size_t pgidx;
 
@@ -80,11 +101,7 @@ static void __vtsaddrtable_insert(struct vtsaddrtable *table, struct vblock *blo
             __vtsaddrtable_expand(table);
 
         pgstart = block->pgstart + (pgidx * sysconf(_SC_PAGE_SIZE));
-        entry = __vtsaddrtable_find(table, pgstart);
-
-        entry->key = pgstart;
-        entry->value = block;
-        table->nelem++;
+        __vtsaddrtable_insert_page(table, pgstart, block);
     }
 }
 
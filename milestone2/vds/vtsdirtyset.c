@@ -79,6 +79,7 @@ static void __vtsdirtyset_insert(struct vtsdirtyset *set, void *key)
 
     list_push_back(&set->buckets[hash], &entry->elem);
     list_push_back(&set->iterlist, &entry->iter);
+    set->size++;
 }
 
 /** Removes (unsafely) the specified address, if it exists.                   */
@@ -94,6 +95,7 @@ static void *__vtsdirtyset_remove(struct vtsdirtyset *set, void *key)
     list_remove(&entry->elem);
     list_remove(&entry->iter);
     __vtsdirtyaddr_delete(entry);
+    set->size--;
 
     return key;
 }
@@ -115,6 +117,7 @@ static void *__vtsdirtyset_remove_any(struct vtsdirtyset *set)
 
     list_remove(&entry->elem);
     __vtsdirtyaddr_delete(entry);
+    set->size--;
 
     return key;
 }
@@ -133,6 +136,7 @@ struct vtsdirtyset *vtsdirtyset_new()
 
     pthread_mutex_init(&set->lock, NULL);
     list_init(&set->iterlist);
+    set->size = 0;
 
     for (i = 0; i < VDIRTYSET_SIZE; i++)
         list_init(&set->buckets[i]);
@@ -192,6 +196,17 @@ void vtsdirtyset_insert(struct vtsdirtyset *set, void *addr)
     pthread_mutex_unlock(&set->lock);
 }
 
+bool vtsdirtyset_contains(struct vtsdirtyset *set, void *addr)
+{
+    bool found;
+
+    pthread_mutex_lock(&set->lock);
+    found = __vtsdirtyset_find(set, addr) != NULL;
+    pthread_mutex_unlock(&set->lock);
+
+    return found;
+}
+
 void *vtsdirtyset_remove(struct vtsdirtyset *set, void *addr)
 {
     pthread_mutex_lock(&set->lock);
@@ -201,6 +216,12 @@ void *vtsdirtyset_remove(struct vtsdirtyset *set, void *addr)
     return addr;
 }
 
+/** Number of addresses in the set, read without locking - only a snapshot */
+size_t vtsdirtyset_size(struct vtsdirtyset *set)
+{
+    return set->size;
+}
+
 void *vtsdirtyset_remove_any(struct vtsdirtyset *set)
 {
     void *addr;
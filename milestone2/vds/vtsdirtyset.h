@@ -30,6 +30,7 @@ struct vtsdirtyset
 {
     struct list buckets[VDIRTYSET_SIZE];
     struct list iterlist;
+    volatile size_t size;
     pthread_mutex_t lock;
 };
 
@@ -38,7 +39,9 @@ struct vtsdirtyset *vtsdirtyset_copy(struct vtsdirtyset *base);
 void vtsdirtyset_delete(struct vtsdirtyset *set);
 
 void vtsdirtyset_insert(struct vtsdirtyset *set, void *addr);
+bool vtsdirtyset_contains(struct vtsdirtyset *set, void *addr);
 void *vtsdirtyset_remove(struct vtsdirtyset *set, void *addr);
 void *vtsdirtyset_remove_any(struct vtsdirtyset *set);
+size_t vtsdirtyset_size(struct vtsdirtyset *set);
 
 #endif
\ No newline at end of file
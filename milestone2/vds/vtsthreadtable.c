@@ -82,4 +82,29 @@ struct crthread *vtsthreadtable_remove(pthread_t id)
         vtslist_remove(&fetch->vtselem);
 
     return fetch;
+}
+
+void vtsthreadtable_foreach(void (*func) (struct crthread *, void *), 
+                            void *aux)
+{
+    struct vtslist *vtslist;
+    struct vtslist_elem *vtselem;
+    struct list_elem *elem;
+    size_t i;
+
+    for (i = 0; i < VTHREADTABLE_SIZE; i++)
+    {
+        vtslist = &table[i];
+        pthread_mutex_lock(&vtslist->lock);
+
+        elem = list_begin(&vtslist->list);
+        while (elem != list_end(&vtslist->list))
+        {
+            vtselem = container_of(elem, struct vtslist_elem, elem);
+            func(container_of(vtselem, struct crthread, vtselem), aux);
+            elem = list_next(elem);
+        }
+
+        pthread_mutex_unlock(&vtslist->lock);
+    }
 }
\ No newline at end of file
@@ -60,4 +60,12 @@ struct crthread *vtsthreadtable_find(pthread_t id);
  */
 struct crthread *vtsthreadtable_remove(pthread_t id);
 
+/**
+ * Calls [func] on every thread handle in the table, along with [aux]. This is
+ * the one operation performed on other threads: [func] must only touch their
+ * transient fields, and must not insert into or remove from the table.
+ */
+void vtsthreadtable_foreach(void (*func) (struct crthread *, void *), 
+                            void *aux);
+
 #endif
\ No newline at end of file